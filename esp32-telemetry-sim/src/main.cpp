@@ -1,97 +1,1047 @@
 #include <Arduino.h>
 #include <ezButton.h>
+#include "telemetry_protocol.h"
+#include "telemetry_codec.h"
+#include "frame_parser.h"
+#include "rate_controller.h"
+#include "tx_scheduler.h"
+#include "vehicle_model.h"
+#include "trace_replay.h"
+#include "trace_partition.h"
+#include "uart_transport.h"
+#include "twai_bus.h"
+#include <esp_timer.h>
+#include <atomic>
+#include <stdarg.h>
 
-// ================= UART =================
+// ================= UART / CAN =================
 #define UART_TX_PIN 18
 #define UART_RX_PIN 19
-#define UART_BAUD   115200
+#define UART_BAUD   BAUD_BASE   // Boot rate; the display negotiates up from here
 
+// 1: talk to the display over CAN through a transceiver on the same two
+// pins instead of the UART. Framing is then FRAMING_PLAIN (CAN has its
+// own CRC) and baud negotiation and superframes are off.
+#define TELEMETRY_LINK_CAN 0
+#define CAN_BITRATE        1000000
+#define CAN_BYTE_RATE      (CAN_BITRATE / 16)   // ~8 data bytes per 128 bit frame
+
+// 1: feed several displays over an RS-485 style bus (BUS ADDRESSING in
+// telemetry_protocol.h); each display needs TELEMETRY_BUS and its own
+// node number. Full duplex (4 wire): our TX pair is always driven, the
+// displays take turns on the return pair when polled.
+#define TELEMETRY_BUS 0
+#define BUS_NODES     2    // Displays 1..BUS_NODES are polled in turn
+#define BUS_POLL_MS   10   // One display's uplink slot
+
+#if TELEMETRY_BUS && TELEMETRY_LINK_CAN
+#error "TELEMETRY_BUS addresses UART frames; CAN nodes already share the bus"
+#endif
+
+#if TELEMETRY_LINK_CAN
+TwaiBus canBus(UART_TX_PIN, UART_RX_PIN, CAN_BITRATE);
+CanTransport can(canBus);
+Transport &displayLink = can;
+#else
 HardwareSerial DisplaySerial(1);
+UartTransport uart(DisplaySerial);
+Transport &displayLink = uart;   // Everything below talks to the display through this
+#endif
 
 // ================= SYNC / COMMANDS =================
-#define SYNC_BYTE 0xAA
+// SYNC_BYTE, CMD_* and the frame layout live in telemetry_protocol.h,
+// DisplayData and the command payloads in telemetry_schema.h.
+//
+// The TELEMETRY_* switches below are the boot configuration. The display
+// replaces it with CTRL_CONFIGURE after the CTRL_HELLO / CMD_CAPS exchange,
+// unless it speaks another PROTOCOL_VERSION, and we return to it whenever
+// the display goes quiet for LINK_TIMEOUT_MS.
+// FRAMING_PLAIN, FRAMING_CRC or FRAMING_COBS; must match the display.
+#if TELEMETRY_LINK_CAN
+#define TELEMETRY_FRAMING FRAMING_PLAIN
+#else
+#define TELEMETRY_FRAMING FRAMING_CRC
+#endif
+
+// 1: CMD_FAST/CMD_AWARENESS only carry fields that changed (CMD_DELTA),
+// with a full keyframe every KEYFRAME_MS
+#define TELEMETRY_DELTA 0
+#define KEYFRAME_MS     500
+
+// 1: every frame carries a per-command sequence number and our micros()
+// at send time (CMD_TRACE_FLAG) so the display can measure latency and loss
+#define TELEMETRY_TRACE 0
+
+// 1: all periodic frames due in one loop pass go out as one CMD_SUPERFRAME
+// from boot. Off by default, and a display gets them only if it asks for
+// FEAT_SUPERFRAME: on the schema schedule they save ~2% of the wire bytes
+// but double the display's decode time on the 1 s tick (bench_superframe).
+#define TELEMETRY_SUPERFRAME 0
+
+// 1: velocity is also sampled every SAMPLE_INTERVAL_MS and sent in
+// batches of SAMPLE_BATCH samples (CMD_SAMPLES)
+#define TELEMETRY_SAMPLES   1
+#define SAMPLE_INTERVAL_MS  1
+#define SAMPLE_BATCH        10
+
+#define BOOT_FEATURES ((TELEMETRY_DELTA      ? FEAT_DELTA      : 0) | \
+                       (TELEMETRY_TRACE      ? FEAT_TRACE      : 0) | \
+                       (TELEMETRY_SUPERFRAME ? FEAT_SUPERFRAME : 0) | \
+                       (TELEMETRY_SAMPLES    ? FEAT_SAMPLES    : 0) | \
+                       (TELEMETRY_BUS        ? FEAT_MSG_FRAG   : 0) | FEAT_LOAD)
+
+// ================= CAPABILITIES =================
+// Everything this firmware can do, announced in CMD_CAPS
+#if TELEMETRY_LINK_CAN
+#define SIM_FEATURES (FEAT_DELTA | FEAT_SAMPLES | FEAT_TRACE | FEAT_LOAD | FEAT_MSG_FRAG | \
+                      FEAT_RX_STATS)
+#define SIM_MAX_BAUD UART_BAUD
+#elif TELEMETRY_BUS
+// Shared by every display on the bus, so only what we boot with
+#define SIM_FEATURES (BOOT_FEATURES | (TELEMETRY_FRAMING == FRAMING_COBS ? FEAT_COBS : \
+                                       TELEMETRY_FRAMING == FRAMING_CRC  ? FEAT_CRC : 0))
+#define SIM_MAX_BAUD UART_BAUD
+#else
+#define SIM_FEATURES (FEAT_CRC | FEAT_COBS | FEAT_DELTA | FEAT_SUPERFRAME | \
+                      FEAT_SAMPLES | FEAT_TRACE | FEAT_LOAD | FEAT_MSG_FRAG | FEAT_RX_STATS)
+#define SIM_MAX_BAUD 3000000
+#endif
 
-#define CMD_FAST      0x01
-#define CMD_AWARENESS 0x02
-#define CMD_GRAPH     0x03
-#define CMD_HEARTBEAT 0x04
-#define CMD_MESSAGE 0x05
+// Fastest each command may be scheduled with CTRL_SET_RATE
+const RateLimit rate_limits[] = {
+  { CMD_FAST,      5   },
+  { CMD_AWARENESS, 20  },
+  { CMD_GRAPH,     100 },
+  { CMD_HEARTBEAT, 50  },
+};
+#define RATE_LIMIT_COUNT (sizeof(rate_limits) / sizeof(rate_limits[0]))
+
+Caps sim_caps;
+uint16_t sim_caps_id;
+
+// Configuration in use; the boot one until the display configures us
+Framing  link_framing  = TELEMETRY_FRAMING;
+uint16_t link_features = BOOT_FEATURES;
+bool     link_configured = false;
+bool     config_pending = false;   // Apply pending_config once the ack is out
+LinkConfig pending_config;
 
 // ================= SIMULATION =================
+// Telemetry comes from a vehicle and battery model (vehicle_model.h)
+// stepped every SAMPLE_INTERVAL_MS
 #define LAPS_BUTTON_PIN 23
 #define ADC_VEL_PIN     4
 #define wheelR 0.5f
 #define rpm_k  2.65f
 
-#define MAX_CUSTOM_MSG_LEN 32
-char custom_msg_buf[MAX_CUSTOM_MSG_LEN + 1];
-uint8_t custom_msg_len = 0;
-bool send_custom_msg = false;
+VehicleParams vehicleParams() {
+  VehicleParams p = VEHICLE_DEFAULTS;
+  p.wheel_r_m = wheelR;
+  p.rpm_scale = rpm_k;
+  return p;
+}
 
 ezButton button(LAPS_BUTTON_PIN);
-uint16_t rpm_aux = 0;
-uint16_t vel_aux10 = 0;
 uint8_t pressCount = 0;
 
+// The ADC is the throttle: it sets the speed the model's driver aims for
+#define THROTTLE_MAX_KMH 99.9f
+
+VehicleModel vehicle(vehicleParams());
+
+// ================= TRACE REPLAY =================
+// "replay <1-100>" on the console streams the run recorded in the trace
+// partition (partitions_trace.csv) in place of the model, that many times
+// faster than it was recorded; "replay off" or the end of the trace hands
+// back to the model. Fields the trace doesn't carry keep coming from the
+// sim. Each telemetry period shows the trace as of that moment, so at
+// high speeds the records in between are skipped over.
+//
+// loop() is the loader: it rewinds the reader and keeps its buffers full.
+// The TX side consumes. replayState hands over between the two.
+#define SIM_TRACE_PARTITION "trace"
+
+enum {
+  REPLAY_OFF,
+  REPLAY_LOADING,    // loop() rewinds and fills
+  REPLAY_STARTING,   // TX side starts the clock
+  REPLAY_RUNNING,
+  REPLAY_STOPPING,   // Asked off; TX side lets go of the reader
+};
+
+PartitionTraceSource traceSource(SIM_TRACE_PARTITION);
+TraceReader traceReader(traceSource);
+TraceReplay replay(traceReader);
+std::atomic<uint8_t> replayState(REPLAY_OFF);
+uint8_t replaySpeed = 1;
+
 // ================= MESSAGE =================
-typedef enum {
-  IDLE_MSG,
-  RESET_MSG,
-  CUSTOM_MSG,
-} Message;
 Message sent_message = IDLE_MSG;
 
-// ================= DATA =================
+// ================= LONG MESSAGES =================
+// Typed messages wait here, most urgent first, and leave one
+// CMD_MESSAGE_FRAG per FAST period right behind that tick's frames.
+// Each goes out MSG_SEND_COUNT times; the display drops the repeats.
+#define MSG_OUTBOX     4
+#define MSG_SEND_COUNT 2
+
 typedef struct {
-  float battery_voltage;
-  float current_amps;
-  uint8_t laps;
-  float consumption;
-  float efficiency;
-  uint16_t rpms;
-  float velocity;
-  uint8_t tx_message;
-} DisplayData;
+  uint8_t id;
+  uint8_t priority;
+  uint8_t len;
+  uint8_t next_frag;
+  uint8_t sends_left;
+  char    text[MAX_LONG_MSG_LEN];
+} OutMessage;
 
+OutMessage outbox[MSG_OUTBOX];
+uint8_t outbox_count = 0;
+uint8_t next_msg_id = 0;
+
+// ================= DATA =================
 DisplayData sent_data;
+DisplayData last_tx;     // Values the display last received from us
+
+// ================= RATES =================
+// Per-command send periods, adjustable by the display with CTRL_SET_RATE
+uint32_t period_fast      = CMD_FAST_PERIOD_MS;
+uint32_t period_awareness = CMD_AWARENESS_PERIOD_MS;
+uint32_t period_graph     = CMD_GRAPH_PERIOD_MS;
+uint32_t period_heartbeat = CMD_HEARTBEAT_PERIOD_MS;
+
+#define MIN_PERIOD_MS 1
+#define MAX_PERIOD_MS 60000
+
+// ================= BACKPRESSURE =================
+// CMD_LOAD reports from the display pick one of these levels; each sheds
+// a bit more while keeping the fields the driver looks at most.
+// Heartbeat and graph are never slowed.
+#define LOAD_BACKLOG_FULL 2048   // Display UART bytes waiting that count as 100 %
+
+typedef struct {
+  uint8_t fast;        // CMD_FAST period multiplier
+  uint8_t awareness;   // CMD_AWARENESS period multiplier
+  bool    samples;     // 1 kHz CMD_SAMPLES batches
+} LoadLevel;
+
+const LoadLevel load_levels[] = {
+  { 1, 1, true  },     // 100 Hz FAST, everything on
+  { 2, 1, true  },     // 50 Hz FAST
+  { 2, 1, false },     // ... and no velocity samples
+  { 5, 2, false },     // 20 Hz FAST, 5 Hz AWARENESS
+};
+#define LOAD_LEVEL_COUNT (sizeof(load_levels) / sizeof(load_levels[0]))
+
+RateController rateControl(LOAD_LEVEL_COUNT - 1, LOAD_BACKLOG_FULL);
+
+// ================= CONTROL CHANNEL =================
+// A retransmitted command is acked again but not re-applied. After
+// CONTROL_DEDUP_MS the same SEQ counts as new, e.g. a rebooted display.
+#define CONTROL_DEDUP_MS 1000
+
+typedef struct {
+  uint8_t  ctrl_seq;      // Last command applied
+  uint8_t  ctrl_status;   // ... and its ack status
+  uint32_t ctrl_ms;
+  uint32_t heard_ms;      // Last valid frame, 0 = never
+  uint8_t  groups;        // CTRL_SUBSCRIBE, GROUP_ALL until then
+} Peer;
+
+// [0] is the display on a point-to-point link, [1..BUS_NODES] bus nodes
+Peer peers[BUS_NODES + 1];
+uint8_t uplink_node = ADDR_NONE;   // Peer whose frame is being handled
+
+// ================= BAUD RATE =================
+uint32_t uart_baud = UART_BAUD;
+uint32_t pending_baud = 0;      // Switch to this once the ack is out
+uint32_t last_uplink_ms = 0;    // Last valid frame from the display
 
-// ================= TIMERS =================
-unsigned long t_fast = 0;
-unsigned long t_awareness = 0;
-unsigned long t_graph = 0;
-unsigned long t_heartbeat = 0;
+void onUplinkFrame(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx);
+FrameParser uplinkParser(TELEMETRY_FRAMING, onUplinkFrame);
+
+SampleBatch vel_samples;
+
+// ================= TX TASK =================
+// 1: sampling, telemetry and all link I/O run in a high priority task
+// woken by a one-shot esp_timer armed for the scheduler's next release,
+// so they keep time whatever loop() is busy with; loop() only reads the
+// serial console. 0: loop() runs the same pass itself.
+#define SIM_TX_TASK      1
+#define TX_TASK_STACK    4096
+#define TX_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define TX_TASK_CORE     0      // loop() runs on core 1
+#define TX_MAX_SLEEP_US  1000   // Uplink is read at least this often
+#define TX_MAX_BUSY_PASSES 8    // Back to back passes before blocking a tick anyway
+
+TaskHandle_t txTaskHandle = NULL;
+esp_timer_handle_t txTimer = NULL;
+
+// ================= TX SCHEDULE =================
+// Everything periodic is released earliest deadline first, frames
+// against the link's byte rate (tx_scheduler.h). Tasks are added in this
+// order; on equal deadlines the earlier one goes first.
+enum {
+  TX_SAMPLE,      // Vehicle model step and velocity sample, SAMPLE_INTERVAL_MS
+  TX_INPUT,       // Lap button
+  TX_GENERATE,    // New telemetry values, ahead of the FAST frame
+  TX_FAST,
+  TX_AWARENESS,
+  TX_GRAPH,
+  TX_HEARTBEAT,
+  TX_KEYFRAME,
+  TX_POLL,        // Bus only
+  TX_TASK_COUNT
+};
+
+#define INPUT_PERIOD_MS    5
+#define GENERATE_PERIOD_MS 10
+
+TxScheduler txSched(TELEMETRY_LINK_CAN ? CAN_BYTE_RATE : UART_BAUD / 10);
+
+// Delta mode: the next FAST and AWARENESS after a keyframe tick go out whole
+bool keyframe_fast = false;
+bool keyframe_awareness = false;
+
+// ================= CONSOLE =================
+// loop() parses the serial console and hands what it asks for to the TX
+// pass through consoleQueue, so only the TX side touches link state
+enum { CONSOLE_IDLE, CONSOLE_MESSAGE, CONSOLE_TX_STATS, CONSOLE_STRESS };
+
+typedef struct {
+  uint8_t op;
+  uint8_t priority;                  // CONSOLE_MESSAGE
+  char    text[MAX_LONG_MSG_LEN + 1];
+} ConsoleRequest;
+
+#define CONSOLE_QUEUE_LEN 4
+QueueHandle_t consoleQueue;
+
+// Output goes the other way: a Serial.printf on the TX side can block
+// until the console drains, so txLog() only formats the line and loop()
+// prints it. Lines that find the queue full are counted instead.
+#define LOG_QUEUE_LEN 16   // One "tx" report fits
+#define LOG_LINE_LEN  160
+QueueHandle_t logQueue;
+std::atomic<uint32_t> log_dropped(0);
+
+void txLog(const char *fmt, ...) {
+  char line[LOG_LINE_LEN];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (xQueueSend(logQueue, line, 0) != pdTRUE) log_dropped++;
+}
+
+void printTxLog() {
+  char line[LOG_LINE_LEN];
+  while (xQueueReceive(logQueue, line, 0) == pdTRUE) Serial.print(line);
+  uint32_t dropped = log_dropped.exchange(0);
+  if (dropped) Serial.printf("%lu console lines dropped\n", (unsigned long)dropped);
+}
+
+// ================= STRESS =================
+// "stress <fast|awareness|graph|heartbeat>" ramps that command through
+// stress_rates_hz[], STRESS_STEP_MS per rate, as full frames next to the
+// usual traffic. Each step prints one point of the display's capacity
+// curve from its CMD_RX_STATS reports: commands decoded per second
+// against its UI pass times. Backpressure and the CTRL_SET_RATE limits
+// are set aside meanwhile; finding where they ought to sit is the point.
+// "stress off" stops early.
+#define STRESS_STEP_MS     3000
+#define STRESS_SETTLE_MS   1000   // Start of each step left out of the figures
+#define STRESS_KEPT_UP_PCT 98     // Of the commands sent, decoded in the same time
+
+const uint16_t stress_rates_hz[] = { 100, 200, 300, 500, 750, 1000, 1500, 2000 };
+#define STRESS_RATE_COUNT (sizeof(stress_rates_hz) / sizeof(stress_rates_hz[0]))
+
+typedef struct {
+  const char *name;
+  uint8_t cmd;
+  uint8_t task;
+} StressCommand;
+
+const StressCommand stress_cmds[] = {
+  { "fast",      CMD_FAST,      TX_FAST },
+  { "awareness", CMD_AWARENESS, TX_AWARENESS },
+  { "graph",     CMD_GRAPH,     TX_GRAPH },
+  { "heartbeat", CMD_HEARTBEAT, TX_HEARTBEAT },
+};
+#define STRESS_CMD_COUNT (sizeof(stress_cmds) / sizeof(stress_cmds[0]))
+
+typedef struct {
+  const StressCommand *cmd;   // NULL: off
+  uint8_t  step;              // Into stress_rates_hz[]
+  uint32_t step_ms;
+  uint32_t releases;          // Of cmd's task, all steps
+  uint16_t kept_up_hz;        // Highest rate the display kept up with
+  uint16_t link_full_hz;      // Lowest rate the link couldn't carry, 0 none
+  // This step, between the first report after settling and the newest
+  uint8_t  reports;
+  uint32_t first_ms, last_ms;
+  RxStatsReport first, last;
+  uint32_t sent_first, sent_last;           // tx_records at those reports
+  uint32_t releases_first, releases_last;
+  uint32_t ui_sum_us;
+  uint16_t ui_max_us;
+  uint32_t lag_max_us;
+} StressRun;
+
+StressRun stress;
 
 // ================= HELPERS =================
-void writeFloat(float v) {
-  union { float f; uint8_t b[4]; } u;
-  u.f = v;
-  DisplaySerial.write(u.b, 4);
+uint16_t trace_seq[128];   // Next sequence number per command
+uint32_t tx_records = 0;   // Commands sent, each superframe record counted
+uint32_t tx_oversize = 0;  // Frames dropped: no room for the trace or address prefix
+
+// Command groups some live bus node subscribed to; all of them off a bus
+// or while no display has spoken up yet
+uint8_t subscribedGroups() {
+#if TELEMETRY_BUS
+  uint8_t groups = 0;
+  uint32_t now = millis();
+  for (uint8_t n = 1; n <= BUS_NODES; n++) {
+    if (peers[n].heard_ms && now - peers[n].heard_ms <= LINK_TIMEOUT_MS) {
+      groups |= peers[n].groups;
+    }
+  }
+  return groups ? groups | GROUP_LINK : GROUP_ALL;
+#else
+  return GROUP_ALL;
+#endif
 }
 
-void writeU16(uint16_t v) {
-  DisplaySerial.write((v >> 8) & 0xFF);
-  DisplaySerial.write(v & 0xFF);
+// addr: bus node or ADDR_BROADCAST, ignored off a bus
+void sendFrameTo(uint8_t addr, uint8_t cmd, const uint8_t *payload, uint8_t len) {
+  if (addr == ADDR_BROADCAST && !(command_groups(cmd) & subscribedGroups())) return;
+  if (cmd != CMD_SUPERFRAME) tx_records++;
+
+  uint8_t wire[FRAME_MAX_WIRE];
+  uint8_t traced[FRAME_MAX_PAYLOAD];
+
+  if (link_features & FEAT_TRACE) {
+    if (TRACE_HEADER_LEN + len > FRAME_MAX_PAYLOAD) {
+      tx_oversize++;
+      return;
+    }
+    uint8_t hdr = trace_header_encode(trace_seq[cmd]++, micros(), traced);
+    memcpy(traced + hdr, payload, len);
+    payload = traced;
+    len += hdr;
+    cmd |= CMD_TRACE_FLAG;
+  }
+  size_t n = frame_encode_addr(wire, TELEMETRY_BUS ? addr : ADDR_NONE,
+                               cmd, payload, len, link_framing);
+  if (n == 0) {   // No room for the address prefix
+    tx_oversize++;
+    return;
+  }
+  displayLink.write(wire, n);
+  txSched.charge(n, micros());
 }
 
-void generate_telemetry(DisplayData *data) {
-  float raw_vel = analogRead(ADC_VEL_PIN);
+void sendFrame(uint8_t cmd, const uint8_t *payload, uint8_t len) {
+  sendFrameTo(ADDR_BROADCAST, cmd, payload, len);
+}
+
+// ================= TICK BATCHING =================
+Superframe tick_frame;
+
+// Superframe payload limit, leaving room for the address and trace
+// prefixes if on
+uint8_t superframeMaxLen() {
+  return FRAME_MAX_PAYLOAD - (TELEMETRY_BUS ? ADDR_LEN : 0) -
+         ((link_features & FEAT_TRACE) ? TRACE_HEADER_LEN : 0);
+}
+
+// Sends what queueFrame() collected this pass: nothing, a plain frame for
+// a single record, else one superframe
+void flushTick() {
+  if (tick_frame.count == 1) {
+    sendFrame(tick_frame.payload[0], &tick_frame.payload[SUPERFRAME_RECORD_HEADER],
+              tick_frame.payload[1]);
+  } else if (tick_frame.count > 1) {
+    tx_records += tick_frame.count;
+    sendFrame(CMD_SUPERFRAME, tick_frame.payload, tick_frame.len);
+  }
+  superframe_reset(&tick_frame, superframeMaxLen());
+}
+
+// Periodic telemetry goes through here; events use sendFrame() directly
+void queueFrame(uint8_t cmd, const uint8_t *payload, uint8_t len) {
+  if (!(command_groups(cmd) & subscribedGroups())) return;
+  if (!(link_features & FEAT_SUPERFRAME)) {
+    sendFrame(cmd, payload, len);
+    return;
+  }
+  if (!superframe_add(&tick_frame, cmd, payload, len)) {
+    flushTick();
+    superframe_add(&tick_frame, cmd, payload, len);
+  }
+}
+
+// ================= FRAMES =================
+// Full frame for any schema command (CMD_FAST, CMD_AWARENESS, ...)
+void sendCommand(uint8_t cmd) {
+  uint8_t payload[FRAME_MAX_PAYLOAD];
+  uint8_t len = telemetry_encode(&sent_data, cmd, payload);
+  queueFrame(cmd, payload, len);
+  telemetry_copy_fields(&last_tx, &sent_data, telemetry_command_fields(cmd));
+}
+
+// Sent the moment the lap count changes, stamped with our clock
+void sendLapEvent(uint32_t now) {
+  uint8_t payload[LAP_EVENT_LEN];
+  uint8_t len = lap_event_encode(now, pressCount, payload);
+  sendFrame(CMD_LAP_EVENT, payload, len);
+}
+
+// Sends the fields in eligible that changed since last_tx; nothing at all
+// when none did
+void sendDelta(uint32_t eligible) {
+  uint8_t mask = telemetry_diff(&sent_data, &last_tx) & eligible;
+  if (!mask) return;
+
+  uint8_t payload[FRAME_MAX_PAYLOAD];
+  uint8_t len = telemetry_encode_delta(&sent_data, mask, payload);
+  queueFrame(CMD_DELTA, payload, len);
+  telemetry_copy_fields(&last_tx, &sent_data, mask);
+}
+
+// Queues text behind anything of the same or higher priority. A full
+// outbox gives up its least urgent message, or refuses this one.
+void queueMessage(const char *text, uint8_t priority) {
+  if (outbox_count == MSG_OUTBOX) {
+    if (outbox[MSG_OUTBOX - 1].priority >= priority) {
+      txLog("Outbox full, message dropped\n");
+      return;
+    }
+    outbox_count--;
+  }
+
+  uint8_t pos = outbox_count;
+  while (pos > 0 && outbox[pos - 1].priority < priority) {
+    outbox[pos] = outbox[pos - 1];
+    pos--;
+  }
+  outbox_count++;
+
+  OutMessage &m = outbox[pos];
+  m.id = next_msg_id++;
+  m.priority = priority;
+  m.len = strnlen(text, MAX_LONG_MSG_LEN);
+  memcpy(m.text, text, m.len);
+  m.next_frag = 0;
+  m.sends_left = MSG_SEND_COUNT;
+}
+
+// Next fragment of the message at the head of the outbox. A display that
+// didn't take FEAT_MSG_FRAG gets one CMD_MESSAGE with what fits.
+void sendMessageFragment() {
+  if (!outbox_count) return;
+  OutMessage &m = outbox[0];
+
+  if (!(link_features & FEAT_MSG_FRAG)) {
+    uint8_t len = m.len < MAX_CUSTOM_MSG_LEN ? m.len : MAX_CUSTOM_MSG_LEN;
+    sendFrame(CMD_MESSAGE, (const uint8_t *)m.text, len);
+    m.sends_left = 1;
+  } else {
+    uint8_t count = m.len ? (m.len + MSG_FRAG_TEXT - 1) / MSG_FRAG_TEXT : 1;
+    uint8_t offset = m.next_frag * MSG_FRAG_TEXT;
+
+    MessageFragment f;
+    f.id = m.id;
+    f.priority = m.priority;
+    f.index = m.next_frag;
+    f.count = count;
+    f.len = m.len - offset < MSG_FRAG_TEXT ? m.len - offset : MSG_FRAG_TEXT;
+    f.text = (const uint8_t *)&m.text[offset];
+
+    uint8_t payload[MSG_FRAG_HEADER_LEN + MSG_FRAG_TEXT];
+    sendFrame(CMD_MESSAGE_FRAG, payload, msg_frag_encode(&f, payload));
+
+    if (++m.next_frag < count) return;
+    m.next_frag = 0;
+  }
+
+  if (--m.sends_left) return;
+  outbox_count--;
+  memmove(&outbox[0], &outbox[1], outbox_count * sizeof(OutMessage));
+}
+
+// CMD_FAST / CMD_AWARENESS: a delta in delta mode unless a keyframe is due
+// or the command is being stressed
+void sendPeriodic(uint8_t cmd, uint32_t fields, bool &keyframe) {
+  bool stressed = stress.cmd && stress.cmd->cmd == cmd;
+  if ((link_features & FEAT_DELTA) && !keyframe && !stressed) sendDelta(fields);
+  else                                                        sendCommand(cmd);
+  keyframe = false;
+}
+
+// Scheduler periods from the CTRL_SET_RATE periods and the load level
+void schedulePeriods(const LoadLevel &load) {
+  txSched.setPeriod(TX_FAST,      period_fast * load.fast * 1000);
+  txSched.setPeriod(TX_AWARENESS, period_awareness * load.awareness * 1000);
+  txSched.setPeriod(TX_GRAPH,     period_graph * 1000);
+  txSched.setPeriod(TX_HEARTBEAT, period_heartbeat * 1000);
+  if (stress.cmd) {
+    txSched.setPeriod(stress.cmd->task, 1000000u / stress_rates_hz[stress.step]);
+  }
+}
+
+// Display pressed reset (CTRL_RESET)
+void resetAttempt(uint32_t now) {
+  pressCount = 0;
+  vehicle.resetTrip();
+  sent_message = RESET_MSG;
+  sendLapEvent(now);
+}
+
+uint32_t *periodFor(uint8_t cmd) {
+  switch (cmd) {
+    case CMD_FAST:      return &period_fast;
+    case CMD_AWARENESS: return &period_awareness;
+    case CMD_GRAPH:     return &period_graph;
+    case CMD_HEARTBEAT: return &period_heartbeat;
+    default:            return NULL;
+  }
+}
+
+uint16_t minPeriod(uint8_t cmd) {
+  for (size_t i = 0; i < RATE_LIMIT_COUNT; i++) {
+    if (rate_limits[i].cmd == cmd) return rate_limits[i].min_period_ms;
+  }
+  return MIN_PERIOD_MS;
+}
+
+void sendCaps() {
+  uint8_t payload[FRAME_MAX_PAYLOAD];
+  uint8_t len = caps_encode(&sim_caps, payload);
+  sendFrameTo(uplink_node, CMD_CAPS, payload, len);
+}
+
+// Switches framing and features; the caller makes sure any ack is out
+void applyConfig(Framing framing, uint16_t features, bool configured) {
+  flushTick();
+  displayLink.flush();
+  link_framing = framing;
+  link_features = features;
+  link_configured = configured;
+  uplinkParser.setFraming(framing);
+  superframe_reset(&tick_frame, superframeMaxLen());
+  txLog("Link framing %u, features 0x%04X\n", framing, features);
+}
+
+uint8_t applyControl(uint8_t op, const uint8_t *args, uint8_t len) {
+  switch (op) {
+    case CTRL_RESET:
+      resetAttempt(millis());
+      return ACK_OK;
+
+    case CTRL_PING:
+      return ACK_OK;
+
+    case CTRL_SET_RATE: {
+      if (len != SET_RATE_ARGS_LEN) return ACK_BAD_ARGS;
+      uint16_t period;
+      memcpy(&period, &args[1], 2);
+      uint32_t *p = periodFor(args[0]);
+      if (!p || period < minPeriod(args[0]) || period > MAX_PERIOD_MS) return ACK_BAD_ARGS;
+      *p = period;
+      // Restart the schedule so a shorter period doesn't burst to catch up
+      schedulePeriods(load_levels[rateControl.level()]);
+      for (uint8_t t = TX_FAST; t <= TX_HEARTBEAT; t++) txSched.restart(t, micros());
+      return ACK_OK;
+    }
+
+    case CTRL_SET_BAUD: {
+      if (TELEMETRY_LINK_CAN || TELEMETRY_BUS) return ACK_UNSUPPORTED;
+      if (len != SET_BAUD_ARGS_LEN) return ACK_BAD_ARGS;
+      uint32_t baud;
+      memcpy(&baud, args, 4);
+      if (!baud_supported(baud)) return ACK_BAD_ARGS;
+      pending_baud = baud;
+      return ACK_OK;
+    }
+
+    case CTRL_PROBE: {
+      if (TELEMETRY_BUS) return ACK_UNSUPPORTED;   // Baud rate is fixed on a bus
+      if (len != PROBE_ARGS_LEN || args[0] > PROBE_MAX_COUNT) return ACK_BAD_ARGS;
+      uint8_t payload[PROBE_LEN];
+      for (uint8_t i = 0; i < args[0]; i++) {
+        sendFrame(CMD_PROBE, payload, probe_encode(i, payload));
+      }
+      return ACK_OK;
+    }
+
+    case CTRL_HELLO:
+      if (len != 1) return ACK_BAD_ARGS;
+      sendCaps();   // Ahead of the ack, so the display has it when the ack lands
+      if (args[0] != PROTOCOL_VERSION) {
+        txLog("HELLO from protocol v%u, we speak v%u\n", args[0], PROTOCOL_VERSION);
+        return ACK_BAD_VERSION;
+      }
+      return ACK_OK;
+
+    case CTRL_CONFIGURE: {
+      LinkConfig cfg;
+      if (!link_config_decode(args, len, &cfg)) return ACK_BAD_ARGS;
+      if (cfg.caps_id != sim_caps_id) return ACK_STALE;
+      if (cfg.features & ~SIM_FEATURES) return ACK_BAD_ARGS;
+      // One display can't reconfigure a link the others share
+      if (TELEMETRY_BUS) return cfg.framing == link_framing ? ACK_OK : ACK_BAD_ARGS;
+      pending_config = cfg;
+      config_pending = true;
+      return ACK_OK;
+    }
+
+    case CTRL_SUBSCRIBE:
+      if (!TELEMETRY_BUS) return ACK_UNSUPPORTED;
+      if (len != SUBSCRIBE_ARGS_LEN) return ACK_BAD_ARGS;
+      peers[uplink_node].groups = args[0] | GROUP_LINK;
+      return ACK_OK;
 
-  vel_aux10 = (uint16_t)((raw_vel / 4095.0f) * 999);
-  rpm_aux   = (uint16_t)((raw_vel / 4095.0f) * 99.9f * rpm_k / wheelR);
+    default:
+      return ACK_UNSUPPORTED;
+  }
+}
+
+void setBaud(uint32_t baud) {
+  displayLink.setBaud(baud);   // Lets the ack leave at the old rate first
+  uplinkParser.reset();        // Partial frame received at the old rate
+  uart_baud = baud;
+  txSched.setByteRate(baud / 10);
+  txLog("UART %lu baud\n", (unsigned long)baud);
+}
+
+void sendAck(uint8_t seq, uint8_t status) {
+  uint8_t payload[ACK_LEN];
+  uint8_t len = ack_encode(seq, status, payload);
+  sendFrameTo(uplink_node, CMD_ACK, payload, len);
+}
+
+void onLoadReport(const uint8_t *payload, uint8_t len) {
+  LoadReport r;
+  if (!load_decode(payload, len, &r)) return;
+
+  uint8_t before = rateControl.level();
+  if (rateControl.onReport(r, millis()) != before) {
+    txLog("Load %u%%, level %u\n", rateControl.stats().last_load, rateControl.level());
+  }
+}
+
+// Display receive counters; stress mode measures a step by them
+void onRxStats(const uint8_t *payload, uint8_t len) {
+  RxStatsReport r;
+  if (!rx_stats_decode(payload, len, &r)) return;
+  uint32_t now = millis();
+  if (!stress.cmd || now - stress.step_ms < STRESS_SETTLE_MS) return;
+
+  if (stress.reports == 0) {
+    stress.first = r;
+    stress.first_ms = now;
+    stress.sent_first = tx_records;
+    stress.releases_first = stress.releases;
+  } else {
+    // UI figures cover the time since the previous report, so only
+    // those after the first fall inside the step
+    stress.ui_sum_us += r.ui_avg_us;
+    if (r.ui_max_us > stress.ui_max_us)   stress.ui_max_us = r.ui_max_us;
+    if (r.lag_max_us > stress.lag_max_us) stress.lag_max_us = r.lag_max_us;
+  }
+  stress.last = r;
+  stress.last_ms = now;
+  stress.sent_last = tx_records;
+  stress.releases_last = stress.releases;
+  if (stress.reports < 255) stress.reports++;
+}
+
+// Uplink frames from the display: commands and reports
+void onUplinkFrame(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx) {
+  uint32_t now = millis();
+  uint8_t node = ADDR_NONE;
+#if TELEMETRY_BUS
+  if (!(cmd & CMD_ADDR_FLAG) || len < ADDR_LEN) return;
+  node = payload[0];
+  if (node < 1 || node > BUS_NODES) return;
+  cmd &= ~CMD_ADDR_FLAG;
+  payload += ADDR_LEN;
+  len -= ADDR_LEN;
+#endif
+  Peer &peer = peers[node];
+  uplink_node = node;
+  peer.heard_ms = now;
+  last_uplink_ms = now;
+
+  if (cmd == CMD_LOAD) {
+    onLoadReport(payload, len);
+    return;
+  }
+  if (cmd == CMD_RX_STATS) {
+    onRxStats(payload, len);
+    return;
+  }
+
+  uint8_t seq, op, args_len;
+  const uint8_t *args;
+  if (cmd != CMD_CONTROL) return;
+  if (!control_decode(payload, len, &seq, &op, &args, &args_len)) return;
+
+  if (seq != peer.ctrl_seq || now - peer.ctrl_ms > CONTROL_DEDUP_MS) {
+    peer.ctrl_status = applyControl(op, args, args_len);
+    peer.ctrl_seq = seq;
+  }
+  peer.ctrl_ms = now;
+  sendAck(seq, peer.ctrl_status);
+}
+
+float throttle_kmh() {
+  return analogRead(ADC_VEL_PIN) / 4095.0f * THROTTLE_MAX_KMH;
+}
+
+// Model velocity in 0.1 km/h, for the 1 kHz batches; the trace's
+// while replaying
+int16_t sample_velocity10() {
+  float v = replayState == REPLAY_RUNNING ? sent_data.velocity : vehicle.velocityKmh();
+  return (int16_t)(v * 10.0f + 0.5f);
+}
+
+void addSample(uint32_t t) {
+  if (vel_samples.count == 0) {
+    vel_samples.start_ms = t;
+    vel_samples.interval_ms = SAMPLE_INTERVAL_MS;
+  }
+  vel_samples.v[vel_samples.count++] = sample_velocity10();
+
+  if (vel_samples.count == SAMPLE_BATCH) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t len = samples_encode(&vel_samples, payload);
+    queueFrame(CMD_SAMPLES, payload, len);
+    vel_samples.count = 0;
+  }
+}
 
-  data->battery_voltage = random(220, 260) / 10.0f;
-  data->current_amps    = random(70, 100) / 10.0f;
+// A lap in the trace counts as a button press
+void replay_telemetry(DisplayData *data) {
+  uint8_t laps = data->laps;
+  if (!replay.update(millis(), data)) {
+    uint8_t running = REPLAY_RUNNING;
+    replayState.compare_exchange_strong(running, REPLAY_OFF);
+    txLog("Replay done: %lu records, %lu bad, %lu underruns\n",
+          (unsigned long)traceReader.stats().records,
+          (unsigned long)traceReader.stats().bad,
+          (unsigned long)traceReader.stats().underruns);
+  }
+  if (data->laps != laps) {
+    pressCount = data->laps;
+    sendLapEvent(millis());
+  }
+}
+
+void generate_telemetry(DisplayData *data) {
+  data->tx_message = sent_message;
+  if (replayState == REPLAY_RUNNING) {
+    replay_telemetry(data);
+    return;
+  }
+  vehicle.telemetry(data);
   data->laps            = pressCount;
-  data->consumption     = random(12000, 15000) / 100.0f;
-  data->efficiency      = random(16000, 20000) / 100.0f;
-  data->rpms            = rpm_aux;
-  data->velocity        = vel_aux10 / 10.0f;
-  data->tx_message      = sent_message;
+}
+
+// Consumer side of the replay hand-over, on the TX side
+void updateReplayState() {
+  switch (replayState) {
+    case REPLAY_STARTING: {
+      uint8_t state = REPLAY_STARTING;
+      replay.start(replaySpeed, millis());
+      replayState.compare_exchange_strong(state, REPLAY_RUNNING);
+      break;
+    }
+    case REPLAY_STOPPING:
+      replay.stop();
+      replayState = REPLAY_OFF;
+      break;
+  }
+}
+
+// Loader side, from loop()
+void serviceReplay() {
+  switch (replayState) {
+    case REPLAY_LOADING:
+      if (traceReader.restart()) {
+        traceReader.fill();
+        replayState = REPLAY_STARTING;
+        Serial.printf("Replaying at %ux\n", replaySpeed);
+      } else {
+        Serial.println("No " SIM_TRACE_PARTITION " partition");
+        replayState = REPLAY_OFF;
+      }
+      break;
+    case REPLAY_STARTING:
+    case REPLAY_RUNNING:
+      traceReader.fill();
+      break;
+  }
+}
+
+void replayCommand(const char *arg) {
+  if (strcmp(arg, "off") == 0) {
+    uint8_t state = replayState;
+    while ((state == REPLAY_STARTING || state == REPLAY_RUNNING) &&
+           !replayState.compare_exchange_weak(state, REPLAY_STOPPING)) {
+    }
+    return;
+  }
+  int speed = atoi(arg);
+  if (speed < 1 || speed > TRACE_SPEED_MAX) {
+    Serial.println("replay <1-100> | replay off");
+  } else if (replayState != REPLAY_OFF) {
+    Serial.println("Replay running, replay off first");
+  } else {
+    replaySpeed = speed;
+    replayState = REPLAY_LOADING;
+  }
+}
+
+// ----- Per-command TX timing, "tx" on the serial console -----
+void printTxStats() {
+  static const char *const names[TX_TASK_COUNT] = {
+    "sample", "input", "generate", "fast", "awareness", "graph", "heartbeat", "keyframe", "poll",
+  };
+  for (uint8_t i = 0; i < TX_TASK_COUNT; i++) {
+    const TxTaskStats &s = txSched.stats(i);
+    txLog("%-9s runs %lu, late max %lu us, jitter %lu us, deferred %lu, skipped %lu\n",
+          names[i], (unsigned long)s.runs, (unsigned long)s.late_max_us,
+          (unsigned long)txSched.jitterUs(i), (unsigned long)s.deferred,
+          (unsigned long)s.skipped);
+  }
+  if (tx_oversize) txLog("oversize  %lu frames dropped\n", (unsigned long)tx_oversize);
+  tx_oversize = 0;
+  txSched.resetStats();
+}
+
+// ----- Stress sweep, on the TX side -----
+void stressBeginStep(uint32_t now) {
+  stress.step_ms = now;
+  stress.reports = 0;
+  stress.ui_sum_us = 0;
+  stress.ui_max_us = 0;
+  stress.lag_max_us = 0;
+}
+
+void stressStart(const char *name) {
+  if (strcmp(name, "off") == 0) {
+    if (stress.cmd) txLog("Stress stopped\n");
+    stress.cmd = NULL;
+    return;
+  }
+  const StressCommand *cmd = NULL;
+  for (size_t i = 0; i < STRESS_CMD_COUNT; i++) {
+    if (strcmp(name, stress_cmds[i].name) == 0) cmd = &stress_cmds[i];
+  }
+  if (!cmd) {
+    txLog("stress <fast|awareness|graph|heartbeat|off>\n");
+    return;
+  }
+  if (!(link_features & FEAT_RX_STATS)) {
+    txLog("Stress needs a display that sends CMD_RX_STATS\n");
+    return;
+  }
+  memset(&stress, 0, sizeof(stress));
+  stress.cmd = cmd;
+  stressBeginStep(millis());
+  txLog("Stress %s: %u rates, %u ms each\n", cmd->name,
+        (unsigned)STRESS_RATE_COUNT, STRESS_STEP_MS);
+}
+
+// One point of the capacity curve. The display kept up with a rate if it
+// decoded what was sent without loss; a rate the sim couldn't reach
+// within the link's byte budget says nothing about the display.
+void stressPoint() {
+  uint16_t hz = stress_rates_hz[stress.step];
+  if (stress.reports < 2) {
+    txLog("%-9s %4u Hz: no CMD_RX_STATS from the display\n", stress.cmd->name, hz);
+    return;
+  }
+  uint32_t ms = stress.last_ms - stress.first_ms;
+  uint32_t sent = stress.sent_last - stress.sent_first;
+  uint32_t decoded = stress.last.records - stress.first.records;
+  uint32_t drops = stress.last.drops - stress.first.drops;
+  uint32_t errors = stress.last.errors - stress.first.errors;
+  uint32_t reached = (stress.releases_last - stress.releases_first) * 1000 / ms;
+
+  bool link_full = reached * 100 < (uint32_t)hz * STRESS_KEPT_UP_PCT;
+  bool kept_up = drops == 0 && errors == 0 &&
+                 (uint64_t)decoded * 100 >= (uint64_t)sent * STRESS_KEPT_UP_PCT;
+  if (link_full && !stress.link_full_hz) stress.link_full_hz = hz;
+  if (kept_up && !link_full) stress.kept_up_hz = hz;
+
+  txLog("%-9s %4u Hz: reached %4lu Hz, sent %5lu/s, decoded %5lu/s, "
+        "dropped %lu, errors %lu, UI %lu us avg %u us max, lag %lu us%s\n",
+        stress.cmd->name, hz, (unsigned long)reached,
+        (unsigned long)(sent * 1000 / ms), (unsigned long)(decoded * 1000 / ms),
+        (unsigned long)drops, (unsigned long)errors,
+        (unsigned long)(stress.ui_sum_us / (stress.reports - 1)),
+        stress.ui_max_us, (unsigned long)stress.lag_max_us,
+        !kept_up ? "  <- display behind" : link_full ? "  <- link full" : "");
+}
+
+void stressPoll(uint32_t now) {
+  if (!stress.cmd || now - stress.step_ms < STRESS_STEP_MS) return;
+  stressPoint();
+  if (++stress.step < STRESS_RATE_COUNT) {
+    stressBeginStep(now);
+    return;
+  }
+  char link[32] = "";
+  if (stress.link_full_hz) {
+    snprintf(link, sizeof(link), ", link full from %u Hz", stress.link_full_hz);
+  }
+  if (stress.kept_up_hz) {
+    txLog("Stress %s: display keeps up to %u Hz%s\n", stress.cmd->name, stress.kept_up_hz, link);
+  } else {
+    txLog("Stress %s: display behind at every rate%s\n", stress.cmd->name, link);
+  }
+  stress.cmd = NULL;
+}
+
+// ----- Console requests, applied on the TX side -----
+void applyConsoleRequests() {
+  ConsoleRequest req;
+  while (xQueueReceive(consoleQueue, &req, 0) == pdTRUE) {
+    switch (req.op) {
+      case CONSOLE_IDLE:
+        sent_message = IDLE_MSG;
+        outbox_count = 0;
+        break;
+      case CONSOLE_MESSAGE:
+        sent_message = CUSTOM_MSG;
+        queueMessage(req.text, req.priority);
+        break;
+      case CONSOLE_TX_STATS:
+        printTxStats();
+        break;
+      case CONSOLE_STRESS:
+        stressStart(req.text);
+        break;
+    }
+  }
+}
+
+void consoleRequest(uint8_t op, const char *text = "", uint8_t priority = 0) {
+  ConsoleRequest req;
+  req.op = op;
+  req.priority = priority;
+  strncpy(req.text, text, MAX_LONG_MSG_LEN);
+  req.text[MAX_LONG_MSG_LEN] = '\0';
+  if (xQueueSend(consoleQueue, &req, 0) != pdTRUE) {
+    Serial.println("Console busy, try again");
+  }
 }
 
 // ----- Serial input parser for sent_message -----
 void handleSerialInput() {
-  static char line[64];
+  static char line[MAX_LONG_MSG_LEN + 8];
   static uint8_t idx = 0;
 
   while (Serial.available()) {
@@ -103,16 +1053,25 @@ void handleSerialInput() {
 
       // ---- Parse commands ----
       if (strcmp(line, "idle") == 0) {
-        sent_message = IDLE_MSG;
+        consoleRequest(CONSOLE_IDLE);
       }
       else if (strncmp(line, "msg ", 4) == 0) {
-        sent_message = CUSTOM_MSG;
-
-        strncpy(custom_msg_buf, line + 4, MAX_CUSTOM_MSG_LEN);
-        custom_msg_buf[MAX_CUSTOM_MSG_LEN] = '\0';
-        custom_msg_len = strlen(custom_msg_buf);
-
-        send_custom_msg = true;   // trigger UART send once
+        consoleRequest(CONSOLE_MESSAGE, line + 4, MSG_PRIO_NORMAL);
+      }
+      else if (strncmp(line, "urgent ", 7) == 0) {
+        consoleRequest(CONSOLE_MESSAGE, line + 7, MSG_PRIO_URGENT);
+      }
+      else if (strncmp(line, "info ", 5) == 0) {
+        consoleRequest(CONSOLE_MESSAGE, line + 5, MSG_PRIO_INFO);
+      }
+      else if (strcmp(line, "tx") == 0) {
+        consoleRequest(CONSOLE_TX_STATS);
+      }
+      else if (strncmp(line, "stress ", 7) == 0) {
+        consoleRequest(CONSOLE_STRESS, line + 7);
+      }
+      else if (strncmp(line, "replay ", 7) == 0) {
+        replayCommand(line + 7);
       }
 
     } else if (idx < sizeof(line) - 1) {
@@ -122,89 +1081,193 @@ void handleSerialInput() {
 }
 
 
-// ================= SETUP =================
-void setup() {
-  Serial.begin(115200);
-
-  DisplaySerial.begin(UART_BAUD, SERIAL_8N1, UART_RX_PIN, UART_TX_PIN);
+// ================= TX PASS =================
+// Uplink, then every scheduled task that is due; the TX task or loop()
+// runs this
+void txPass() {
+  applyConsoleRequests();
+  updateReplayState();
 
-  analogReadResolution(12);
-  analogSetPinAttenuation(ADC_VEL_PIN, ADC_11db);
-  button.setDebounceTime(50);
+  // -------- Uplink (display commands) --------
+  static uint8_t uplink[64];
+  size_t n = displayLink.read(uplink, sizeof(uplink));
+  if (n) uplinkParser.feed(uplink, n);
 
-  Serial.println("UART Telemetry TX started");
-}
-
-void loop() {
-  uint32_t now = millis();
-  // -------- Buttons & serial input (always) --------
-  button.loop();
-  handleSerialInput();
-
-  if (button.isPressed()) {
-    pressCount++;
+  // Acked switches, applied outside the parser callback
+  if (config_pending) {
+    config_pending = false;
+    applyConfig((Framing)pending_config.framing, pending_config.features, true);
   }
-  // -------- Telemetry update @10ms --------
-  static uint32_t t_telemetry = 0;
-  if (now - t_telemetry >= 10) {
-    t_telemetry += 10;   // avoids drift
-    generate_telemetry(&sent_data);
+  if (pending_baud) {
+    setBaud(pending_baud);
+    pending_baud = 0;
   }
 
-  uint8_t byteIn = DisplaySerial.read();
-  if (byteIn == SYNC_BYTE){ //Button Press Recieved
-    pressCount = 0;
-    sent_message = RESET_MSG;
+  // Display went quiet: meet it back on the boot configuration
+  if ((uart_baud != UART_BAUD || link_configured) &&
+      millis() - last_uplink_ms > LINK_TIMEOUT_MS) {
+    if (uart_baud != UART_BAUD) setBaud(UART_BAUD);
+    if (link_configured) applyConfig(TELEMETRY_FRAMING, BOOT_FEATURES, false);
+    rateControl.reset();
   }
 
-  // ================= CMD 0x01 (FAST – 10ms) =================
-  if (now - t_fast >= 10) {
-    t_fast += 10;
-    DisplaySerial.write(SYNC_BYTE);
-    DisplaySerial.write(CMD_FAST);
-    DisplaySerial.write(6);
-    writeU16(sent_data.rpms);
-    writeFloat(sent_data.velocity);
+  // ================= SCHEDULED TASKS (earliest deadline first) =================
+  stressPoll(millis());
+  const LoadLevel &load = load_levels[stress.cmd ? 0 : rateControl.level()];
+  schedulePeriods(load);
+  bool fast_tick = false;
+  int task;
+  uint32_t due_us;
+  // At most TX_TASK_COUNT releases, so a task that outlasts its period
+  // hands control back to txTask() instead of running forever
+  for (uint8_t released = 0;
+       released < TX_TASK_COUNT && (task = txSched.next(micros(), &due_us)) >= 0;
+       released++) {
+    if (stress.cmd && task == stress.cmd->task) stress.releases++;
+    switch (task) {
+      case TX_SAMPLE:      // 1 kHz model step and velocity
+        vehicle.step(throttle_kmh(), SAMPLE_INTERVAL_MS / 1000.0f);
+        if (!(link_features & FEAT_SAMPLES)) break;
+        // Stamped with the release time, so samples stay evenly spaced
+        if (load.samples) addSample(millis() - (micros() - due_us) / 1000);
+        else              vel_samples.count = 0;
+        break;
+      case TX_INPUT:
+        button.loop();
+        if (button.isPressed()) {
+          pressCount++;
+          sendLapEvent(millis());
+        }
+        break;
+      case TX_GENERATE:
+        generate_telemetry(&sent_data);
+        break;
+      case TX_FAST:        // 0x01, 10 ms
+        sendPeriodic(CMD_FAST, CMD_FAST_FIELDS, keyframe_fast);
+        fast_tick = true;
+        break;
+      case TX_AWARENESS:   // 0x02, 100 ms
+        sendPeriodic(CMD_AWARENESS, CMD_AWARENESS_FIELDS, keyframe_awareness);
+        break;
+      case TX_GRAPH:       // 0x03, 1 s
+        sendCommand(CMD_GRAPH);
+        break;
+      case TX_HEARTBEAT:   // 0x04, 200 ms
+        sendCommand(CMD_HEARTBEAT);
+        break;
+      case TX_KEYFRAME:    // Delta mode, 500 ms
+        keyframe_fast = keyframe_awareness = true;
+        break;
+      case TX_POLL: {      // Bus: hand the return pair to the next display
+        static uint8_t poll_node = 0;
+        poll_node = poll_node % BUS_NODES + 1;
+        sendFrameTo(poll_node, CMD_POLL, NULL, 0);
+        break;
+      }
+    }
   }
+  flushTick();
+
+  // ================= CMD 0x10 (MESSAGE FRAGMENT – behind FAST) =================
+  if (fast_tick) sendMessageFragment();
+}
+
+#if SIM_TX_TASK
+void onTxTimer(void *arg) {
+  xTaskNotifyGive(txTaskHandle);
+}
 
-  // ================= CMD 0x02 (AWARENESS – 100ms) =================
-  if (now - t_awareness >= 100) {
-    t_awareness += 100;
-    DisplaySerial.write(SYNC_BYTE);
-    DisplaySerial.write(CMD_AWARENESS);
-    DisplaySerial.write(9);
-    DisplaySerial.write(sent_data.laps);
-    writeFloat(sent_data.consumption);
-    writeFloat(sent_data.efficiency);
+// Pinned to core 0, away from loop(); sleeps until the next release.
+// Running behind, it still blocks for a tick every TX_MAX_BUSY_PASSES
+// passes: IDLE0 has to run to feed the task watchdog.
+void txTask(void *arg) {
+  uint8_t busy_passes = 0;
+  for (;;) {
+    txPass();
+    uint32_t wait = txSched.idleUs(micros());
+    if (wait == 0) {
+      if (++busy_passes < TX_MAX_BUSY_PASSES) continue;
+      busy_passes = 0;
+      vTaskDelay(1);
+      continue;
+    }
+    busy_passes = 0;
+    if (wait > TX_MAX_SLEEP_US) wait = TX_MAX_SLEEP_US;
+    esp_timer_start_once(txTimer, wait);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
+}
+#endif
+
+// ================= SETUP =================
+void setup() {
+  Serial.begin(115200);
+  logQueue = xQueueCreate(LOG_QUEUE_LEN, LOG_LINE_LEN);
 
-  // ================= CMD 0x03 (GRAPH – 1s) =================
-  if (now - t_graph >= 1000) {
-    t_graph += 1000;
-    DisplaySerial.write(SYNC_BYTE);
-    DisplaySerial.write(CMD_GRAPH);
-    DisplaySerial.write(8);
-    writeFloat(sent_data.battery_voltage);
-    writeFloat(sent_data.current_amps);
+#if TELEMETRY_LINK_CAN
+  static const uint8_t uplink_cmds[] = { CMD_CONTROL, CMD_LOAD, CMD_RX_STATS };
+  can.accept(uplink_cmds, sizeof(uplink_cmds));
+  if (!canBus.begin()) {
+    Serial.printf("CAN start failed at %lu bit/s\n", (unsigned long)CAN_BITRATE);
   }
+#else
+  DisplaySerial.begin(UART_BAUD, SERIAL_8N1, UART_RX_PIN, UART_TX_PIN);
+#endif
 
-  // ================= CMD 0x04 (HEARTBEAT – 200ms) =================
-  if (now - t_heartbeat >= 200) {
-    t_heartbeat += 200;
-    DisplaySerial.write(SYNC_BYTE);
-    DisplaySerial.write(CMD_HEARTBEAT);
-    DisplaySerial.write(1);
-    DisplaySerial.write(sent_data.tx_message);
+  superframe_reset(&tick_frame, superframeMaxLen());
+  for (uint8_t n = 0; n <= BUS_NODES; n++) {
+    peers[n].groups = GROUP_ALL;
   }
 
-  // ================= CMD 0x05 (CUSTOM MESSAGE – on demand) =================
-  if (send_custom_msg) {
-    send_custom_msg = false;
+  sim_caps.version = PROTOCOL_VERSION;
+  sim_caps.features = SIM_FEATURES;
+  sim_caps.max_baud = SIM_MAX_BAUD;
+  sim_caps.limit_count = RATE_LIMIT_COUNT;
+  memcpy(sim_caps.limits, rate_limits, sizeof(rate_limits));
+  sim_caps_id = caps_id(&sim_caps);
 
-    DisplaySerial.write(SYNC_BYTE);
-    DisplaySerial.write(CMD_MESSAGE);
-    DisplaySerial.write(custom_msg_len);
-    DisplaySerial.write((uint8_t *)custom_msg_buf, custom_msg_len);
-  }
+  analogReadResolution(12);
+  analogSetPinAttenuation(ADC_VEL_PIN, ADC_11db);
+  button.setDebounceTime(50);
+
+  consoleQueue = xQueueCreate(CONSOLE_QUEUE_LEN, sizeof(ConsoleRequest));
+
+  // Sampling, generation and the keyframe produce no bytes of their own,
+  // so the link budget doesn't hold them. Sampling starts one interval
+  // in, so each batch fills on a FAST release and shares its tick (and
+  // its superframe, when on).
+  uint32_t now_us = micros();
+  txSched.add(SAMPLE_INTERVAL_MS * 1000, now_us + SAMPLE_INTERVAL_MS * 1000, false);  // TX_SAMPLE
+  txSched.add(INPUT_PERIOD_MS * 1000, now_us, false);                                // TX_INPUT
+  txSched.add(GENERATE_PERIOD_MS * 1000, now_us, false);                             // TX_GENERATE
+  txSched.add(period_fast * 1000, now_us);                                           // TX_FAST
+  txSched.add(period_awareness * 1000, now_us);                                      // TX_AWARENESS
+  txSched.add(period_graph * 1000, now_us);                                          // TX_GRAPH
+  txSched.add(period_heartbeat * 1000, now_us);                                      // TX_HEARTBEAT
+  txSched.add(KEYFRAME_MS * 1000, now_us, false);                                    // TX_KEYFRAME
+  txSched.add(TELEMETRY_BUS ? BUS_POLL_MS * 1000 : 0, now_us);                       // TX_POLL
+
+#if SIM_TX_TASK
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = onTxTimer;
+  timer_args.name = "tx";
+  esp_timer_create(&timer_args, &txTimer);
+  xTaskCreatePinnedToCore(txTask, "tx", TX_TASK_STACK, NULL,
+                          TX_TASK_PRIORITY, &txTaskHandle, TX_TASK_CORE);
+#endif
+
+  Serial.println("UART Telemetry TX started");
 }
 
+void loop() {
+  handleSerialInput();
+  printTxLog();
+  serviceReplay();
+#if SIM_TX_TASK
+  // Console and trace loading; the TX task does the rest. A fast replay
+  // goes through a buffer in a few ms.
+  delay(replayState == REPLAY_OFF ? 10 : 1);
+#else
+  txPass();
+#endif
+}
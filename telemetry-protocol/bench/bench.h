@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// ================= BENCH HELPERS =================
+// Shared by the host benchmarks. Figures are printed one line per case,
+// name first, so runs before and after a change can be diffed.
+
+static inline uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// CPU cycles where the counter is readable from user space, else 0
+static inline uint64_t bench_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// name, time per item and, when bytes is nonzero, throughput
+static inline void bench_report(const char *name, uint64_t ns, uint64_t items,
+                                uint64_t bytes)
+{
+    double per_item = items ? (double)ns / items : 0;
+    if (bytes) {
+        printf("%-32s %10.1f ns/frame %10.1f MB/s %12llu frames\n", name, per_item,
+               ns ? bytes * 1000.0 / ns : 0.0, (unsigned long long)items);
+    } else {
+        printf("%-32s %10.1f ns/frame %12llu frames\n", name, per_item,
+               (unsigned long long)items);
+    }
+}
+
+// Keeps the compiler from dropping work whose result is unused
+static inline void bench_keep(uint64_t v)
+{
+    static volatile uint64_t sink;
+    sink = v;
+}
@@ -0,0 +1,253 @@
+// One sim fanned out to N display nodes over ptys, wired as the RS-485
+// bus (see BUS ADDRESSING): every byte the sim sends reaches every node,
+// which keeps what is broadcast or addressed to it. Each node pings the
+// sim every PING_MS through a PolledTransport, so its commands wait for
+// its CMD_POLL; the sim polls the nodes in turn, one every BUS_POLL_MS.
+// Runs on a virtual millisecond clock and reports, per node count:
+//
+//   bus      bytes per second each way, and the share of LINE_BAUD
+//   fan-out  host time from the sim's write of CMD_FAST to a node's decode
+//   uplink   CTRL_PING queued -> acked, in bus milliseconds
+//   not ours frames each node parsed only to drop them
+//
+//   bench_bus_fanout [max nodes] [seconds]     defaults BUS_MAX_NODES and 5
+
+#include <memory>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "command_link.h"
+#include "frame_parser.h"
+#include "host_transport.h"
+#include "polled_transport.h"
+#include "telemetry_codec.h"
+
+// As the display's bus settings
+#define LINE_BAUD          921600
+#define BUS_POLL_MS        10
+#define SLOT_BYTES         (LINE_BAUD / 10 * BUS_POLL_MS / 1000 * 3 / 4)
+#define CMD_ACK_TIMEOUT_MS (50 + BUS_POLL_MS * BUS_MAX_NODES)
+#define PING_MS            200
+#define READ_WAIT_MS       20    // A pty hands bytes over through a kernel worker
+
+struct Node;
+static void nodeWrite(const uint8_t *data, size_t len, void *ctx);
+static void onNodeFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx);
+static void onPingResult(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx);
+
+struct Node {
+    uint8_t id;
+    PtyTransport pty;          // Node end of its pair
+    PolledTransport polled;
+    CommandLink link;
+    FrameParser parser;
+    uint32_t now;
+
+    uint32_t fast;             // CMD_FAST decoded
+    uint32_t not_ours;         // Frames for other nodes
+    uint64_t fanout_ns;        // Sum over fast
+    uint64_t fanout_max_ns;
+    uint32_t pings;            // Acked
+    uint32_t ping_sum_ms;
+
+    explicit Node(uint8_t node_id)
+        : id(node_id), polled(pty, SLOT_BYTES),
+          link(FRAMING_CRC, nodeWrite, this, CMD_ACK_TIMEOUT_MS),
+          parser(FRAMING_CRC, onNodeFrame, this), now(0), fast(0), not_ours(0),
+          fanout_ns(0), fanout_max_ns(0), pings(0), ping_sum_ms(0)
+    {
+        link.setAddress(id);
+        link.setResultHandler(onPingResult, this);
+    }
+};
+
+// ===== SIM =====
+// sim_end[i] is the sim's end of node i's pair: writes go to all of them,
+// as onto the shared TX pair; each one's return bytes get their own parser
+static std::vector<std::unique_ptr<PtyTransport>> sim_end;
+static std::vector<std::unique_ptr<FrameParser>> sim_parser;
+static std::vector<std::unique_ptr<Node>> nodes;
+
+static uint32_t sim_frames;       // Frames put on the bus
+static uint64_t bytes_down, bytes_up;
+static uint64_t fast_tx_ns;       // When the newest CMD_FAST went out
+
+static void simSendTo(uint8_t addr, uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = frame_encode_addr(wire, addr, cmd, payload, len, FRAMING_CRC);
+    if (n == 0) return;
+    if (cmd == CMD_FAST) fast_tx_ns = bench_now_ns();
+    for (auto &end : sim_end) end->write(wire, n);
+    bytes_down += n;
+    sim_frames++;
+}
+
+static void onSimFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    uint8_t seq, op, args_len;
+    const uint8_t *args;
+    if (!(cmd & CMD_ADDR_FLAG) || len < ADDR_LEN) return;
+    uint8_t from = p[0];
+    cmd &= ~CMD_ADDR_FLAG;
+    if (cmd != CMD_CONTROL ||
+        !control_decode(p + ADDR_LEN, len - ADDR_LEN, &seq, &op, &args, &args_len)) {
+        return;
+    }
+    uint8_t payload[ACK_LEN];
+    simSendTo(from, CMD_ACK, payload, ack_encode(seq, ACK_OK, payload));
+}
+
+static void simTick(uint32_t now)
+{
+    static uint8_t poll_node = 0;
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    d.rpms = now % 8000;
+    d.velocity = (now % 1000) * 0.1f;
+
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    static const struct { uint8_t cmd; uint32_t period_ms; } schedule[] = {
+        { CMD_FAST, 10 }, { CMD_AWARENESS, 100 }, { CMD_HEARTBEAT, 200 }, { CMD_GRAPH, 1000 },
+    };
+    for (const auto &s : schedule) {
+        if (now % s.period_ms == 0) {
+            simSendTo(ADDR_BROADCAST, s.cmd, payload, telemetry_encode(&d, s.cmd, payload));
+        }
+    }
+    // Only the nodes present are polled, so a node's turn comes every
+    // N * BUS_POLL_MS
+    if (now % BUS_POLL_MS == 0) {
+        poll_node = poll_node % nodes.size() + 1;
+        simSendTo(poll_node, CMD_POLL, NULL, 0);
+    }
+}
+
+// Reads end until parser has seen `want` frames, or READ_WAIT_MS passed
+static void drainUntil(PtyTransport &end, FrameParser &parser, uint32_t want, uint64_t *bytes)
+{
+    uint8_t buf[4096];
+    for (;;) {
+        size_t n = end.read(buf, sizeof(buf));
+        if (n) {
+            if (bytes) *bytes += n;
+            parser.feed(buf, n);
+            continue;
+        }
+        if (parser.stats().frames >= want) return;
+        struct pollfd p = { end.fd(), POLLIN, 0 };
+        if (poll(&p, 1, READ_WAIT_MS) <= 0) return;
+    }
+}
+
+// ===== NODES =====
+static void nodeWrite(const uint8_t *data, size_t len, void *ctx)
+{
+    ((Node *)ctx)->polled.write(data, len);
+}
+
+static void onNodeFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    Node *node = (Node *)ctx;
+    if (!(cmd & CMD_ADDR_FLAG) || len < ADDR_LEN) return;
+    if (p[0] != ADDR_BROADCAST && p[0] != node->id) {
+        node->not_ours++;
+        return;
+    }
+    cmd &= ~CMD_ADDR_FLAG;
+    p += ADDR_LEN;
+    len -= ADDR_LEN;
+
+    if (cmd == CMD_FAST) {
+        uint64_t ns = bench_now_ns() - fast_tx_ns;
+        node->fanout_ns += ns;
+        if (ns > node->fanout_max_ns) node->fanout_max_ns = ns;
+        node->fast++;
+    } else if (cmd == CMD_POLL) {
+        node->polled.grant();
+    } else if (cmd == CMD_ACK) {
+        node->link.onAck(p, len, node->now);
+    }
+}
+
+static void onPingResult(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx)
+{
+    Node *node = (Node *)ctx;
+    if (status != ACK_OK) return;
+    node->pings++;
+    node->ping_sum_ms += node->link.stats().last_ms;
+}
+
+// ===== RUN =====
+static void run(size_t count, uint32_t seconds)
+{
+    sim_end.clear();
+    sim_parser.clear();
+    nodes.clear();
+    sim_frames = 0;
+    bytes_down = bytes_up = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sim_end.emplace_back(new PtyTransport());
+        nodes.emplace_back(new Node(i + 1));
+        sim_parser.emplace_back(new FrameParser(FRAMING_CRC, onSimFrame));
+        if (!sim_end[i]->create() || !nodes[i]->pty.open(sim_end[i]->slaveName())) {
+            printf("pty setup failed\n");
+            exit(1);
+        }
+    }
+
+    uint64_t t0 = bench_now_ns();
+    for (uint32_t now = 1; now <= seconds * 1000; now++) {
+        simTick(now);
+        for (auto &node : nodes) {
+            node->now = now;
+            drainUntil(node->pty, node->parser, sim_frames, NULL);
+            if ((now + node->id * PING_MS / count) % PING_MS == 0) {
+                node->link.send(CTRL_PING, NULL, 0, now);
+            }
+            node->link.poll(now);
+        }
+        // What the polled node sent in its slot, in the order it went out
+        for (size_t i = 0; i < count; i++) {
+            drainUntil(*sim_end[i], *sim_parser[i], nodes[i]->polled.stats().frames, &bytes_up);
+        }
+    }
+    uint64_t wall_ns = bench_now_ns() - t0;
+
+    uint64_t fanout_ns = 0, fanout_max_ns = 0;
+    uint32_t fast = 0, pings = 0, ping_sum = 0, ping_max = 0, failed = 0, not_ours = 0;
+    for (auto &node : nodes) {
+        fanout_ns += node->fanout_ns;
+        if (node->fanout_max_ns > fanout_max_ns) fanout_max_ns = node->fanout_max_ns;
+        fast += node->fast;
+        pings += node->pings;
+        ping_sum += node->ping_sum_ms;
+        if (node->link.stats().max_ms > ping_max) ping_max = node->link.stats().max_ms;
+        failed += node->link.stats().failed;
+        not_ours += node->not_ours;
+    }
+
+    double line = LINE_BAUD / 10.0;
+    printf("nodes %zu: bus %6.0f B/s down (%4.1f%%) %5.0f B/s up (%4.1f%%); "
+           "fan-out %6.1f us avg %7.1f max; uplink %5.1f ms avg %3u max, %u failed; "
+           "%u/s dropped per node as not ours; %.1f us host per bus ms\n",
+           count, bytes_down / (double)seconds, 100.0 * bytes_down / seconds / line,
+           bytes_up / (double)seconds, 100.0 * bytes_up / seconds / line,
+           fast ? fanout_ns / 1e3 / fast : 0.0, fanout_max_ns / 1e3,
+           pings ? (double)ping_sum / pings : 0.0, ping_max, failed,
+           not_ours / (uint32_t)count / seconds,
+           wall_ns / 1e3 / (seconds * 1000));
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_nodes = argc > 1 ? atoi(argv[1]) : BUS_MAX_NODES;
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 5;
+    if (max_nodes < 1 || max_nodes > BUS_MAX_NODES) max_nodes = BUS_MAX_NODES;
+
+    for (size_t count = 1; count <= max_nodes; count *= 2) run(count, seconds);
+    return 0;
+}
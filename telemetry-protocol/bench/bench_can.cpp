@@ -0,0 +1,156 @@
+// CanTransport over SocketCanBus between two sockets on a virtual bus:
+// round trip of one record at a time (latency), then records pushed as
+// fast as the sender's queue takes them (throughput). vcan has no
+// bitrate, so the bus time each record would take at CAN_BITRATE is
+// reported next to what the host achieved.
+//
+//   ip link add dev vcan0 type vcan && ip link set up vcan0
+//   bench_can [ifname] [seconds]     defaults vcan0 and 2
+//
+// Exits 0 without measuring when the interface can't be opened, so the
+// benchmark can be run unconditionally.
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "can_transport.h"
+#include "frame_parser.h"
+#include "socketcan_bus.h"
+
+#define CAN_BITRATE  1000000
+#define RECORD_WAIT  100000000ull   // ns before a record counts as lost
+#define LATENCY_RUNS 10000
+#define BATCH        8              // Records written between reads
+
+// Standard data frame with n bytes, worst case bit stuffing
+static uint32_t can_frame_bits(uint8_t n)
+{
+    return 47 + 8 * n + (34 + 8 * n - 1) / 4;
+}
+
+static uint32_t record_bits(uint8_t len)
+{
+    if (len <= CAN_DATA_LEN) return can_frame_bits(len);
+    uint32_t bits = 0;
+    for (uint8_t done = 0; done < len; done += CAN_SEG_DATA) {
+        uint8_t n = len - done < CAN_SEG_DATA ? len - done : CAN_SEG_DATA;
+        bits += can_frame_bits(1 + n);
+    }
+    return bits;
+}
+
+typedef struct {
+    uint32_t records;
+    uint32_t last_seq;
+} Rx;
+
+static void onRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    Rx *rx = (Rx *)ctx;
+    memcpy(&rx->last_seq, p, 4);
+    rx->records++;
+}
+
+static void writeRecord(CanTransport &tx, uint8_t cmd, uint8_t len, uint32_t seq)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    memset(payload, 0x55, len);
+    memcpy(payload, &seq, 4);
+    uint8_t wire[FRAME_MAX_WIRE];
+    tx.write(wire, frame_encode(wire, cmd, payload, len, FRAMING_PLAIN));
+}
+
+static void drain(CanTransport &rx, FrameParser &parser)
+{
+    uint8_t buf[CAN_RX_BUFFER];
+    size_t n;
+    while ((n = rx.read(buf, sizeof(buf))) > 0) parser.feed(buf, n);
+}
+
+static void latency(CanTransport &tx, CanTransport &rx, uint8_t cmd, uint8_t len,
+                    const char *name)
+{
+    Rx got = {};
+    FrameParser parser(FRAMING_PLAIN, onRecord, &got);
+    std::vector<uint64_t> ns;
+    uint32_t lost = 0;
+
+    for (uint32_t seq = 0; seq < LATENCY_RUNS; seq++) {
+        uint32_t before = got.records;
+        uint64_t t0 = bench_now_ns();
+        writeRecord(tx, cmd, len, seq);
+        uint64_t t1;
+        do {
+            drain(rx, parser);
+            t1 = bench_now_ns();
+        } while (got.records == before && t1 - t0 < RECORD_WAIT);
+        if (got.records == before || got.last_seq != seq) {
+            lost++;
+            continue;
+        }
+        ns.push_back(t1 - t0);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    uint64_t sum = 0;
+    for (uint64_t v : ns) sum += v;
+    size_t n = ns.size();
+    printf("latency %-22s %8.1f us avg %8.1f p50 %8.1f p99 %8.1f max, %u lost "
+           "(bus time at %u bit/s: %.1f us)\n", name,
+           n ? sum / 1e3 / n : 0.0, n ? ns[n / 2] / 1e3 : 0.0,
+           n ? ns[n * 99 / 100] / 1e3 : 0.0, n ? ns[n - 1] / 1e3 : 0.0, lost,
+           CAN_BITRATE, record_bits(len) * 1e6 / CAN_BITRATE);
+}
+
+static void throughput(CanTransport &tx, CanTransport &rx, uint8_t cmd, uint8_t len,
+                       double seconds, const char *name)
+{
+    Rx got = {};
+    FrameParser parser(FRAMING_PLAIN, onRecord, &got);
+    CanStats tx_before = tx.stats(), rx_before = rx.stats();
+    uint32_t sent = 0;
+
+    uint64_t t0 = bench_now_ns();
+    uint64_t end = t0 + (uint64_t)(seconds * 1e9);
+    while (bench_now_ns() < end) {
+        for (int i = 0; i < BATCH; i++) writeRecord(tx, cmd, len, sent++);
+        drain(rx, parser);
+    }
+    uint64_t settle = bench_now_ns();
+    while (got.records < sent && bench_now_ns() - settle < RECORD_WAIT) drain(rx, parser);
+    uint64_t ns = bench_now_ns() - t0;
+
+    const CanStats &ts = tx.stats(), &rs = rx.stats();
+    char label[48];
+    snprintf(label, sizeof(label), "throughput %s", name);
+    bench_report(label, ns, got.records, (uint64_t)got.records * len);
+    printf("    %u written, %u queued, %u tx full, %u received, %u segment errors, "
+           "%u overflows; at %u bit/s the bus carries %.0f/s\n",
+           sent, ts.records_tx - tx_before.records_tx, ts.tx_full - tx_before.tx_full,
+           got.records, rs.seg_errors - rx_before.seg_errors,
+           rs.rx_overflow - rx_before.rx_overflow, CAN_BITRATE,
+           (double)CAN_BITRATE / record_bits(len));
+}
+
+int main(int argc, char **argv)
+{
+    const char *ifname = argc > 1 ? argv[1] : "vcan0";
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    SocketCanBus sim_bus, display_bus;
+    if (!sim_bus.open(ifname) || !display_bus.open(ifname)) {
+        printf("%s not available, skipped\n", ifname);
+        return 0;
+    }
+    CanTransport sim(sim_bus), display(display_bus);
+
+    static const struct { uint8_t cmd; uint8_t len; const char *name; } cases[] = {
+        { CMD_FAST,  6,         "CMD_FAST (1 frame)" },
+        { CMD_PROBE, PROBE_LEN, "CMD_PROBE (5 frames)" },
+    };
+    for (const auto &c : cases) latency(sim, display, c.cmd, c.len, c.name);
+    for (const auto &c : cases) throughput(sim, display, c.cmd, c.len, seconds, c.name);
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Framing modes side by side on the sim's own traffic mix: bytes on the
+// wire, decode time through FrameParser in UART-sized chunks, and how
+// long a receiver that lost alignment (or joined mid-stream) takes to
+// deliver a good frame again, plus how many bogus frames it delivers
+// on the way.
+//
+//   bench_framing [trials]     default 20000 resync trials per mode
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "frame_parser.h"
+#include "telemetry_codec.h"
+
+#define TICKS       20000   // 10 ms ticks of traffic, 200 s
+#define DECODE_MB   64      // Bytes pushed through the decoder per mode
+#define RX_CHUNK    256     // UART_RX_CHUNK on the display
+#define RESYNC_BAUD 115200  // For turning bytes into time
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    size_t end;             // Offset one past its last wire byte
+} Sent;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+// What the sim sends at the schema periods, with values drifting the way
+// a run does; floats and rpm regularly carry 0xAA and 0x00 bytes
+static void buildTraffic(std::vector<Sent> *frames)
+{
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    for (uint32_t tick = 0; tick < TICKS; tick++) {
+        d.rpms = (tick * 7) % 1000;
+        d.velocity = (tick % 1000) * 0.0999f;
+        d.laps = tick / 6000;
+        d.consumption = tick * 0.013f;
+        d.efficiency = 80.0f + (tick % 400) * 0.05f;
+        d.battery_voltage = 25.2f - (tick % 4200) * 0.001f;
+        d.current_amps = (tick % 450) * 0.1f;
+        d.tx_message = (tick / 3000) % 3;
+
+        uint32_t ms = tick * 10;
+        static const uint8_t cmds[] = { CMD_FAST, CMD_AWARENESS, CMD_GRAPH, CMD_HEARTBEAT };
+        static const uint32_t periods[] = { 10, 100, 1000, 200 };
+        for (size_t i = 0; i < sizeof(cmds); i++) {
+            if (ms % periods[i]) continue;
+            Sent s;
+            s.cmd = cmds[i];
+            s.len = telemetry_encode(&d, s.cmd, s.payload);
+            s.end = 0;
+            frames->push_back(s);
+        }
+    }
+}
+
+static std::vector<uint8_t> encode(std::vector<Sent> *frames, Framing framing)
+{
+    std::vector<uint8_t> out;
+    for (Sent &s : *frames) {
+        uint8_t wire[FRAME_MAX_WIRE];
+        size_t n = frame_encode(wire, s.cmd, s.payload, s.len, framing);
+        out.insert(out.end(), wire, wire + n);
+        s.end = out.size();
+    }
+    return out;
+}
+
+// ===== DECODE =====
+static uint32_t decoded;
+
+static void onDecode(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    decoded++;
+    bench_keep(cmd + len + p[0]);
+}
+
+static void benchDecode(const std::vector<uint8_t> &stream, size_t frames,
+                        Framing framing, const char *name)
+{
+    FrameParser parser(framing, onDecode, NULL);
+    uint8_t chunk[RX_CHUNK];
+    size_t passes = (size_t)DECODE_MB * 1024 * 1024 / stream.size() + 1;
+    decoded = 0;
+
+    uint64_t t0 = bench_now_ns();
+    for (size_t pass = 0; pass < passes; pass++) {
+        for (size_t pos = 0; pos < stream.size(); pos += RX_CHUNK) {
+            size_t n = stream.size() - pos < RX_CHUNK ? stream.size() - pos : RX_CHUNK;
+            memcpy(chunk, &stream[pos], n);     // The UART read, in place for COBS
+            parser.feed(chunk, n);
+        }
+    }
+    uint64_t ns = bench_now_ns() - t0;
+
+    if (decoded != frames * passes) {
+        printf("%s: decoded %u of %zu frames\n", name, decoded, frames * passes);
+        exit(1);
+    }
+    char label[48];
+    snprintf(label, sizeof(label), "decode %s", name);
+    bench_report(label, ns, decoded, (uint64_t)stream.size() * passes);
+}
+
+// ===== RESYNC =====
+typedef struct {
+    const std::vector<Sent> *frames;
+    size_t next;            // First frame that can still be delivered intact
+    size_t fed;             // Stream offset after the byte being fed
+    size_t good_at;         // Offset at which the first good frame came out
+    size_t good_index;
+    uint32_t bogus;         // Frames delivered that were never sent
+} Resync;
+
+static void onResync(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    Resync *r = (Resync *)ctx;
+    const std::vector<Sent> &f = *r->frames;
+    for (size_t i = r->next; i < f.size() && f[i].end <= r->fed; i++) {
+        if (f[i].cmd == cmd && f[i].len == len && memcmp(f[i].payload, p, len) == 0) {
+            if (!r->good_at) {
+                r->good_at = r->fed;
+                r->good_index = i;
+            }
+            r->next = i + 1;
+            return;
+        }
+    }
+    r->bogus++;
+}
+
+static void benchResync(const std::vector<uint8_t> &stream, const std::vector<Sent> &frames,
+                        Framing framing, const char *name, uint32_t trials)
+{
+    uint64_t extra_total = 0, bogus = 0, lost = 0;
+    size_t extra_max = 0;
+    uint32_t failed = 0;
+
+    for (uint32_t t = 0; t < trials; t++) {
+        // Start anywhere but in the last few frames, so one can complete
+        size_t cut = rnd(frames[frames.size() - 8].end);
+        size_t first = 0;       // First frame wholly after the cut
+        while (frames[first].end - frame_size(frames[first].len, framing) < cut) first++;
+
+        Resync r = { &frames, first, 0, 0, 0, 0 };
+        FrameParser parser(framing, onResync, &r);
+        size_t stop = frames[frames.size() - 1].end;
+        for (size_t i = cut; i < stop && !r.good_at; i++) {
+            uint8_t b = stream[i];
+            r.fed = i + 1;
+            parser.feed(&b, 1);
+        }
+        bogus += r.bogus;
+        if (!r.good_at) {
+            failed++;
+            continue;
+        }
+        // Against the best case: the first whole frame out as its last
+        // byte arrives
+        size_t extra = r.good_at - frames[first].end;
+        extra_total += extra;
+        if (extra > extra_max) extra_max = extra;
+        lost += r.good_index - first;
+    }
+
+    uint32_t ok = trials - failed;
+    printf("resync %-24s %7.2f bytes avg %5zu max extra (%6.0f us at %u), "
+           "%.3f frames lost, %llu bogus frames, %u never\n", name,
+           ok ? (double)extra_total / ok : 0.0, extra_max,
+           extra_max * 10 * 1e6 / RESYNC_BAUD, RESYNC_BAUD,
+           ok ? (double)lost / ok : 0.0, (unsigned long long)bogus, failed);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t trials = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+
+    std::vector<Sent> frames;
+    buildTraffic(&frames);
+    size_t payload = 0, syncs = 0;
+    for (const Sent &s : frames) {
+        payload += s.len;
+        for (uint8_t i = 0; i < s.len; i++) syncs += s.payload[i] == SYNC_BYTE;
+    }
+    printf("%zu frames, %zu payload bytes, %zu of them 0xAA\n",
+           frames.size(), payload, syncs);
+
+    static const struct { Framing framing; const char *name; } modes[] = {
+        { FRAMING_PLAIN, "plain (SYNC)" },
+        { FRAMING_CRC,   "crc (SYNC + CRC)" },
+        { FRAMING_COBS,  "cobs" },
+    };
+    for (const auto &m : modes) {
+        std::vector<uint8_t> stream = encode(&frames, m.framing);
+        printf("wire %-26s %8zu bytes %6.2f per frame, %5.1f%% over payload\n",
+               m.name, stream.size(), (double)stream.size() / frames.size(),
+               100.0 * (stream.size() - payload) / payload);
+        benchDecode(stream, frames.size(), m.framing, m.name);
+        benchResync(stream, frames, m.framing, m.name, trials);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+// FrameParser throughput on its own, no transport: a pre-encoded stream
+// fed in UART_RX_CHUNK spans, one byte at a time and as one span, for a
+// small, a mid-sized and a maximal payload in each framing. Reports
+// ns/frame and MB/s of wire bytes, best of RUNS to keep scheduler noise
+// out of before/after comparisons.
+//
+//   bench_parser [MB per case]     default 16
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "frame_parser.h"
+
+#define UART_RX_CHUNK 256   // As DisplayUART() reads
+#define RUNS          5
+
+static uint64_t frames_seen;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    frames_seen += len + cmd;
+}
+
+static void run(Framing framing, const char *framing_name, uint8_t len, size_t chunk,
+                const char *chunk_name, size_t stream_bytes)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    for (uint8_t i = 0; i < len; i++) payload[i] = i % 3 ? (uint8_t)(i * 37) : SYNC_BYTE;
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = frame_encode(wire, CMD_FAST, payload, len, framing);
+
+    std::vector<uint8_t> clean;
+    while (clean.size() + n <= stream_bytes) clean.insert(clean.end(), wire, wire + n);
+    size_t frames = clean.size() / n;
+    if (chunk == 0) chunk = clean.size();
+
+    uint64_t best = UINT64_MAX;
+    std::vector<uint8_t> buf;
+    for (int r = 0; r < RUNS; r++) {
+        buf = clean;   // COBS decodes in place
+        FrameParser parser(framing, onFrame);
+        uint64_t t0 = bench_now_ns();
+        for (size_t pos = 0; pos < buf.size(); pos += chunk) {
+            size_t k = buf.size() - pos < chunk ? buf.size() - pos : chunk;
+            parser.feed(&buf[pos], k);
+        }
+        uint64_t ns = bench_now_ns() - t0;
+        if (parser.stats().frames != frames) {
+            printf("%s: %u of %zu frames decoded\n", framing_name, parser.stats().frames, frames);
+            exit(1);
+        }
+        if (ns < best) best = ns;
+    }
+    bench_keep(frames_seen);
+
+    char name[48];
+    snprintf(name, sizeof(name), "%s %2u B %s", framing_name, len, chunk_name);
+    bench_report(name, best, frames, clean.size());
+}
+
+int main(int argc, char **argv)
+{
+    size_t stream_bytes = (argc > 1 ? atoi(argv[1]) : 16) << 20;
+
+    static const struct { Framing framing; const char *name; } framings[] = {
+        { FRAMING_CRC,  "crc"  },
+        { FRAMING_COBS, "cobs" },
+    };
+    static const struct { size_t chunk; const char *name; } chunks[] = {
+        { UART_RX_CHUNK, "chunked" },
+        { 1,             "bytewise" },
+        { 0,             "one span" },
+    };
+    static const uint8_t lens[] = { 6, 24, FRAME_MAX_PAYLOAD };
+
+    for (const auto &f : framings) {
+        for (uint8_t len : lens) {
+            for (const auto &c : chunks) run(f.framing, f.name, len, c.chunk, c.name, stream_bytes);
+        }
+    }
+    return 0;
+}
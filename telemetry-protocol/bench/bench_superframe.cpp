@@ -0,0 +1,138 @@
+// One superframe per scheduler tick against a frame per command, on the
+// sim's schedule (schema periods, 10 ms tick): bytes per second on the
+// wire, and the display's decode cost per tick, FrameParser through
+// telemetry_decode(), for an average tick and for the 1 s boundary where
+// every command is due at once.
+//
+//   bench_superframe [seconds of traffic decoded]     default 2000
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench.h"
+#include "frame_parser.h"
+#include "telemetry_codec.h"
+
+#define TICK_MS  10
+#define RX_CHUNK 256   // UART_RX_CHUNK on the display
+
+static const struct { uint8_t cmd; uint32_t period_ms; } schedule[] = {
+#define X(CMD, id, period_ms, fields) { CMD, period_ms },
+    TELEMETRY_COMMANDS(X)
+#undef X
+};
+
+typedef struct {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> ends;   // Offset after each tick
+    uint32_t records;
+} Stream;
+
+// One second of ticks. Like the sim, a tick with a single record goes
+// out as a plain frame.
+static void buildSecond(Stream *separate, Stream *batched, bool boundary_only)
+{
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    for (uint32_t ms = 0; ms < 1000; ms += TICK_MS) {
+        d.rpms = ms % 1000;
+        d.velocity = ms * 0.0371f;
+        d.consumption = ms * 0.0013f;
+        d.efficiency = 92.5f;
+        d.battery_voltage = 24.1f;
+        d.current_amps = 12.25f;
+
+        Superframe sf;
+        superframe_reset(&sf);
+        uint8_t wire[FRAME_MAX_WIRE];
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        uint8_t last_cmd = 0, last_len = 0;
+        uint32_t now = boundary_only ? 0 : ms;
+        for (const auto &s : schedule) {
+            if (now % s.period_ms) continue;
+            uint8_t len = telemetry_encode(&d, s.cmd, payload);
+            size_t n = frame_encode(wire, s.cmd, payload, len, FRAMING_CRC);
+            separate->bytes.insert(separate->bytes.end(), wire, wire + n);
+            separate->records++;
+            if (!superframe_add(&sf, s.cmd, payload, len)) {
+                printf("tick does not fit one superframe\n");
+                exit(1);
+            }
+            last_cmd = s.cmd;
+            last_len = len;
+        }
+        size_t n = sf.count == 1
+            ? frame_encode(wire, last_cmd, sf.payload + SUPERFRAME_RECORD_HEADER, last_len, FRAMING_CRC)
+            : frame_encode(wire, CMD_SUPERFRAME, sf.payload, sf.len, FRAMING_CRC);
+        batched->bytes.insert(batched->bytes.end(), wire, wire + n);
+        batched->records += sf.count;
+
+        separate->ends.push_back(separate->bytes.size());
+        batched->ends.push_back(batched->bytes.size());
+    }
+}
+
+// ===== DECODE =====
+// As decodeFrame() on the display: superframes are walked in place
+static DisplayData rx_data;
+static uint32_t records;
+
+static void onRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    uint32_t changed;
+    if (telemetry_decode(&rx_data, cmd, p, len, &changed)) records++;
+}
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    if (cmd == CMD_SUPERFRAME) superframe_walk(p, len, onRecord, ctx);
+    else                       onRecord(cmd, p, len, ctx);
+}
+
+static void benchDecode(const Stream &s, uint32_t seconds, const char *name)
+{
+    FrameParser parser(FRAMING_CRC, onFrame);
+    uint8_t chunk[RX_CHUNK];
+    records = 0;
+
+    uint64_t t0 = bench_now_ns(), c0 = bench_cycles();
+    for (uint32_t sec = 0; sec < seconds; sec++) {
+        // Each tick arrives as its own read, as it does at a real rate
+        size_t pos = 0;
+        for (size_t end : s.ends) {
+            memcpy(chunk, &s.bytes[pos], end - pos);
+            parser.feed(chunk, end - pos);
+            pos = end;
+        }
+    }
+    uint64_t ns = bench_now_ns() - t0, cycles = bench_cycles() - c0;
+
+    uint64_t ticks = (uint64_t)seconds * s.ends.size();
+    if (records != s.records * seconds) {
+        printf("%s: decoded %u of %llu records\n", name, records,
+               (unsigned long long)s.records * seconds);
+        exit(1);
+    }
+    printf("%-30s %8.1f ns/tick %8.1f cycles/tick %8.1f ns/record %8zu bytes/s\n",
+           name, (double)ns / ticks, (double)cycles / ticks, (double)ns / records,
+           s.bytes.size() * 1000 / (TICK_MS * s.ends.size()));
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+
+    Stream separate = {}, batched = {};
+    buildSecond(&separate, &batched, false);
+    Stream separate_peak = {}, batched_peak = {};
+    buildSecond(&separate_peak, &batched_peak, true);
+
+    printf("%u records/s: %zu bytes/s as frames, %zu as superframes (%.1f%% less)\n",
+           separate.records, separate.bytes.size(), batched.bytes.size(),
+           100.0 * (separate.bytes.size() - batched.bytes.size()) / separate.bytes.size());
+    benchDecode(separate, seconds, "frames, every tick");
+    benchDecode(batched, seconds, "superframes, every tick");
+    benchDecode(separate_peak, seconds, "frames, 1 s boundary");
+    benchDecode(batched_peak, seconds, "superframes, 1 s boundary");
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Display RX path at a real line rate: a producer thread delivers the
+// sim's byte stream into a driver-sized ring at the UART's pace, an RX
+// thread drains it the way DisplayUART() does (poll, chunked read, bulk
+// parse, 1 ms sleep when idle). Reports frames per second and bytes the
+// ring had to drop.
+//
+//   bench_uart_rx [baud] [seconds]     defaults 921600 and 2
+
+#include <atomic>
+#include <thread>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "frame_parser.h"
+#include "ring_transport.h"
+#include "telemetry_codec.h"
+
+// As in ui_assets_tutorial/src/main.cpp; the ring is the driver buffer
+#define UART_RX_BUFFER_SIZE RING_TRANSPORT_SIZE
+#define UART_RX_CHUNK       256
+#define DELIVERY_US         1000   // How often the "ISR" moves bytes in
+
+static std::atomic<bool> running(true);
+static uint32_t frames_ok = 0;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    DisplayData *d = (DisplayData *)ctx;
+    uint32_t changed;
+    if (telemetry_decode(d, cmd, p, len, &changed)) frames_ok++;
+}
+
+// Back-to-back CRC framed CMD_FAST, enough to saturate any rate
+static size_t buildStream(uint8_t *out, size_t max)
+{
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    size_t n = 0;
+    for (uint16_t i = 0; n + FRAME_MAX_WIRE <= max; i++) {
+        d.rpms = i % 1000;
+        d.velocity = (i % 1000) * 0.1f;
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        uint8_t len = telemetry_encode(&d, CMD_FAST, payload);
+        n += frame_encode(out + n, CMD_FAST, payload, len, FRAMING_CRC);
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? strtoul(argv[1], NULL, 10) : 921600;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    static uint8_t stream[1 << 16];
+    size_t stream_len = buildStream(stream, sizeof(stream));
+
+    RingPair link;
+    RingEnd &uart = link.b();
+    DisplayData rx_data;
+    memset(&rx_data, 0, sizeof(rx_data));
+    FrameParser parser(FRAMING_CRC, onFrame, &rx_data);
+    size_t max_fill = 0;
+
+    std::thread rx([&] {
+        static uint8_t chunk[UART_RX_CHUNK];
+        while (running) {
+            size_t avail = uart.available();
+            if (avail == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (avail > max_fill) max_fill = avail;
+            size_t n = uart.read(chunk, sizeof(chunk));
+            parser.feed(chunk, n);
+        }
+    });
+
+    // The UART: baud / 10 bytes per second, handed over every DELIVERY_US
+    uint64_t start = bench_now_ns();
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    uint64_t sent = 0;
+    size_t pos = 0;
+    for (uint64_t now = start; now < end; now = bench_now_ns()) {
+        uint64_t due = (now - start) * (baud / 10) / 1000000000u;
+        while (sent < due) {
+            size_t n = due - sent;
+            if (n > stream_len - pos) n = stream_len - pos;
+            link.a().write(stream + pos, n);
+            pos = (pos + n) % stream_len;
+            sent += n;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(DELIVERY_US));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));   // Let RX drain
+    running = false;
+    rx.join();
+    double elapsed = (bench_now_ns() - start) / 1e9;
+
+    const FrameParserStats &ps = parser.stats();
+    printf("%lu baud, %.1f s: %llu bytes, %.0f frames/s, dropped %lu bytes, "
+           "crc errors %lu, resyncs %lu, ring max %zu of %d\n",
+           (unsigned long)baud, elapsed, (unsigned long long)sent,
+           frames_ok / elapsed, (unsigned long)link.a().dropped(),
+           (unsigned long)ps.crc_errors, (unsigned long)ps.resyncs, max_fill,
+           UART_RX_BUFFER_SIZE);
+    return link.a().dropped() ? 1 : 0;
+}
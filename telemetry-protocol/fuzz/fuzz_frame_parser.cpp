@@ -0,0 +1,157 @@
+// Fuzz target for the display's receive path: FrameParser::feed() and the
+// telemetry_dispatch() the display runs on what comes out of it (address
+// filter, trace prefixes, superframes, group filter, every payload decoder),
+// then message reassembly and the ack and caps decoders the display's UI
+// loop applies to the queued events.
+//
+// Input: byte 0 picks the framing and, with its top bit, whether we are a
+// bus node or on a point-to-point link; byte 1 seeds the chunk sizes the
+// rest is fed in, so the fuzzer also explores where the transport splits
+// the stream. Besides the sanitizers, it checks that nothing longer than
+// FRAME_MAX_PAYLOAD is ever delivered and that the parser comes back:
+// a valid frame fed after the input must arrive.
+//
+// With clang and -DTELEMETRY_FUZZ=ON this links against libFuzzer. Any
+// other build gets a main() that runs each file named on the command
+// line, or stdin when there are none, once; that is what AFL drives:
+//
+//   afl-fuzz -i seeds -o findings -- ./fuzz_frame_parser
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "frame_parser.h"
+#include "message_board.h"
+#include "telemetry_dispatch.h"
+
+#define CANARY_CMD 0x3F
+
+static DisplayData data;
+static uint32_t changed;
+static MessageBoard board(0);
+static uint32_t fuzz_ms;
+static bool canary;
+
+static void fuzz_assert(bool ok, const char *what)
+{
+    if (ok) return;
+    fprintf(stderr, "fuzz_frame_parser: %s\n", what);
+    abort();
+}
+
+// What the display's handlers and its UI loop do with each kind, minus
+// the queues in between
+static void onRecord(uint8_t cmd, void *ctx)
+{
+    if (cmd == CANARY_CMD) canary = true;
+}
+
+static void onSamples(const SampleBatch *b, void *ctx)
+{
+    fuzz_assert(b->count <= SAMPLE_BATCH_MAX, "sample batch overflow");
+}
+
+static void onEvent(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    switch (cmd) {
+        case CMD_CAPS: {
+            Caps c;
+            caps_decode(p, len, &c);
+            break;
+        }
+        case CMD_ACK: {
+            uint8_t seq, status;
+            ack_decode(p, len, &seq, &status);
+            break;
+        }
+        case CMD_MESSAGE_FRAG: {
+            MessageFragment f;
+            if (msg_frag_decode(p, len, &f)) board.onFragment(f, fuzz_ms);
+            board.update(fuzz_ms);
+            break;
+        }
+        case CMD_MESSAGE:
+            board.post((const char *)p, len, MSG_PRIO_NORMAL, fuzz_ms);
+            break;
+    }
+}
+
+static TelemetryDispatch dispatch;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    fuzz_assert(len <= FRAME_MAX_PAYLOAD, "payload longer than FRAME_MAX_PAYLOAD");
+    telemetry_dispatch(&dispatch, cmd, p, len);
+    fuzz_ms += 10;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size)
+{
+    if (size < 2) return 0;
+    Framing framing = (Framing)(input[0] % 3);
+    uint32_t chunks = input[1] | 1;
+
+    // The top bit of byte 0 makes us bus node 1, taking part of the groups
+    bool bus = input[0] & 0x80;
+    dispatch.node      = bus ? 1 : ADDR_NONE;
+    dispatch.groups    = bus ? GROUP_FAST | GROUP_STATUS : GROUP_ALL;
+    dispatch.data      = &data;
+    dispatch.changed   = &changed;
+    dispatch.record    = onRecord;
+    dispatch.samples   = onSamples;
+    dispatch.event     = onEvent;
+
+    // feed() may write into the span (COBS decodes in place)
+    std::vector<uint8_t> buf(input + 2, input + size);
+    FrameParser parser(framing, onFrame);
+    for (size_t pos = 0; pos < buf.size();) {
+        chunks = chunks * 1103515245u + 12345u;
+        size_t n = 1 + (chunks >> 16) % 97;
+        if (n > buf.size() - pos) n = buf.size() - pos;
+        parser.feed(&buf[pos], n);
+        pos += n;
+    }
+
+    // Whatever the input left behind, a maximal frame of idle line and a
+    // good frame get through
+    uint8_t tail[FRAME_MAX_SIZE + FRAME_MAX_WIRE];
+    memset(tail, 0, FRAME_MAX_SIZE);
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+    size_t n = FRAME_MAX_SIZE + frame_encode(&tail[FRAME_MAX_SIZE], CANARY_CMD, payload,
+                                             sizeof(payload), framing);
+    canary = false;
+    parser.feed(tail, n);
+    fuzz_assert(canary, "parser stuck after the input");
+    return 0;
+}
+
+#ifndef TELEMETRY_LIBFUZZER
+static void runFile(FILE *f)
+{
+    std::vector<uint8_t> input;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) input.insert(input.end(), buf, buf + n);
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        runFile(stdin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return 1;
+        }
+        runFile(f);
+        fclose(f);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,176 @@
+#include "baud_negotiator.h"
+#include <string.h>
+
+BaudNegotiator::BaudNegotiator(CommandLink &link, SetBaud set_baud, void *ctx)
+    : _link(link), _set_baud(set_baud), _ctx(ctx),
+      _started(false), _max_baud(UINT32_MAX), _state(BAUD_STATE_BASE), _baud(BAUD_BASE), _next(BAUD_RATE_COUNT),
+      _since_ms(0), _ping_ms(0), _probe_sent(false), _probe_acked(false),
+      _switched(false), _win_ms(0)
+{
+    memset(&_mark, 0, sizeof(_mark));
+    memset(&_win, 0, sizeof(_win));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void BaudNegotiator::setBaud(uint32_t baud)
+{
+    if (baud == _baud) return;
+    _baud = baud;
+    _set_baud(baud, _ctx);
+    _switched = true;   // Restart the error window from the next counters
+}
+
+void BaudNegotiator::start(uint32_t now_ms, uint32_t max_baud)
+{
+    setBaud(BAUD_BASE);
+    _started = true;
+    _max_baud = max_baud;
+    _state = BAUD_STATE_BASE;
+    _since_ms = now_ms;
+
+    for (_next = 0; _next < BAUD_RATE_COUNT; _next++) {
+        if (baud_rates[_next] <= max_baud) {
+            request(now_ms);
+            return;
+        }
+    }
+    _started = false;   // Nothing faster than BAUD_BASE to try
+}
+
+void BaudNegotiator::stop()
+{
+    setBaud(BAUD_BASE);
+    _started = false;
+    _state = BAUD_STATE_BASE;
+}
+
+void BaudNegotiator::request(uint32_t now_ms)
+{
+    uint32_t baud = baud_rates[_next];
+    uint8_t args[SET_BAUD_ARGS_LEN];
+    memcpy(args, &baud, SET_BAUD_ARGS_LEN);
+
+    _stats.attempts++;
+    _state = BAUD_STATE_REQUEST;
+    _since_ms = now_ms;
+    if (!_link.send(CTRL_SET_BAUD, args, SET_BAUD_ARGS_LEN, now_ms)) {
+        fallBack(now_ms);
+    }
+}
+
+// Current rate (or the one being tried) is no good: back to BAUD_BASE,
+// then on to the next slower rate once the sim has timed out too
+void BaudNegotiator::fallBack(uint32_t now_ms)
+{
+    if (_state == BAUD_STATE_LOCKED) _stats.fallbacks++;
+    setBaud(BAUD_BASE);
+    _next++;
+    _state = (_next < BAUD_RATE_COUNT) ? BAUD_STATE_HOLDOFF : BAUD_STATE_BASE;
+    _since_ms = now_ms;
+}
+
+void BaudNegotiator::onResult(uint8_t op, uint8_t status, uint32_t now_ms)
+{
+    switch (op) {
+        case CTRL_SET_BAUD:
+            if (_state != BAUD_STATE_REQUEST) return;
+            if (status != ACK_OK) {
+                fallBack(now_ms);
+                return;
+            }
+            // The sim switched right after acking; follow, and probe from
+            // the next poll() once counters taken at the new rate are in
+            setBaud(baud_rates[_next]);
+            _state = BAUD_STATE_PROBE;
+            _since_ms = now_ms;
+            _ping_ms = now_ms;
+            _probe_sent = false;
+            _probe_acked = false;
+            break;
+
+        case CTRL_PROBE:
+            if (_state != BAUD_STATE_PROBE) return;
+            if (status != ACK_OK) fallBack(now_ms);
+            else                  _probe_acked = true;   // Judged in poll()
+            break;
+
+        case CTRL_PING:
+            if (_state == BAUD_STATE_LOCKED && status == LINK_TIMEOUT) {
+                fallBack(now_ms);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void BaudNegotiator::poll(uint32_t now_ms, const BaudLinkCounters &c)
+{
+    // Bytes the old rate garbled were flushed with the switch; count from
+    // here, not from counters taken before it
+    if (_switched) {
+        _switched = false;
+        _win_ms = now_ms;
+        _win = c;
+    }
+
+    // Keep the sim from timing out while we are off BAUD_BASE
+    if (_baud != BAUD_BASE && _link.idle() &&
+        now_ms - _ping_ms >= BAUD_KEEPALIVE_MS) {
+        _ping_ms = now_ms;
+        _link.send(CTRL_PING, NULL, 0, now_ms);
+    }
+
+    // Error rate at whatever rate is in use; only a locked rate is dropped
+    if (now_ms - _win_ms >= BAUD_ERROR_WINDOW_MS) {
+        uint32_t frames = c.frames - _win.frames;
+        uint32_t errors = c.errors - _win.errors;
+        uint32_t total = frames + errors;
+        _win_ms = now_ms;
+        _win = c;
+        if (total >= BAUD_ERROR_MIN_FRAMES) {
+            _stats.error_ppm = (uint32_t)((uint64_t)errors * 1000000 / total);
+            if (_state == BAUD_STATE_LOCKED && _stats.error_ppm > BAUD_MAX_ERROR_PPM) {
+                fallBack(now_ms);
+                return;
+            }
+        }
+    }
+
+    switch (_state) {
+        case BAUD_STATE_PROBE:
+            if (!_probe_sent) {
+                uint8_t count = BAUD_PROBE_FRAMES;
+                _mark = c;
+                _probe_sent = true;
+                if (!_link.send(CTRL_PROBE, &count, PROBE_ARGS_LEN, now_ms)) {
+                    fallBack(now_ms);
+                }
+            } else if (_probe_acked) {
+                // The ack follows the burst, so every probe frame is in
+                bool clean = c.probes - _mark.probes == BAUD_PROBE_FRAMES &&
+                             c.errors == _mark.errors;
+                if (!clean) {
+                    fallBack(now_ms);
+                    return;
+                }
+                _state = BAUD_STATE_LOCKED;
+                _since_ms = now_ms;
+                _win_ms = now_ms;
+                _win = c;
+            }
+            break;
+
+        case BAUD_STATE_HOLDOFF:
+            if (now_ms - _since_ms >= BAUD_HOLDOFF_MS) request(now_ms);
+            break;
+
+        case BAUD_STATE_BASE:
+            if (_started && now_ms - _since_ms >= BAUD_RETRY_MS) start(now_ms, _max_baud);
+            break;
+
+        default:
+            break;
+    }
+}
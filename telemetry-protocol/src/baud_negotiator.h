@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include "command_link.h"
+
+// ================= BAUD NEGOTIATOR =================
+// Display side of the baud handshake described in telemetry_protocol.h.
+// Pure state machine: the caller switches its UART in the set_baud
+// callback, feeds command results from the CommandLink and, every loop
+// pass, the running RX counters that decide whether a rate is healthy.
+// set_baud must drop RX bytes still waiting (Transport::setBaud() does):
+// they were sent at the other rate, and the counters the next poll()
+// brings are the baseline for judging the new one.
+//
+//   BASE --SET_BAUD acked--> PROBE --burst clean--> LOCKED
+//     ^                        | burst dirty / timeout   | errors above
+//     |                        v                         | threshold
+//     +------------------- HOLDOFF <---------------------+
+//
+// HOLDOFF waits out the sim's link timeout at BAUD_BASE, then tries the
+// next slower rate. Once every rate has failed it stays at BAUD_BASE and
+// starts over from the top after BAUD_RETRY_MS (the sim may have been
+// rebooting or unplugged).
+
+#define BAUD_PROBE_FRAMES     32
+#define BAUD_HOLDOFF_MS       (LINK_TIMEOUT_MS + 250)
+#define BAUD_RETRY_MS         30000
+#define BAUD_ERROR_WINDOW_MS  1000
+#define BAUD_ERROR_MIN_FRAMES 20     // Windows with fewer are not judged
+#define BAUD_MAX_ERROR_PPM    10000  // 1 % of frames bad -> fall back
+
+typedef struct {
+    uint32_t frames;   // Good frames received, running total
+    uint32_t errors;   // CRC / framing errors, running total
+    uint32_t probes;   // Intact CMD_PROBE frames, running total
+} BaudLinkCounters;
+
+typedef struct {
+    uint32_t attempts;     // SET_BAUD requests made
+    uint32_t fallbacks;    // Rates abandoned after being in use
+    uint32_t error_ppm;    // Bad frames per million, last judged window
+} BaudStats;
+
+class BaudNegotiator
+{
+public:
+    enum State { BAUD_STATE_BASE, BAUD_STATE_REQUEST, BAUD_STATE_PROBE,
+                 BAUD_STATE_LOCKED, BAUD_STATE_HOLDOFF };
+
+    typedef void (*SetBaud)(uint32_t baud, void *ctx);
+
+    BaudNegotiator(CommandLink &link, SetBaud set_baud, void *ctx = NULL);
+
+    // Starts from the fastest rate up to max_baud (the sim's MAX_BAUD)
+    void start(uint32_t now_ms, uint32_t max_baud = UINT32_MAX);
+
+    // Back to BAUD_BASE and idle, e.g. when the link was lost
+    void stop();
+
+    void poll(uint32_t now_ms, const BaudLinkCounters &c);
+    void onResult(uint8_t op, uint8_t status, uint32_t now_ms);
+
+    State state() const { return _state; }
+    uint32_t baud() const { return _baud; }
+    const BaudStats &stats() const { return _stats; }
+
+private:
+    void request(uint32_t now_ms);
+    void fallBack(uint32_t now_ms);
+    void setBaud(uint32_t baud);
+
+    CommandLink &_link;
+    SetBaud _set_baud;
+    void *_ctx;
+
+    bool _started;
+    uint32_t _max_baud;
+    State _state;
+    uint32_t _baud;
+    uint8_t _next;           // Index into baud_rates[] to try next
+    uint32_t _since_ms;      // Entered current state / window start
+    uint32_t _ping_ms;
+    bool _probe_sent;
+    bool _probe_acked;
+    bool _switched;          // set_baud called since the last poll()
+    BaudLinkCounters _mark;  // When the probe was requested
+    uint32_t _win_ms;        // Error rate window
+    BaudLinkCounters _win;
+
+    BaudStats _stats;
+};
@@ -0,0 +1,205 @@
+#include "can_transport.h"
+#include "telemetry_codec.h"
+#include <string.h>
+
+// Index = priority. Rate monotonic: the 10 ms commands first, the 1 s
+// ones last; the uplink goes first so acks never wait behind telemetry.
+static const uint8_t can_commands[] = {
+    CMD_CONTROL, CMD_ACK, CMD_FAST, CMD_SAMPLES, CMD_DELTA, CMD_LAP_EVENT,
+    CMD_AWARENESS, CMD_LOAD, CMD_RX_STATS, CMD_HEARTBEAT, CMD_GRAPH, CMD_MESSAGE,
+    CMD_MESSAGE_FRAG, CMD_CAPS, CMD_PROBE,
+};
+static_assert(sizeof(can_commands) <= CAN_PRIORITIES, "PRIO is 4 bits");
+
+uint8_t can_priority(uint8_t cmd)
+{
+    for (uint8_t i = 0; i < sizeof(can_commands); i++) {
+        if (can_commands[i] == cmd) return i;
+    }
+    return CAN_NO_PRIORITY;
+}
+
+void can_acceptance(const uint32_t *ids, size_t count, uint32_t *code, uint32_t *mask)
+{
+    *code = count ? ids[0] : 0;
+    *mask = count ? 0 : 0x7FF;
+    for (size_t i = 1; i < count; i++) {
+        *mask |= ids[i] ^ *code;
+    }
+    *code &= ~*mask;
+}
+
+CanTransport::CanTransport(CanBus &bus)
+    : _bus(bus), _accept(0xFFFF), _tx_len(0), _rx_len(0)
+{
+    memset(_slots, 0, sizeof(_slots));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void CanTransport::accept(const uint8_t *cmds, size_t count)
+{
+    uint32_t ids[CAN_PRIORITIES * 4];
+    size_t n = 0;
+    _accept = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t prio = can_priority(cmds[i]);
+        if (prio == CAN_NO_PRIORITY || (_accept & (1u << prio))) continue;
+        _accept |= 1u << prio;
+        for (uint8_t v = 0; v < 4; v++) {   // Traced or not, whole or segmented
+            ids[n++] = can_id(prio, v & 2, v & 1);
+        }
+    }
+    _bus.setFilter(ids, n);
+}
+
+// ================= TX =================
+size_t CanTransport::write(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (_tx_len == 0 && data[i] != SYNC_BYTE) continue;   // Not FRAMING_PLAIN
+        _tx[_tx_len++] = data[i];
+
+        if (_tx_len < FRAME_HEADER_LEN) continue;
+        uint8_t plen = _tx[2];
+        if (plen > FRAME_MAX_PAYLOAD) {
+            _tx_len = 0;
+            continue;
+        }
+        if (_tx_len < (size_t)FRAME_HEADER_LEN + plen) continue;
+
+        uint8_t cmd = _tx[1];
+        if (cmd == CMD_SUPERFRAME) {
+            superframe_walk(&_tx[FRAME_HEADER_LEN], plen, onRecord, this);
+        } else if (cmd == (CMD_SUPERFRAME | CMD_TRACE_FLAG)) {
+            // Records go out on their own IDs; the trace prefix is lost
+            if (plen >= TRACE_HEADER_LEN) {
+                superframe_walk(&_tx[FRAME_HEADER_LEN + TRACE_HEADER_LEN],
+                                plen - TRACE_HEADER_LEN, onRecord, this);
+            }
+        } else {
+            sendRecord(cmd, &_tx[FRAME_HEADER_LEN], plen);
+        }
+        _tx_len = 0;
+    }
+    return len;
+}
+
+void CanTransport::onRecord(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx)
+{
+    static_cast<CanTransport *>(ctx)->sendRecord(cmd, payload, len);
+}
+
+void CanTransport::sendRecord(uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    uint8_t prio = can_priority(cmd & ~CMD_TRACE_FLAG);
+    if (prio == CAN_NO_PRIORITY) return;
+    bool trace = cmd & CMD_TRACE_FLAG;
+
+    CanFrame f;
+    if (len <= CAN_DATA_LEN) {
+        f.id = can_id(prio, trace, false);
+        f.len = len;
+        memcpy(f.data, payload, len);
+        if (!_bus.send(f)) {
+            _stats.tx_full++;
+            return;
+        }
+        _stats.frames_tx++;
+        _stats.records_tx++;
+        return;
+    }
+
+    uint8_t count = (len + CAN_SEG_DATA - 1) / CAN_SEG_DATA;
+    f.id = can_id(prio, trace, true);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t n = len - i * CAN_SEG_DATA;
+        if (n > CAN_SEG_DATA) n = CAN_SEG_DATA;
+        f.len = 1 + n;
+        f.data[0] = i << 4 | (count - 1);
+        memcpy(&f.data[1], payload + i * CAN_SEG_DATA, n);
+        if (!_bus.send(f)) {
+            _stats.tx_full++;   // The receiver drops the partial record
+            return;
+        }
+        _stats.frames_tx++;
+    }
+    _stats.records_tx++;
+}
+
+// ================= RX =================
+void CanTransport::pump()
+{
+    CanFrame f;
+    while (_bus.receive(f)) {
+        receive(f);
+    }
+}
+
+void CanTransport::receive(const CanFrame &f)
+{
+    _stats.frames_rx++;
+    uint32_t rel = f.id - CAN_ID_BASE;
+    uint8_t prio = rel >> 2;
+    if (f.id < CAN_ID_BASE || prio >= sizeof(can_commands) || !(_accept & (1u << prio))) {
+        _stats.filtered++;
+        return;
+    }
+    uint8_t cmd = can_commands[prio] | ((rel & 2) ? CMD_TRACE_FLAG : 0);
+
+    if (!(rel & 1)) {
+        deliver(cmd, f.data, f.len);
+        return;
+    }
+
+    if (f.len < 2) return;
+    uint8_t index = f.data[0] >> 4;
+    uint8_t count = (f.data[0] & 0x0F) + 1;
+    uint8_t n = f.len - 1;
+    Slot &s = _slots[prio];
+
+    if (index == 0) {
+        if (s.count) _stats.seg_errors++;   // Previous record never finished
+        s.count = count;
+        s.next = 0;
+        s.len = 0;
+    }
+    if (!s.count || index != s.next || count != s.count ||
+        s.len + n > FRAME_MAX_PAYLOAD) {
+        if (s.count) _stats.seg_errors++;
+        s.count = 0;
+        return;
+    }
+
+    memcpy(&s.data[s.len], &f.data[1], n);
+    s.len += n;
+    if (++s.next == s.count) {
+        s.count = 0;
+        deliver(cmd, s.data, s.len);
+    }
+}
+
+void CanTransport::deliver(uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    if (_rx_len + FRAME_HEADER_LEN + len > sizeof(_rx)) {
+        _stats.rx_overflow++;
+        return;
+    }
+    _rx_len += frame_encode(&_rx[_rx_len], cmd, payload, len, FRAMING_PLAIN);
+    _stats.records_rx++;
+}
+
+size_t CanTransport::available()
+{
+    pump();
+    return _rx_len;
+}
+
+size_t CanTransport::read(uint8_t *buf, size_t len)
+{
+    pump();
+    if (len > _rx_len) len = _rx_len;
+    memcpy(buf, _rx, len);
+    memmove(_rx, &_rx[len], _rx_len - len);
+    _rx_len -= len;
+    return len;
+}
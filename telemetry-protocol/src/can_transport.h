@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_protocol.h"
+#include "transport.h"
+
+// ================= CAN TRANSPORT =================
+// Carries the protocol over a CAN bus instead of a UART. CAN already
+// delimits, checksums and retransmits frames, so each protocol record
+// maps straight to CAN frames and the serial framing is only kept at the
+// Transport boundary: write() takes FRAMING_PLAIN frames (both ends must
+// run with FRAMING_PLAIN) and read() hands back FRAMING_PLAIN frames
+// rebuilt from whole records. A CMD_SUPERFRAME is split into its records,
+// since on CAN each record is arbitrated on its own.
+//
+// Standard 11 bit ID: CAN_ID_BASE | PRIO << 2 | TRACE << 1 | SEG
+//   PRIO   can_priority(cmd); lower wins arbitration, ordered by rate
+//          with the command uplink ahead of everything
+//   TRACE  the record had CMD_TRACE_FLAG set
+//   SEG    0: the record is the whole data field (up to 8 bytes)
+//          1: data = INDEX << 4 | (COUNT - 1), then up to 7 record bytes
+//
+// Only one sender uses each ID and a CAN controller sends in order, so
+// segments of a record arrive back to back; a gap drops the record.
+
+#define CAN_ID_BASE     0x100
+#define CAN_DATA_LEN    8
+#define CAN_SEG_DATA    (CAN_DATA_LEN - 1)
+#define CAN_PRIORITIES  16
+#define CAN_NO_PRIORITY 0xFF
+#define CAN_RX_BUFFER   512   // Rebuilt frames waiting for read()
+
+typedef struct {
+    uint32_t id;
+    uint8_t  len;
+    uint8_t  data[CAN_DATA_LEN];
+} CanFrame;
+
+// Priority of cmd (without CMD_TRACE_FLAG), CAN_NO_PRIORITY if unmapped
+uint8_t can_priority(uint8_t cmd);
+
+static inline uint32_t can_id(uint8_t prio, bool trace, bool seg)
+{
+    return CAN_ID_BASE | (uint32_t)prio << 2 | (trace ? 2 : 0) | (seg ? 1 : 0);
+}
+
+// One single-filter acceptance code/mask (mask bit set = don't care)
+// passing every ID in ids; may pass a few others, never fewer
+void can_acceptance(const uint32_t *ids, size_t count, uint32_t *code, uint32_t *mask);
+
+// ================= CAN BUS =================
+// A controller: TwaiBus on the ESP32, SocketCanBus on Linux
+class CanBus
+{
+public:
+    virtual ~CanBus() {}
+
+    virtual bool send(const CanFrame &f) = 0;   // false: TX queue full
+    virtual bool receive(CanFrame &f) = 0;      // Nonblocking
+    // Frames with other IDs may be dropped in hardware; ids NULL = all
+    virtual void setFilter(const uint32_t *ids, size_t count) = 0;
+};
+
+typedef struct {
+    uint32_t records_tx;   // Records queued on the bus
+    uint32_t frames_tx;    // CAN frames queued
+    uint32_t tx_full;      // Records cut short by a full TX queue
+    uint32_t records_rx;   // Records rebuilt and handed to read()
+    uint32_t frames_rx;    // CAN frames received
+    uint32_t filtered;     // Frames the hardware filter let through
+    uint32_t seg_errors;   // Records dropped for a missing segment
+    uint32_t rx_overflow;  // Records dropped because read() fell behind
+} CanStats;
+
+class CanTransport : public Transport
+{
+public:
+    explicit CanTransport(CanBus &bus);
+
+    // Receive only these commands (all by default)
+    void accept(const uint8_t *cmds, size_t count);
+
+    size_t available() override;
+    size_t read(uint8_t *buf, size_t len) override;
+    size_t write(const uint8_t *data, size_t len) override;
+
+    const CanStats &stats() const { return _stats; }
+
+private:
+    struct Slot {
+        uint8_t next;    // Index of the segment expected next
+        uint8_t count;   // 0: idle
+        uint8_t len;
+        uint8_t data[FRAME_MAX_PAYLOAD];
+    };
+
+    void sendRecord(uint8_t cmd, const uint8_t *payload, uint8_t len);
+    static void onRecord(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx);
+    void pump();
+    void receive(const CanFrame &f);
+    void deliver(uint8_t cmd, const uint8_t *payload, uint8_t len);
+
+    CanBus &_bus;
+    uint16_t _accept;   // Bit per priority
+
+    uint8_t _tx[FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD];   // Partial frame from write()
+    size_t _tx_len;
+
+    Slot _slots[CAN_PRIORITIES];
+    uint8_t _rx[CAN_RX_BUFFER];
+    size_t _rx_len;
+
+    CanStats _stats;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// ================= CLOCK SYNC =================
+// Maps timestamps taken on the sender's millis()/micros() clock onto the
+// receiver's. Every frame carrying a source timestamp gives one sample
+// of (local receive time - source time) = clock offset + transit delay;
+// the smallest recent sample is the one with the least transit delay, so
+// that is the offset kept. Samples older than window are let go so the
+// estimate follows slow drift between the two crystals.
+class ClockSync
+{
+public:
+    explicit ClockSync(uint32_t window) : _window(window) {}
+
+    void sample(uint32_t src, uint32_t local)
+    {
+        int32_t offset = (int32_t)(local - src);
+        if (!_valid || offset < _offset || (uint32_t)(local - _taken) > _window) {
+            _offset = offset;
+            _taken = local;
+            _valid = true;
+        }
+    }
+
+    bool valid() const { return _valid; }
+    uint32_t toLocal(uint32_t src) const { return src + (uint32_t)_offset; }
+    void reset() { _valid = false; }
+
+private:
+    uint32_t _window;
+    int32_t  _offset = 0;
+    uint32_t _taken = 0;
+    bool     _valid = false;
+};
@@ -0,0 +1,95 @@
+#include "command_link.h"
+#include "telemetry_codec.h"
+#include <string.h>
+
+CommandLink::CommandLink(Framing framing, LinkWriter writer, void *ctx,
+                         uint32_t timeout_ms, uint8_t max_tries)
+    : _framing(framing), _addr(ADDR_NONE), _writer(writer), _ctx(ctx),
+      _result(NULL), _result_ctx(NULL),
+      _timeout_ms(timeout_ms), _max_tries(max_tries),
+      _head(0), _count(0), _next_seq(1)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool CommandLink::send(uint8_t op, const uint8_t *args, uint8_t args_len, uint32_t now_ms)
+{
+    if (_count == COMMAND_LINK_QUEUE || args_len > CONTROL_MAX_ARGS) {
+        _stats.queue_full++;
+        return false;
+    }
+
+    Pending &p = _queue[(_head + _count) % COMMAND_LINK_QUEUE];
+    p.seq = _next_seq++;
+    if (_next_seq == 0) _next_seq = 1;   // 0 never appears on the wire
+    p.op = op;
+    p.args_len = args_len;
+    if (args_len) memcpy(p.args, args, args_len);
+    p.tries = 0;
+    p.queued_ms = now_ms;
+    _count++;
+
+    // Nothing ahead of it: go out now rather than on the next poll()
+    if (_count == 1) transmit(p, now_ms);
+    return true;
+}
+
+void CommandLink::transmit(Pending &p, uint32_t now_ms)
+{
+    uint8_t payload[CONTROL_HEADER_LEN + CONTROL_MAX_ARGS];
+    uint8_t wire[FRAME_MAX_WIRE];
+
+    uint8_t len = control_encode(p.seq, p.op, p.args, p.args_len, payload);
+    size_t n = frame_encode_addr(wire, _addr, CMD_CONTROL, payload, len, _framing);
+    _writer(wire, n, _ctx);
+
+    if (p.tries) _stats.retransmits++;
+    p.tries++;
+    p.sent_ms = now_ms;
+}
+
+void CommandLink::pop()
+{
+    _head = (_head + 1) % COMMAND_LINK_QUEUE;
+    _count--;
+}
+
+void CommandLink::poll(uint32_t now_ms)
+{
+    while (_count) {
+        Pending &p = _queue[_head];
+        if (p.tries == 0) {
+            transmit(p, now_ms);
+            return;
+        }
+        if (now_ms - p.sent_ms < _timeout_ms) return;
+        if (p.tries < _max_tries) {
+            transmit(p, now_ms);
+            return;
+        }
+        _stats.failed++;
+        uint8_t op = p.op;
+        pop();
+        if (_result) _result(op, LINK_TIMEOUT, now_ms, _result_ctx);
+    }
+}
+
+bool CommandLink::onAck(const uint8_t *payload, uint8_t len, uint32_t now_ms)
+{
+    uint8_t seq, status;
+    if (!ack_decode(payload, len, &seq, &status)) return false;
+    if (_count == 0 || _queue[_head].seq != seq) return false;   // Late duplicate
+
+    const Pending &p = _queue[_head];
+    uint8_t op = p.op;
+    uint32_t ms = now_ms - p.queued_ms;
+    _stats.last_ms = ms;
+    if (ms > _stats.max_ms) _stats.max_ms = ms;
+    if (status == ACK_OK) _stats.sent++;
+    else                  _stats.rejected++;
+
+    pop();
+    if (_result) _result(op, status, now_ms, _result_ctx);
+    poll(now_ms);   // Next command goes out without waiting a loop pass
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_protocol.h"
+
+// ================= COMMAND LINK =================
+// Sender side of the CMD_CONTROL channel. Commands wait in a small FIFO
+// and go out one at a time (stop-and-wait): the head is retransmitted
+// every timeout until its CMD_ACK arrives or max_tries is used up, then
+// the next one is sent. Call poll() every loop pass and onAck() for each
+// CMD_ACK, both from the same task. An optional result handler hears how
+// each command ended: its ack status, or LINK_TIMEOUT.
+
+#define COMMAND_LINK_QUEUE 8
+
+#define LINK_TIMEOUT 0xFF   // Result status: no ack after max_tries
+
+typedef void (*LinkWriter)(const uint8_t *data, size_t len, void *ctx);
+typedef void (*LinkResultHandler)(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx);
+
+typedef struct {
+    uint32_t sent;           // Commands acked
+    uint32_t retransmits;    // Extra copies sent
+    uint32_t failed;         // Commands dropped after max_tries
+    uint32_t queue_full;     // send() calls rejected
+    uint32_t rejected;       // Acks with a status other than ACK_OK
+    uint32_t last_ms;        // Queued -> acked, newest command
+    uint32_t max_ms;         // Queued -> acked, worst so far
+} CommandLinkStats;
+
+class CommandLink
+{
+public:
+    CommandLink(Framing framing, LinkWriter writer, void *ctx = NULL,
+                uint32_t timeout_ms = 50, uint8_t max_tries = 5);
+
+    // Queues op; false when the queue is full or args too long
+    bool send(uint8_t op, const uint8_t *args, uint8_t args_len, uint32_t now_ms);
+
+    // Transmits or retransmits the head command when due
+    void poll(uint32_t now_ms);
+
+    // CMD_ACK payload received; returns false if it acks nothing pending
+    bool onAck(const uint8_t *payload, uint8_t len, uint32_t now_ms);
+
+    bool idle() const { return _count == 0; }
+    void setFraming(Framing framing) { _framing = framing; }
+    void setAddress(uint8_t addr) { _addr = addr; }   // Our bus node, ADDR_NONE off a bus
+    void setResultHandler(LinkResultHandler handler, void *ctx = NULL)
+    {
+        _result = handler;
+        _result_ctx = ctx;
+    }
+    const CommandLinkStats &stats() const { return _stats; }
+
+private:
+    struct Pending {
+        uint8_t  seq;
+        uint8_t  op;
+        uint8_t  args_len;
+        uint8_t  args[CONTROL_MAX_ARGS];
+        uint8_t  tries;
+        uint32_t queued_ms;
+        uint32_t sent_ms;
+    };
+
+    void transmit(Pending &p, uint32_t now_ms);
+    void pop();
+
+    Framing _framing;
+    uint8_t _addr;
+    LinkWriter _writer;
+    void *_ctx;
+    LinkResultHandler _result;
+    void *_result_ctx;
+    uint32_t _timeout_ms;
+    uint8_t _max_tries;
+
+    Pending _queue[COMMAND_LINK_QUEUE];
+    uint8_t _head;
+    uint8_t _count;
+    uint8_t _next_seq;
+
+    CommandLinkStats _stats;
+};
@@ -0,0 +1,170 @@
+#include "frame_parser.h"
+#include <string.h>
+
+FrameParser::FrameParser(Framing framing, FrameHandler handler, void *ctx)
+    : _framing(framing), _handler(handler), _ctx(ctx), _len(0), _discard(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void FrameParser::reset()
+{
+    _len = 0;
+    _discard = false;
+}
+
+void FrameParser::setFraming(Framing framing)
+{
+    _framing = framing;
+    reset();
+}
+
+// Delivers every complete frame in p[0..n) and returns how many bytes
+// were consumed. Whatever is left starts with SYNC and is an incomplete
+// frame.
+size_t FrameParser::scan(const uint8_t *p, size_t n)
+{
+    size_t pos = 0;
+
+    while (pos < n) {
+        const uint8_t *sync = (const uint8_t *)memchr(p + pos, SYNC_BYTE, n - pos);
+        if (!sync) {
+            _stats.skipped += n - pos;
+            return n;
+        }
+        _stats.skipped += sync - (p + pos);
+        pos = sync - p;
+
+        if (n - pos < FRAME_HEADER_LEN) {
+            return pos;
+        }
+
+        uint8_t cmd = p[pos + 1];
+        uint8_t len = p[pos + 2];
+        if (len > FRAME_MAX_PAYLOAD) {
+            _stats.resyncs++;
+            _stats.skipped++;
+            pos++;               // Rescan from the byte after this SYNC
+            continue;
+        }
+
+        size_t size = frame_size(len, _framing);
+        if (n - pos < size) {
+            return pos;
+        }
+
+        if (_framing == FRAMING_CRC) {
+            uint16_t rx_crc = (p[pos + size - 2] << 8) | p[pos + size - 1];
+            if (crc16(&p[pos + 1], 2 + len) != rx_crc) {
+                _stats.crc_errors++;
+                _stats.resyncs++;
+                _stats.skipped++;
+                pos++;           // Rescan from the byte after this SYNC
+                continue;
+            }
+        }
+
+        _stats.frames++;
+        _handler(cmd, &p[pos + FRAME_HEADER_LEN], len, _ctx);
+        pos += size;
+    }
+    return pos;
+}
+
+void FrameParser::feed(uint8_t *p, size_t n)
+{
+    if (_framing == FRAMING_COBS) {
+        feedCobs(p, n);
+        return;
+    }
+
+    while (n > 0) {
+        if (_len == 0) {
+            // Zero-copy path: decode straight out of the caller's span
+            size_t used = scan(p, n);
+            p += used;
+            n -= used;
+            memcpy(_window, p, n);     // Partial frame, always fits
+            _len = n;
+            return;
+        }
+
+        // Top the window up to exactly one frame, then rescan it
+        size_t need;
+        if (_len < FRAME_HEADER_LEN) {
+            need = FRAME_HEADER_LEN - _len;
+        } else {
+            need = frame_size(_window[2], _framing) - _len;
+        }
+        if (need > n) need = n;
+
+        memcpy(&_window[_len], p, need);
+        _len += need;
+        p += need;
+        n -= need;
+
+        size_t used = scan(_window, _len);
+        _len -= used;
+        memmove(_window, &_window[used], _len);
+    }
+}
+
+// Decodes one delimited COBS body in place, checks it and delivers it
+void FrameParser::deliverCobs(uint8_t *body, size_t n)
+{
+    if (n == 0) {
+        return;                  // Back-to-back delimiters
+    }
+
+    size_t len = cobs_decode_in_place(body, n);
+    if (len < 1 + FRAME_CRC_LEN || len > 1 + FRAME_MAX_PAYLOAD + FRAME_CRC_LEN) {
+        _stats.bad_frames++;
+        _stats.skipped += n;
+        return;
+    }
+
+    uint16_t rx_crc = (body[len - 2] << 8) | body[len - 1];
+    if (crc16(body, len - FRAME_CRC_LEN) != rx_crc) {
+        _stats.crc_errors++;
+        _stats.skipped += n;
+        return;
+    }
+
+    _stats.frames++;
+    _handler(body[0], &body[1], len - 1 - FRAME_CRC_LEN, _ctx);
+}
+
+void FrameParser::feedCobs(uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        uint8_t *delim = (uint8_t *)memchr(p, COBS_DELIM, n);
+        size_t seg = delim ? (size_t)(delim - p) : n;
+
+        if (_discard) {
+            _stats.skipped += seg;
+        } else if (_len + seg > sizeof(_window)) {
+            // Longer than any valid frame: garbage or a lost delimiter.
+            // Checked first so it counts the same however the span is cut
+            _stats.resyncs++;
+            _stats.skipped += _len + seg;
+            _len = 0;
+            _discard = true;
+        } else if (_len == 0 && delim) {
+            deliverCobs(p, seg);             // Zero-copy: whole frame in span
+        } else {
+            memcpy(&_window[_len], p, seg);
+            _len += seg;
+            if (delim) {
+                deliverCobs(_window, _len);
+            }
+        }
+
+        if (!delim) {
+            return;
+        }
+        _len = 0;
+        _discard = false;
+        p += seg + 1;
+        n -= seg + 1;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "telemetry_protocol.h"
+
+// ================= FRAME PARSER =================
+// Resynchronising scanner for the SYNC framed stream. Feed it whatever
+// spans the transport hands over; complete frames are delivered through
+// the callback, straight out of the caller's span when a frame is fully
+// inside it, otherwise out of a window holding one partial frame.
+//
+// On a bad length or CRC the scanner restarts at the byte after the
+// rejected SYNC, so a corrupted header never swallows the good frames
+// behind it.
+//
+// In COBS mode frames end at the 0x00 delimiter and are decoded in place,
+// which is why feed() takes a writable span: COBS frames fully inside it
+// are decoded without any copy, and it is clobbered in the process.
+
+typedef struct {
+    uint32_t frames;       // Frames delivered
+    uint32_t crc_errors;   // Frames rejected by CRC
+    uint32_t resyncs;      // Times the scanner restarted after a bad SYNC
+    uint32_t skipped;      // Bytes discarded while hunting for SYNC
+    uint32_t bad_frames;   // COBS frames that failed to decode
+} FrameParserStats;
+
+class FrameParser
+{
+public:
+    FrameParser(Framing framing, FrameHandler handler, void *ctx = NULL);
+
+    void feed(uint8_t *p, size_t n);
+    void reset();
+
+    void setFraming(Framing framing);
+    const FrameParserStats &stats() const { return _stats; }
+
+private:
+    size_t scan(const uint8_t *p, size_t n);
+    void feedCobs(uint8_t *p, size_t n);
+    void deliverCobs(uint8_t *body, size_t n);
+
+    Framing _framing;
+    FrameHandler _handler;
+    void *_ctx;
+
+    uint8_t _window[FRAME_MAX_SIZE];
+    size_t _len;
+    bool _discard;         // COBS: window overflowed, drop until delimiter
+
+    FrameParserStats _stats;
+};
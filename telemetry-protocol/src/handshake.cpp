@@ -0,0 +1,146 @@
+#include "handshake.h"
+#include <string.h>
+
+Handshake::Handshake(CommandLink &link, const Caps &ours, Apply apply, void *ctx)
+    : _link(link), _ours(ours), _apply(apply), _ctx(ctx),
+      _state(HS_IDLE), _since_ms(0), _have_caps(false), _have_cached(false)
+{
+    memset(&_peer, 0, sizeof(_peer));
+    memset(&_cached, 0, sizeof(_cached));
+    memset(&_config, 0, sizeof(_config));
+}
+
+LinkConfig Handshake::choose(const Caps &ours, const Caps &theirs)
+{
+    uint16_t common = ours.features & theirs.features;
+    LinkConfig cfg;
+    cfg.caps_id = caps_id(&theirs);
+
+    // COBS: no LEN byte and resync at every delimiter; CRC next best
+    if (common & FEAT_COBS)     cfg.framing = FRAMING_COBS;
+    else if (common & FEAT_CRC) cfg.framing = FRAMING_CRC;
+    else                        cfg.framing = FRAMING_PLAIN;
+
+    cfg.features = common & ~FEAT_FRAMING;
+    cfg.max_baud = ours.max_baud < theirs.max_baud ? ours.max_baud : theirs.max_baud;
+    return cfg;
+}
+
+uint16_t Handshake::minPeriod(uint8_t cmd) const
+{
+    for (uint8_t i = 0; i < _peer.limit_count; i++) {
+        if (_peer.limits[i].cmd == cmd) return _peer.limits[i].min_period_ms;
+    }
+    return 0;
+}
+
+void Handshake::start(uint32_t now_ms, const LinkConfig *cached)
+{
+    _have_caps = false;
+    _have_cached = cached != NULL;
+    if (cached) {
+        _cached = *cached;
+        _config = *cached;
+        configure(now_ms, HS_RESUME);
+    } else {
+        hello(now_ms);
+    }
+}
+
+void Handshake::hello(uint32_t now_ms)
+{
+    uint8_t version = PROTOCOL_VERSION;
+    _state = HS_HELLO;
+    _since_ms = now_ms;
+    if (!_link.send(CTRL_HELLO, &version, 1, now_ms)) {
+        _state = HS_RETRY;
+    }
+}
+
+void Handshake::configure(uint32_t now_ms, State next)
+{
+    uint8_t args[CONFIGURE_ARGS_LEN];
+    link_config_encode(&_config, args);
+    _state = next;
+    _since_ms = now_ms;
+    if (!_link.send(CTRL_CONFIGURE, args, CONFIGURE_ARGS_LEN, now_ms)) {
+        _state = HS_RETRY;
+    }
+}
+
+void Handshake::fallback(uint32_t now_ms)
+{
+    _state = HS_FALLBACK;
+    _since_ms = now_ms;
+}
+
+void Handshake::onCaps(const uint8_t *payload, uint8_t len)
+{
+    if (_state != HS_HELLO || len < 1) return;
+    // VERSION leads CMD_CAPS in every version; the rest is ours to read
+    // only if it is our version
+    if (payload[0] != PROTOCOL_VERSION) {
+        memset(&_peer, 0, sizeof(_peer));
+        _peer.version = payload[0];
+        return;
+    }
+    if (caps_decode(payload, len, &_peer)) _have_caps = true;
+}
+
+void Handshake::onResult(uint8_t op, uint8_t status, uint32_t now_ms)
+{
+    // Other users share the CommandLink; their timeouts are not ours
+    if (op != CTRL_HELLO && op != CTRL_CONFIGURE) return;
+
+    if (status == LINK_TIMEOUT &&
+        (_state == HS_RESUME || _state == HS_HELLO || _state == HS_CONFIGURE)) {
+        _state = HS_RETRY;
+        _since_ms = now_ms;
+        return;
+    }
+
+    switch (_state) {
+        case HS_RESUME:
+            if (op != CTRL_CONFIGURE) return;
+            if (status == ACK_OK) {
+                _state = HS_DONE;
+                _apply(_config, _ctx);
+            } else {
+                _have_cached = false;   // Sim changed: full exchange
+                hello(now_ms);
+            }
+            break;
+
+        case HS_HELLO:
+            if (op != CTRL_HELLO) return;
+            if (status != ACK_OK || !_have_caps) {
+                fallback(now_ms);
+                return;
+            }
+            _config = choose(_ours, _peer);
+            configure(now_ms, HS_CONFIGURE);
+            break;
+
+        case HS_CONFIGURE:
+            if (op != CTRL_CONFIGURE) return;
+            if (status == ACK_OK) {
+                _state = HS_DONE;
+                _apply(_config, _ctx);
+            } else {
+                fallback(now_ms);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Handshake::poll(uint32_t now_ms)
+{
+    if (_state == HS_RETRY && now_ms - _since_ms >= HANDSHAKE_RETRY_MS) {
+        start(now_ms, _have_cached ? &_cached : NULL);
+    } else if (_state == HS_FALLBACK && now_ms - _since_ms >= HANDSHAKE_FALLBACK_RETRY_MS) {
+        start(now_ms, NULL);   // The sim may have been updated since
+    }
+}
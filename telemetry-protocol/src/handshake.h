@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include "command_link.h"
+#include "telemetry_codec.h"
+
+// ================= HANDSHAKE =================
+// Display side of the HELLO / CAPS / CONFIGURE exchange described in
+// telemetry_protocol.h. Pure state machine on top of a CommandLink:
+//
+//   start(cached) --CONFIGURE(cached) acked-------------------> DONE
+//        |              | rejected (sim changed)
+//        v              v
+//      HELLO --CAPS + ack--> CONFIGURE(chosen) --acked-------> DONE
+//        | rejected, or CAPS of another version    | rejected
+//        v                                      v
+//      FALLBACK (stay on the boot configuration)
+//
+// The sim answers a HELLO for another PROTOCOL_VERSION with its CAPS and
+// ACK_BAD_VERSION. Only VERSION is read from CAPS of another version, so
+// peer().version tells which one the sim speaks. FALLBACK asks again
+// after HANDSHAKE_FALLBACK_RETRY_MS, in case the sim was updated.
+//
+// A HELLO or CONFIGURE that times out (the sim is rebooting, or still on
+// another configuration until its link timeout) waits HANDSHAKE_RETRY_MS
+// and starts over; timeouts of other commands on the same CommandLink are
+// ignored. The apply callback fires on DONE with the configuration to
+// switch to, which the caller should also keep for next time.
+
+#define HANDSHAKE_RETRY_MS          (LINK_TIMEOUT_MS + 250)
+#define HANDSHAKE_FALLBACK_RETRY_MS 60000
+
+class Handshake
+{
+public:
+    enum State { HS_IDLE, HS_RESUME, HS_HELLO, HS_CONFIGURE, HS_DONE,
+                 HS_FALLBACK, HS_RETRY };
+
+    typedef void (*Apply)(const LinkConfig &cfg, void *ctx);
+
+    Handshake(CommandLink &link, const Caps &ours, Apply apply, void *ctx = NULL);
+
+    // cached: configuration agreed last time, NULL for a full exchange
+    void start(uint32_t now_ms, const LinkConfig *cached);
+    void stop() { _state = HS_IDLE; }
+
+    void poll(uint32_t now_ms);
+    void onResult(uint8_t op, uint8_t status, uint32_t now_ms);
+    void onCaps(const uint8_t *payload, uint8_t len);
+
+    State state() const { return _state; }
+    bool done() const { return _state == HS_DONE; }
+    const LinkConfig &config() const { return _config; }
+    const Caps &peer() const { return _peer; }
+    bool versionMismatch() const { return _peer.version && _peer.version != PROTOCOL_VERSION; }
+
+    // Sim's lowest accepted period for cmd, 0 if it set no limit
+    uint16_t minPeriod(uint8_t cmd) const;
+
+    // Most efficient configuration both caps allow
+    static LinkConfig choose(const Caps &ours, const Caps &theirs);
+
+private:
+    void hello(uint32_t now_ms);
+    void configure(uint32_t now_ms, State next);
+    void fallback(uint32_t now_ms);
+
+    CommandLink &_link;
+    Caps _ours;
+    Apply _apply;
+    void *_ctx;
+
+    State _state;
+    uint32_t _since_ms;
+    bool _have_caps;
+    bool _have_cached;
+    Caps _peer;
+    LinkConfig _cached;
+    LinkConfig _config;
+};
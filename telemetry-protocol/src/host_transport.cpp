@@ -0,0 +1,183 @@
+#include "host_transport.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// ================= FD =================
+bool FdTransport::adopt(int fd)
+{
+    close();
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ::close(fd);
+        return false;
+    }
+    _fd = fd;
+    return true;
+}
+
+void FdTransport::close()
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+size_t FdTransport::available()
+{
+    int n = 0;
+    if (_fd < 0 || ioctl(_fd, FIONREAD, &n) < 0 || n < 0) return 0;
+    return n;
+}
+
+size_t FdTransport::read(uint8_t *buf, size_t len)
+{
+    if (_fd < 0) return 0;
+    ssize_t n;
+    do {
+        n = ::read(_fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0 && len && _socket) close();   // Peer closed the connection
+    return n > 0 ? n : 0;   // EAGAIN, EOF and a hung up peer all read as idle
+}
+
+size_t FdTransport::write(const uint8_t *data, size_t len)
+{
+    size_t done = 0;
+    while (_fd >= 0 && done < len) {
+        ssize_t n = _socket ? ::send(_fd, data + done, len - done, MSG_NOSIGNAL)
+                            : ::write(_fd, data + done, len - done);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            struct pollfd p = { _fd, POLLOUT, 0 };
+            poll(&p, 1, 100);
+        } else {
+            break;   // Peer gone
+        }
+    }
+    return done;
+}
+
+// ================= PTY =================
+bool PtyTransport::makeRaw(int fd)
+{
+    struct termios t;
+    if (tcgetattr(fd, &t) < 0) return false;
+    cfmakeraw(&t);
+    return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+bool PtyTransport::create()
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0) return false;
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+        ptsname_r(fd, _slave, sizeof(_slave)) != 0 || !makeRaw(fd)) {
+        ::close(fd);
+        _slave[0] = '\0';
+        return false;
+    }
+    return adopt(fd);
+}
+
+bool PtyTransport::open(const char *path)
+{
+    int fd = ::open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return false;
+    if (!makeRaw(fd)) {
+        ::close(fd);
+        return false;
+    }
+    snprintf(_slave, sizeof(_slave), "%s", path);
+    return adopt(fd);
+}
+
+void PtyTransport::flush()
+{
+    if (_fd >= 0) tcdrain(_fd);
+}
+
+// Real adapters take standard rates only; a pty ignores the rate anyway
+void PtyTransport::setBaud(uint32_t baud)
+{
+    static const struct { uint32_t baud; speed_t speed; } rates[] = {
+        { 115200, B115200 }, { 921600, B921600 }, { 2000000, B2000000 },
+        { 3000000, B3000000 },
+    };
+    struct termios t;
+    if (_fd < 0 || tcgetattr(_fd, &t) < 0) return;
+    tcdrain(_fd);
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        if (rates[i].baud == baud) {
+            cfsetspeed(&t, rates[i].speed);
+            tcsetattr(_fd, TCSANOW, &t);
+            break;
+        }
+    }
+    tcflush(_fd, TCIFLUSH);   // Received at the old rate
+}
+
+// ================= TCP =================
+bool TcpTransport::setup(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (!adopt(fd)) return false;
+    _socket = true;
+    return true;
+}
+
+bool TcpTransport::listen(uint16_t port)
+{
+    int srv = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv < 0) return false;
+
+    int one = 1;
+    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = -1;
+    if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        ::listen(srv, 1) == 0) {
+        fd = accept(srv, NULL, NULL);
+    }
+    ::close(srv);
+    return fd >= 0 && setup(fd);
+}
+
+bool TcpTransport::connect(const char *host, uint16_t port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return false;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return false;
+    }
+    return setup(fd);
+}
+#endif
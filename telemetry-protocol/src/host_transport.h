@@ -0,0 +1,71 @@
+#pragma once
+
+#if defined(__linux__)
+#include "transport.h"
+
+// ================= HOST TRANSPORTS =================
+// Linux stand-ins for the UART, for running either firmware's protocol
+// code on a PC at full speed. All are nonblocking file descriptors;
+// write() polls for room instead of failing, so a frame is never cut.
+//
+//   PtyTransport  openpty(): the peer opens slaveName(), e.g. another
+//                 process, socat or a terminal. open(path) instead takes
+//                 an existing tty such as a USB serial adapter.
+//   TcpTransport  one loopback connection: listen() waits for the peer,
+//                 connect() dials it. TCP_NODELAY, so frames are not
+//                 held back to fill segments. Once the peer has closed,
+//                 read() finds the end of the stream and closes our side:
+//                 isOpen() turns false and writes return 0.
+
+class FdTransport : public Transport
+{
+public:
+    FdTransport() : _fd(-1), _socket(false) {}
+    ~FdTransport() override { close(); }
+
+    size_t available() override;
+    size_t read(uint8_t *buf, size_t len) override;
+    size_t write(const uint8_t *data, size_t len) override;
+
+    void close();
+    bool isOpen() const { return _fd >= 0; }
+    int fd() const { return _fd; }   // For poll() by the caller
+
+    FdTransport(const FdTransport &) = delete;
+    FdTransport &operator=(const FdTransport &) = delete;
+
+protected:
+    bool adopt(int fd);   // Makes fd nonblocking and takes ownership
+
+    int _fd;
+    bool _socket;   // send() without SIGPIPE, and EOF means the peer left
+};
+
+class PtyTransport : public FdTransport
+{
+public:
+    PtyTransport() { _slave[0] = '\0'; }
+
+    bool create();                    // New pty, we hold the master side
+    bool open(const char *path);      // Existing tty, raw mode
+    const char *slaveName() const { return _slave; }
+
+    void flush() override;
+    void setBaud(uint32_t baud) override;
+
+private:
+    bool makeRaw(int fd);
+
+    char _slave[64];
+};
+
+class TcpTransport : public FdTransport
+{
+public:
+    bool listen(uint16_t port);                   // Blocks until a peer connects
+    bool connect(const char *host, uint16_t port);
+
+private:
+    bool setup(int fd);
+};
+#endif
@@ -0,0 +1,113 @@
+#include "latency_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_CLOCK_WINDOW_US 10000000   // Re-anchor clock offset every 10 s
+
+// Log-linear buckets: values 0-3 get their own, above that each octave
+// is split in 4
+static unsigned bucket_of(uint32_t us)
+{
+    if (us < 4) return us;
+    unsigned msb = 31 - __builtin_clz(us);
+    unsigned b = (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+    return b < TRACE_BUCKETS ? b : TRACE_BUCKETS - 1;
+}
+
+static uint32_t bucket_upper(unsigned b)
+{
+    if (b < 4) return b;
+    unsigned msb = b / 4 + 1;
+    return ((4u + b % 4 + 1) << (msb - 2)) - 1;
+}
+
+LatencyTrace::LatencyTrace() : _clock(TRACE_CLOCK_WINDOW_US)
+{
+    memset(_cmd, 0, sizeof(_cmd));
+    for (unsigned i = 0; i < TRACE_MAX_CMD; i++) {
+        _last_tx[i] = 0;
+    }
+}
+
+void LatencyTrace::record(CmdTrace &t, Stage stage, int32_t us)
+{
+    uint16_t &n = t.hist[stage][bucket_of(us < 0 ? 0 : (uint32_t)us)];
+    if (n != UINT16_MAX) n++;
+}
+
+void LatencyTrace::frame(uint8_t cmd, uint16_t seq, uint32_t tx_us,
+                         uint32_t rx_us, uint32_t decoded_us)
+{
+    if (cmd >= TRACE_MAX_CMD) return;
+    CmdTrace &t = _cmd[cmd];
+
+    // Sequence gaps are losses; a jump backwards means the sender restarted
+    if (t.seen) {
+        uint16_t gap = seq - t.next_seq;
+        if (gap < 0x8000) t.lost += gap;
+    }
+    t.seen = true;
+    t.next_seq = seq + 1;
+    t.received++;
+
+    _clock.sample(tx_us, rx_us);
+    uint32_t tx_local = _clock.toLocal(tx_us);
+    _last_tx[cmd] = tx_local ? tx_local : 1;
+
+    record(t, STAGE_TRANSIT, (int32_t)(rx_us - tx_local));
+    record(t, STAGE_DECODE,  (int32_t)(decoded_us - tx_local));
+}
+
+uint32_t LatencyTrace::lastTx(uint8_t cmd) const
+{
+    return cmd < TRACE_MAX_CMD ? _last_tx[cmd] : 0;
+}
+
+void LatencyTrace::displayed(uint8_t cmd, uint32_t tx_us, uint32_t flushed_us)
+{
+    if (cmd >= TRACE_MAX_CMD) return;
+    record(_cmd[cmd], STAGE_DISPLAY, (int32_t)(flushed_us - tx_us));
+}
+
+uint32_t LatencyTrace::total(const uint16_t *hist)
+{
+    uint32_t n = 0;
+    for (unsigned b = 0; b < TRACE_BUCKETS; b++) n += hist[b];
+    return n;
+}
+
+uint32_t LatencyTrace::percentile(const uint16_t *hist, uint32_t permille)
+{
+    uint32_t target = (total(hist) * permille + 999) / 1000;
+    uint32_t sum = 0;
+    for (unsigned b = 0; b < TRACE_BUCKETS; b++) {
+        sum += hist[b];
+        if (sum >= target) return bucket_upper(b);
+    }
+    return bucket_upper(TRACE_BUCKETS - 1);
+}
+
+void LatencyTrace::report(void (*emit)(const char *line)) const
+{
+    static const char *names[STAGE_COUNT] = { "transit", "decode", "display" };
+    char line[160];
+
+    for (unsigned c = 0; c < TRACE_MAX_CMD; c++) {
+        const CmdTrace &t = _cmd[c];
+        if (!t.received) continue;
+
+        int n = snprintf(line, sizeof(line), "cmd 0x%02X rx %lu lost %lu",
+                         c, (unsigned long)t.received, (unsigned long)t.lost);
+        for (unsigned s = 0; s < STAGE_COUNT && n < (int)sizeof(line); s++) {
+            if (!total(t.hist[s])) {
+                n += snprintf(line + n, sizeof(line) - n, " | %s -", names[s]);
+                continue;
+            }
+            n += snprintf(line + n, sizeof(line) - n, " | %s p50 %lu p99 %lu us",
+                          names[s],
+                          (unsigned long)percentile(t.hist[s], 500),
+                          (unsigned long)percentile(t.hist[s], 990));
+        }
+        emit(line);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include "clock_sync.h"
+
+// ================= LATENCY TRACE =================
+// Per-command end-to-end latency for frames sent with CMD_TRACE_FLAG.
+// Three stages are measured from the sender's TX timestamp:
+//   transit - frame handed to the parser (UART + driver + RX polling)
+//   decode  - frame decoded into the telemetry state
+//   display - first LVGL refresh flushed after the UI picked the value up
+// plus received/lost counts from the per-command sequence numbers.
+//
+// Sender timestamps are mapped to our clock with a ClockSync, whose
+// offset absorbs the lowest transit delay seen. Figures are therefore
+// latency above that floor, which is roughly one frame's wire time.
+//
+// frame() and lastTx() belong to the RX side, displayed() to the UI side;
+// each only writes its own counters.
+
+#define TRACE_MAX_CMD   16       // Commands 0..15 are traced
+#define TRACE_BUCKETS   80       // 4 per octave, 1 us to ~2 s
+
+class LatencyTrace
+{
+public:
+    enum Stage { STAGE_TRANSIT, STAGE_DECODE, STAGE_DISPLAY, STAGE_COUNT };
+
+    LatencyTrace();
+
+    // RX side: one traced frame, rx_us/decoded_us on our micros() clock
+    void frame(uint8_t cmd, uint16_t seq, uint32_t tx_us,
+               uint32_t rx_us, uint32_t decoded_us);
+
+    // TX time (our clock) of the newest traced frame of cmd, 0 if none
+    uint32_t lastTx(uint8_t cmd) const;
+
+    // UI side: a value sent at tx_us (our clock) reached the screen
+    void displayed(uint8_t cmd, uint32_t tx_us, uint32_t flushed_us);
+
+    // One line per traced command; emit is called once per line
+    void report(void (*emit)(const char *line)) const;
+
+private:
+    struct CmdTrace {
+        uint32_t received;
+        uint32_t lost;
+        uint16_t next_seq;
+        bool     seen;
+        uint16_t hist[STAGE_COUNT][TRACE_BUCKETS];
+    };
+
+    void record(CmdTrace &t, Stage stage, int32_t us);
+    static uint32_t total(const uint16_t *hist);
+    static uint32_t percentile(const uint16_t *hist, uint32_t permille);
+
+    CmdTrace _cmd[TRACE_MAX_CMD];
+    volatile uint32_t _last_tx[TRACE_MAX_CMD];
+    ClockSync _clock;
+};
@@ -0,0 +1,166 @@
+#include "message_board.h"
+#include <string.h>
+
+static_assert(MSG_MAX_FRAGS <= 8, "Slot::have is one byte");
+
+MessageBoard::MessageBoard(uint32_t min_dwell_ms)
+    : _min_dwell_ms(min_dwell_ms)
+{
+    clear();
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void MessageBoard::clear()
+{
+    memset(_slots, 0, sizeof(_slots));
+    memset(_recent, 0, sizeof(_recent));
+    memset(_recent_ms, 0, sizeof(_recent_ms));
+    _showing = -1;
+    _next_order = 0;
+    _recent_next = 0;
+    _recent_count = 0;
+}
+
+// The sender's repeats follow within a few FAST periods. An ID quiet for
+// longer is a new message: a rebooted sim numbers from 0 again.
+bool MessageBoard::seen(uint8_t id, uint32_t now_ms)
+{
+    for (uint8_t i = 0; i < _recent_count; i++) {
+        if (_recent[i] != id || now_ms - _recent_ms[i] > MSG_REASSEMBLY_MS) continue;
+        _recent_ms[i] = now_ms;
+        return true;
+    }
+    return false;
+}
+
+MessageBoard::Slot *MessageBoard::allocate(uint8_t priority)
+{
+    Slot *victim = NULL;
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        Slot &s = _slots[i];
+        if (s.state == FREE) return &s;
+        if (s.state != QUEUED || s.priority > priority) continue;
+        if (!victim || s.priority < victim->priority ||
+            (s.priority == victim->priority && s.order < victim->order)) {
+            victim = &s;
+        }
+    }
+    if (victim) _stats.evicted++;
+    else        _stats.dropped++;
+    return victim;
+}
+
+void MessageBoard::finish(Slot &s)
+{
+    s.text[s.len] = '\0';
+    s.state = QUEUED;
+    s.order = _next_order++;
+    _stats.completed++;
+}
+
+void MessageBoard::onFragment(const MessageFragment &f, uint32_t now_ms)
+{
+    if (seen(f.id, now_ms)) {
+        _stats.duplicates++;
+        return;
+    }
+
+    Slot *s = NULL;
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        if (_slots[i].state == ASSEMBLING && _slots[i].id == f.id) s = &_slots[i];
+    }
+    if (s && s->count != f.count) {   // Same ID reused for another message
+        s->state = FREE;
+        s = NULL;
+    }
+    if (!s) {
+        s = allocate(f.priority);
+        if (!s) return;
+        s->state = ASSEMBLING;
+        s->id = f.id;
+        s->priority = f.priority;
+        s->count = f.count;
+        s->have = 0;
+        s->len = 0;
+    }
+
+    memcpy(&s->text[f.index * MSG_FRAG_TEXT], f.text, f.len);
+    s->have |= 1u << f.index;
+    s->ms = now_ms;
+    if (f.index == f.count - 1) s->len = f.index * MSG_FRAG_TEXT + f.len;
+
+    if (s->have == (1u << f.count) - 1) {
+        _recent[_recent_next] = f.id;
+        _recent_ms[_recent_next] = now_ms;
+        _recent_next = (_recent_next + 1) % MSG_RECENT_IDS;
+        if (_recent_count < MSG_RECENT_IDS) _recent_count++;
+        finish(*s);
+    }
+}
+
+void MessageBoard::post(const char *text, uint8_t len, uint8_t priority, uint32_t now_ms)
+{
+    Slot *s = allocate(priority);
+    if (!s) return;
+    if (len > MAX_LONG_MSG_LEN) len = MAX_LONG_MSG_LEN;
+    memcpy(s->text, text, len);
+    s->len = len;
+    s->id = 0;
+    s->priority = priority;
+    s->ms = now_ms;
+    finish(*s);
+}
+
+bool MessageBoard::update(uint32_t now_ms)
+{
+    int best = -1;
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        Slot &s = _slots[i];
+        if (s.state == ASSEMBLING && now_ms - s.ms > MSG_REASSEMBLY_MS) {
+            s.state = FREE;
+            _stats.expired++;
+        }
+        if (s.state != QUEUED) continue;
+        if (best < 0 || s.priority > _slots[best].priority ||
+            (s.priority == _slots[best].priority && s.order < _slots[best].order)) {
+            best = i;
+        }
+    }
+    if (best < 0) return false;
+
+    if (_showing >= 0) {
+        Slot &cur = _slots[_showing];
+        if (_slots[best].priority > cur.priority) {
+            cur.state = QUEUED;   // Keeps its order: first of its priority again
+            _stats.preempted++;
+        } else if (now_ms - cur.ms >= _min_dwell_ms) {
+            cur.state = FREE;
+        } else {
+            return false;
+        }
+    }
+
+    _showing = best;
+    _slots[best].state = SHOWING;
+    _slots[best].ms = now_ms;
+    return true;
+}
+
+const char *MessageBoard::current() const
+{
+    return _showing >= 0 ? _slots[_showing].text : NULL;
+}
+
+uint8_t MessageBoard::currentPriority() const
+{
+    return _showing >= 0 ? _slots[_showing].priority : 0;
+}
+
+uint8_t MessageBoard::queued() const
+{
+    uint8_t n = 0;
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        if (_slots[i].state == QUEUED) n++;
+    }
+    return n;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_codec.h"
+
+// ================= MESSAGE BOARD =================
+// Receiver side of custom messages: reassembles CMD_MESSAGE_FRAG
+// fragments and queues finished messages for the screen, all in a fixed
+// pool of MSG_POOL_SLOTS slots (no heap). A slot is free, assembling,
+// queued or showing.
+//
+// update() picks what is on screen: the highest priority queued message,
+// oldest first within a priority. The one showing stays for at least
+// min_dwell_ms, unless a higher priority message arrives: that one takes
+// over at once and the preempted message goes back in the queue to be
+// shown again in full later. When the pool is full a new message evicts
+// the oldest queued one of no higher priority, or is dropped.
+
+#define MSG_POOL_SLOTS    6
+#define MSG_REASSEMBLY_MS 1000   // Partial message dropped after this long quiet
+#define MSG_MIN_DWELL_MS  3000
+#define MSG_RECENT_IDS    8      // Finished MSG_IDs remembered to drop repeats,
+                                 // each until MSG_REASSEMBLY_MS without one
+
+typedef struct {
+    uint32_t completed;   // Messages queued (reassembled or whole)
+    uint32_t duplicates;  // Fragments of a message already complete
+    uint32_t expired;     // Partial messages that never completed
+    uint32_t evicted;     // Queued messages pushed out of a full pool
+    uint32_t dropped;     // Messages refused, pool full of higher priority
+    uint32_t preempted;   // Messages taken off screen by a higher priority
+} MessageStats;
+
+class MessageBoard
+{
+public:
+    explicit MessageBoard(uint32_t min_dwell_ms = MSG_MIN_DWELL_MS);
+
+    void onFragment(const MessageFragment &f, uint32_t now_ms);
+    // A whole message, e.g. a CMD_MESSAGE
+    void post(const char *text, uint8_t len, uint8_t priority, uint32_t now_ms);
+
+    // Returns true when current() changed
+    bool update(uint32_t now_ms);
+
+    const char *current() const;   // NULL before the first message
+    uint8_t currentPriority() const;
+    uint8_t queued() const;
+    void clear();
+
+    const MessageStats &stats() const { return _stats; }
+
+private:
+    enum { FREE, ASSEMBLING, QUEUED, SHOWING };
+
+    struct Slot {
+        uint8_t  state;
+        uint8_t  id;
+        uint8_t  priority;
+        uint8_t  count;       // Fragments expected
+        uint8_t  have;        // Bit per fragment received
+        uint8_t  len;
+        uint32_t order;       // Arrival order among queued messages
+        uint32_t ms;          // Last fragment, or when shown
+        char     text[MAX_LONG_MSG_LEN + 1];
+    };
+
+    Slot *allocate(uint8_t priority);
+    void finish(Slot &s);
+    bool seen(uint8_t id, uint32_t now_ms);
+
+    Slot _slots[MSG_POOL_SLOTS];
+    int _showing;          // Slot index, -1 none
+    uint32_t _min_dwell_ms;
+    uint32_t _next_order;
+    uint8_t _recent[MSG_RECENT_IDS];
+    uint32_t _recent_ms[MSG_RECENT_IDS];   // Last copy of each
+    uint8_t _recent_next;
+    uint8_t _recent_count;
+    MessageStats _stats;
+};
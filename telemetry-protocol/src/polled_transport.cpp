@@ -0,0 +1,46 @@
+#include "polled_transport.h"
+#include "telemetry_protocol.h"
+#include <string.h>
+
+PolledTransport::PolledTransport(Transport &link, size_t slot_bytes)
+    : _link(link), _slot_bytes(slot_bytes), _next_len(-1)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+size_t PolledTransport::write(const uint8_t *data, size_t len)
+{
+    uint8_t entry[1 + FRAME_MAX_WIRE];
+    if (len > FRAME_MAX_WIRE || ByteRing::capacity() - _queue.size() < 1 + len) {
+        _stats.dropped++;
+        return 0;
+    }
+    entry[0] = len;
+    memcpy(&entry[1], data, len);
+    _queue.push(entry, 1 + len);   // One push, so grant() never sees half
+    return len;
+}
+
+void PolledTransport::grant()
+{
+    uint8_t frame[FRAME_MAX_WIRE];
+    size_t sent = 0;
+    _stats.grants++;
+
+    for (;;) {
+        if (_next_len < 0) {
+            uint8_t len;
+            if (!_queue.pop(&len, 1)) return;
+            _next_len = len;
+        }
+        if (sent + _next_len > _slot_bytes && sent > 0) {
+            _stats.deferred++;   // Rest goes out on the next poll
+            return;
+        }
+        _queue.pop(frame, _next_len);
+        _link.write(frame, _next_len);
+        sent += _next_len;
+        _next_len = -1;
+        _stats.frames++;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "transport.h"
+#include "ring_transport.h"
+
+// ================= POLLED TRANSPORT =================
+// A display's end of a shared bus (see BUS ADDRESSING): reads go straight
+// through, writes wait in a queue until grant(), i.e. until the sim's
+// CMD_POLL for this node arrives. grant() sends whole frames only, as
+// many as fit in slot_bytes, so a node never talks past its slot.
+//
+// write() must be called with one complete frame at a time (as
+// CommandLink and frame_encode() users do) and from one thread; grant()
+// from another, typically the one running the parser that saw the poll.
+
+typedef struct {
+    uint32_t frames;     // Frames sent
+    uint32_t grants;     // Polls answered
+    uint32_t deferred;   // Grants that left frames for the next poll
+    uint32_t dropped;    // Frames refused because the queue was full
+} PolledStats;
+
+class PolledTransport : public Transport
+{
+public:
+    PolledTransport(Transport &link, size_t slot_bytes);
+
+    size_t available() override { return _link.available(); }
+    size_t read(uint8_t *buf, size_t len) override { return _link.read(buf, len); }
+    size_t write(const uint8_t *data, size_t len) override;
+    void flush() override { _link.flush(); }
+    void setBaud(uint32_t baud) override { _link.setBaud(baud); }
+
+    void grant();
+
+    const PolledStats &stats() const { return _stats; }
+
+private:
+    Transport &_link;
+    size_t _slot_bytes;
+    ByteRing _queue;        // LEN (u8) | frame, per frame
+    int _next_len;          // Length of the frame at the head, -1 unknown
+    PolledStats _stats;
+};
@@ -0,0 +1,46 @@
+#include "rate_controller.h"
+#include <string.h>
+
+RateController::RateController(uint8_t max_level, uint16_t backlog_full)
+    : _max_level(max_level), _backlog_full(backlog_full), _level(0),
+      _changed_ms(0), _calm_ms(0), _calm(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+uint8_t RateController::load(const LoadReport &r, uint16_t backlog_full)
+{
+    uint32_t pct = backlog_full ? (uint32_t)r.backlog * 100 / backlog_full : 0;
+    if (r.queue_pct > pct)  pct = r.queue_pct;
+    if (r.budget_pct > pct) pct = r.budget_pct;
+    return pct > 100 ? 100 : (uint8_t)pct;
+}
+
+uint8_t RateController::onReport(const LoadReport &r, uint32_t now_ms)
+{
+    uint8_t pct = load(r, _backlog_full);
+    _stats.reports++;
+    _stats.last_load = pct;
+
+    if (pct >= LOAD_HIGH_PCT) {
+        _calm = false;
+        if (_level < _max_level && now_ms - _changed_ms >= RATE_DEGRADE_MS) {
+            _level++;
+            _changed_ms = now_ms;
+            _stats.degrades++;
+        }
+    } else if (pct <= LOAD_LOW_PCT) {
+        if (!_calm) {
+            _calm = true;
+            _calm_ms = now_ms;
+        } else if (_level > 0 && now_ms - _calm_ms >= RATE_RESTORE_MS) {
+            _level--;
+            _changed_ms = now_ms;
+            _calm_ms = now_ms;   // Next step needs another full calm period
+            _stats.restores++;
+        }
+    } else {
+        _calm = false;
+    }
+    return _level;
+}
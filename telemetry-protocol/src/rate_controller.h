@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include "telemetry_codec.h"
+
+// ================= RATE CONTROLLER =================
+// Sender side of the backpressure loop. Turns the display's CMD_LOAD
+// reports into a degradation level, 0 (full rate) to max_level; what each
+// level sheds is up to the sender.
+//
+// A report's load is the worst of its three figures, in percent (the
+// UART backlog against backlog_full bytes). At or above LOAD_HIGH_PCT the
+// level goes up one step, at most every RATE_DEGRADE_MS so a step has time
+// to take effect. It only comes down one step after RATE_RESTORE_MS of
+// reports at or below LOAD_LOW_PCT, which keeps it from oscillating around
+// the threshold. Without reports the level holds.
+
+#define LOAD_HIGH_PCT    80
+#define LOAD_LOW_PCT     50
+#define RATE_DEGRADE_MS  250
+#define RATE_RESTORE_MS  2000
+
+typedef struct {
+    uint32_t reports;
+    uint32_t degrades;
+    uint32_t restores;
+    uint8_t  last_load;   // Percent, newest report
+} RateStats;
+
+class RateController
+{
+public:
+    RateController(uint8_t max_level, uint16_t backlog_full);
+
+    // Returns the new level
+    uint8_t onReport(const LoadReport &r, uint32_t now_ms);
+
+    uint8_t level() const { return _level; }
+    void reset() { _level = 0; }
+    const RateStats &stats() const { return _stats; }
+
+    static uint8_t load(const LoadReport &r, uint16_t backlog_full);
+
+private:
+    uint8_t _max_level;
+    uint16_t _backlog_full;
+    uint8_t _level;
+    uint32_t _changed_ms;   // Last level change
+    uint32_t _calm_ms;      // Start of the current run of low reports
+    bool _calm;
+
+    RateStats _stats;
+};
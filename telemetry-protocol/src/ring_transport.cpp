@@ -0,0 +1,50 @@
+#include "ring_transport.h"
+#include <string.h>
+
+static_assert((RING_TRANSPORT_SIZE & (RING_TRANSPORT_SIZE - 1)) == 0,
+              "RING_TRANSPORT_SIZE must be a power of two");
+
+#define RING_MASK (RING_TRANSPORT_SIZE - 1)
+
+size_t ByteRing::size() const
+{
+    size_t head = _head.load(std::memory_order_acquire);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    return (head - tail) & RING_MASK;
+}
+
+size_t ByteRing::push(const uint8_t *data, size_t len)
+{
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    size_t space = capacity() - ((head - tail) & RING_MASK);
+    if (len > space) {
+        _dropped += len - space;
+        len = space;
+    }
+
+    // At most two copies: up to the end of the buffer, then from the start
+    size_t first = RING_TRANSPORT_SIZE - head;
+    if (first > len) first = len;
+    memcpy(&_buf[head], data, first);
+    memcpy(&_buf[0], data + first, len - first);
+
+    _head.store((head + len) & RING_MASK, std::memory_order_release);
+    return len;
+}
+
+size_t ByteRing::pop(uint8_t *buf, size_t len)
+{
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t head = _head.load(std::memory_order_acquire);
+    size_t avail = (head - tail) & RING_MASK;
+    if (len > avail) len = avail;
+
+    size_t first = RING_TRANSPORT_SIZE - tail;
+    if (first > len) first = len;
+    memcpy(buf, &_buf[tail], first);
+    memcpy(buf + first, &_buf[0], len - first);
+
+    _tail.store((tail + len) & RING_MASK, std::memory_order_release);
+    return len;
+}
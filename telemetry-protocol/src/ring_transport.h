@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "transport.h"
+
+// ================= RING TRANSPORT =================
+// Two ends of an in-memory link, one byte ring per direction: what
+// a().write() queues, b().read() returns and vice versa. Each ring is
+// single producer / single consumer, so the ends may live in different
+// threads. write() never waits (a single-threaded test would deadlock);
+// bytes that do not fit are dropped and counted, like an RX FIFO overrun.
+
+#define RING_TRANSPORT_SIZE 4096   // Bytes per direction, power of two
+
+class ByteRing
+{
+public:
+    size_t size() const;
+    size_t push(const uint8_t *data, size_t len);
+    size_t pop(uint8_t *buf, size_t len);
+
+    uint32_t dropped() const { return _dropped; }
+
+    static constexpr size_t capacity() { return RING_TRANSPORT_SIZE - 1; }
+
+private:
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+    uint32_t _dropped = 0;   // Producer side
+    uint8_t _buf[RING_TRANSPORT_SIZE];
+};
+
+class RingEnd : public Transport
+{
+public:
+    RingEnd(ByteRing &rx, ByteRing &tx) : _rx(rx), _tx(tx) {}
+
+    size_t available() override { return _rx.size(); }
+    size_t read(uint8_t *buf, size_t len) override { return _rx.pop(buf, len); }
+    size_t write(const uint8_t *data, size_t len) override { return _tx.push(data, len); }
+
+    // Bytes this end wrote that the other end never got to see
+    uint32_t dropped() const { return _tx.dropped(); }
+
+private:
+    ByteRing &_rx;
+    ByteRing &_tx;
+};
+
+class RingPair
+{
+public:
+    RingPair() : _a(_b_to_a, _a_to_b), _b(_a_to_b, _b_to_a) {}
+
+    RingEnd &a() { return _a; }
+    RingEnd &b() { return _b; }
+
+private:
+    ByteRing _a_to_b;
+    ByteRing _b_to_a;
+    RingEnd _a;
+    RingEnd _b;
+};
@@ -0,0 +1,96 @@
+#include "socketcan_bus.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+bool SocketCanBus::open(const char *ifname)
+{
+    close();
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) return false;
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0 ||
+        (addr.can_ifindex = ifr.ifr_ifindex,
+         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        ::close(fd);
+        return false;
+    }
+    _fd = fd;
+    return true;
+}
+
+void SocketCanBus::close()
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+bool SocketCanBus::send(const CanFrame &f)
+{
+    struct can_frame cf;
+    memset(&cf, 0, sizeof(cf));
+    cf.can_id = f.id;
+    cf.can_dlc = f.len;
+    memcpy(cf.data, f.data, f.len);
+
+    // ENOBUFS: the interface queue is full, same as a full TWAI TX queue
+    ssize_t n;
+    do {
+        n = ::write(_fd, &cf, sizeof(cf));
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(cf);
+}
+
+bool SocketCanBus::receive(CanFrame &f)
+{
+    struct can_frame cf;
+    for (;;) {
+        ssize_t n = ::read(_fd, &cf, sizeof(cf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n != (ssize_t)sizeof(cf)) return false;
+        if (cf.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) continue;
+
+        f.id = cf.can_id & CAN_SFF_MASK;
+        f.len = cf.can_dlc > CAN_DATA_LEN ? CAN_DATA_LEN : cf.can_dlc;
+        memcpy(f.data, cf.data, f.len);
+        return true;
+    }
+}
+
+void SocketCanBus::setFilter(const uint32_t *ids, size_t count)
+{
+    if (_fd < 0) return;
+    if (!ids) {
+        struct can_filter all = { 0, 0 };
+        setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all));
+        return;
+    }
+
+    struct can_filter filters[CAN_PRIORITIES * 4];
+    if (count > sizeof(filters) / sizeof(filters[0])) count = sizeof(filters) / sizeof(filters[0]);
+    for (size_t i = 0; i < count; i++) {
+        filters[i].can_id = ids[i];
+        filters[i].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+    setsockopt(_fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters, count * sizeof(filters[0]));
+}
+#endif
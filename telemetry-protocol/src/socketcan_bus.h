@@ -0,0 +1,34 @@
+#pragma once
+
+#if defined(__linux__)
+#include "can_transport.h"
+
+// ================= SOCKETCAN BUS =================
+// Linux CAN socket, for running the CAN transport on a PC against a
+// virtual bus or a USB adapter:
+//   ip link add dev vcan0 type vcan && ip link set up vcan0
+// Every socket on vcan0 sees every other socket's frames (but not its
+// own), like nodes on a real bus. Filters are exact, in the kernel.
+
+class SocketCanBus : public CanBus
+{
+public:
+    SocketCanBus() : _fd(-1) {}
+    ~SocketCanBus() override { close(); }
+
+    bool open(const char *ifname);
+    void close();
+
+    bool send(const CanFrame &f) override;
+    bool receive(CanFrame &f) override;
+    void setFilter(const uint32_t *ids, size_t count) override;
+
+    int fd() const { return _fd; }
+
+    SocketCanBus(const SocketCanBus &) = delete;
+    SocketCanBus &operator=(const SocketCanBus &) = delete;
+
+private:
+    int _fd;
+};
+#endif
@@ -0,0 +1,414 @@
+#include "telemetry_codec.h"
+
+uint32_t telemetry_command_fields(uint8_t cmd)
+{
+    switch (cmd) {
+#define X(CMD, id, period, fields) case CMD: return CMD##_FIELDS;
+        TELEMETRY_COMMANDS(X)
+#undef X
+        default: return 0;
+    }
+}
+
+uint8_t telemetry_encode(const DisplayData *d, uint8_t cmd, uint8_t *out)
+{
+    switch (cmd) {
+#define X(CMD, id, period, fields)                    \
+        case CMD:                                     \
+            pack_fields<CMD##_FIELDS>(d, out);        \
+            return CMD##_LEN;
+        TELEMETRY_COMMANDS(X)
+#undef X
+        default: return 0;
+    }
+}
+
+uint8_t telemetry_encode_delta(const DisplayData *d, uint8_t mask, uint8_t *out)
+{
+    uint8_t *w = out;
+    *w++ = mask;
+    for (unsigned i = 0; i < FIELD_COUNT; i++) {
+        if (mask & (1u << i)) {
+            const FieldDesc &f = telemetry_fields[i];
+            memcpy(w, (const uint8_t *)d + f.offset, f.size);
+            w += f.size;
+        }
+    }
+    return w - out;
+}
+
+bool telemetry_decode(DisplayData *d, uint8_t cmd, const uint8_t *p,
+                      uint8_t len, uint32_t *changed)
+{
+    switch (cmd) {
+#define X(CMD, id, period, fields)                    \
+        case CMD:                                     \
+            if (len != CMD##_LEN) return false;       \
+            *changed |= unpack_fields<CMD##_FIELDS>(d, p); \
+            return true;
+        TELEMETRY_COMMANDS(X)
+#undef X
+
+        case CMD_DELTA: {
+            if (len < 1 || len != delta_payload_len(p[0])) return false;
+            uint8_t mask = *p++;
+            for (unsigned i = 0; i < FIELD_COUNT; i++) {
+                if (mask & (1u << i)) {
+                    const FieldDesc &f = telemetry_fields[i];
+                    uint8_t *dst = (uint8_t *)d + f.offset;
+                    if (memcmp(dst, p, f.size) != 0) {
+                        memcpy(dst, p, f.size);
+                        *changed |= 1u << i;
+                    }
+                    p += f.size;
+                }
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+uint32_t telemetry_diff(const DisplayData *a, const DisplayData *b)
+{
+    uint32_t mask = 0;
+    for (unsigned i = 0; i < FIELD_COUNT; i++) {
+        const FieldDesc &f = telemetry_fields[i];
+        if (memcmp((const uint8_t *)a + f.offset, (const uint8_t *)b + f.offset, f.size) != 0) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+void telemetry_copy_fields(DisplayData *dst, const DisplayData *src, uint32_t mask)
+{
+    for (unsigned i = 0; i < FIELD_COUNT; i++) {
+        if (mask & (1u << i)) {
+            const FieldDesc &f = telemetry_fields[i];
+            memcpy((uint8_t *)dst + f.offset, (const uint8_t *)src + f.offset, f.size);
+        }
+    }
+}
+
+uint8_t lap_event_encode(uint32_t src_ms, uint8_t lap, uint8_t *out)
+{
+    memcpy(out, &src_ms, 4);
+    out[4] = lap;
+    return LAP_EVENT_LEN;
+}
+
+void superframe_reset(Superframe *sf, uint8_t max_len)
+{
+    sf->len = 0;
+    sf->count = 0;
+    sf->max_len = max_len;
+}
+
+bool superframe_add(Superframe *sf, uint8_t cmd, const uint8_t *p, uint8_t len)
+{
+    if (sf->len + SUPERFRAME_RECORD_HEADER + len > sf->max_len) return false;
+
+    uint8_t *out = &sf->payload[sf->len];
+    out[0] = cmd;
+    out[1] = len;
+    memcpy(&out[2], p, len);
+    sf->len += SUPERFRAME_RECORD_HEADER + len;
+    sf->count++;
+    return true;
+}
+
+bool superframe_walk(const uint8_t *p, uint8_t len, FrameHandler handler, void *ctx)
+{
+    // Check the whole chain first so a bad length never half-applies it
+    uint8_t pos = 0;
+    while (pos < len) {
+        if (len - pos < SUPERFRAME_RECORD_HEADER) return false;
+        if (len - pos - SUPERFRAME_RECORD_HEADER < p[pos + 1]) return false;
+        pos += SUPERFRAME_RECORD_HEADER + p[pos + 1];
+    }
+    if (len == 0) return false;
+
+    for (pos = 0; pos < len; pos += SUPERFRAME_RECORD_HEADER + p[pos + 1]) {
+        handler(p[pos], &p[pos + 2], p[pos + 1], ctx);
+    }
+    return true;
+}
+
+uint8_t samples_encode(const SampleBatch *b, uint8_t *out)
+{
+    bool wide = false;
+    for (uint8_t i = 1; i < b->count; i++) {
+        int32_t d = b->v[i] - b->v[i - 1];
+        if (d < INT8_MIN || d > INT8_MAX) wide = true;
+    }
+
+    memcpy(&out[0], &b->start_ms, 4);
+    out[4] = b->interval_ms;
+    out[5] = b->count | (wide ? SAMPLES_WIDE_FLAG : 0);
+    memcpy(&out[6], &b->v[0], 2);
+
+    uint8_t len = SAMPLES_HEADER_LEN;
+    for (uint8_t i = 1; i < b->count; i++) {
+        int16_t d = b->v[i] - b->v[i - 1];
+        if (wide) {
+            memcpy(&out[len], &d, 2);
+            len += 2;
+        } else {
+            out[len++] = (uint8_t)(int8_t)d;
+        }
+    }
+    return len;
+}
+
+bool samples_decode(const uint8_t *p, uint8_t len, SampleBatch *b)
+{
+    if (len < SAMPLES_HEADER_LEN) return false;
+
+    bool wide = p[5] & SAMPLES_WIDE_FLAG;
+    uint8_t count = p[5] & ~SAMPLES_WIDE_FLAG;
+    uint8_t width = wide ? 2 : 1;
+    if (count == 0 || count > SAMPLE_BATCH_MAX) return false;
+    if (len != SAMPLES_HEADER_LEN + (count - 1) * width) return false;
+
+    memcpy(&b->start_ms, &p[0], 4);
+    b->interval_ms = p[4];
+    b->count = count;
+    memcpy(&b->v[0], &p[6], 2);
+
+    const uint8_t *d = &p[SAMPLES_HEADER_LEN];
+    for (uint8_t i = 1; i < count; i++, d += width) {
+        int16_t delta;
+        if (wide) memcpy(&delta, d, 2);
+        else      delta = (int8_t)*d;
+        b->v[i] = b->v[i - 1] + delta;
+    }
+    return true;
+}
+
+uint8_t caps_encode(const Caps *c, uint8_t *out)
+{
+    out[0] = c->version;
+    memcpy(&out[1], &c->features, 2);
+    memcpy(&out[3], &c->max_baud, 4);
+    out[7] = c->limit_count;
+
+    uint8_t len = CAPS_HEADER_LEN;
+    for (uint8_t i = 0; i < c->limit_count; i++) {
+        out[len] = c->limits[i].cmd;
+        memcpy(&out[len + 1], &c->limits[i].min_period_ms, 2);
+        len += 3;
+    }
+    return len;
+}
+
+bool caps_decode(const uint8_t *p, uint8_t len, Caps *c)
+{
+    if (len < CAPS_HEADER_LEN) return false;
+    uint8_t count = p[7];
+    if (count > CAPS_MAX_LIMITS || len != CAPS_HEADER_LEN + count * 3) return false;
+
+    c->version = p[0];
+    memcpy(&c->features, &p[1], 2);
+    memcpy(&c->max_baud, &p[3], 4);
+    c->limit_count = count;
+
+    const uint8_t *l = &p[CAPS_HEADER_LEN];
+    for (uint8_t i = 0; i < count; i++, l += 3) {
+        c->limits[i].cmd = l[0];
+        memcpy(&c->limits[i].min_period_ms, &l[1], 2);
+    }
+    return true;
+}
+
+uint16_t caps_id(const Caps *c)
+{
+    uint8_t buf[CAPS_HEADER_LEN + CAPS_MAX_LIMITS * 3];
+    return crc16(buf, caps_encode(c, buf));
+}
+
+uint8_t link_config_encode(const LinkConfig *cfg, uint8_t *out)
+{
+    memcpy(&out[0], &cfg->caps_id, 2);
+    out[2] = cfg->framing;
+    memcpy(&out[3], &cfg->features, 2);
+    return CONFIGURE_ARGS_LEN;
+}
+
+bool link_config_decode(const uint8_t *p, uint8_t len, LinkConfig *cfg)
+{
+    if (len != CONFIGURE_ARGS_LEN || p[2] > FRAMING_COBS) return false;
+    memcpy(&cfg->caps_id, &p[0], 2);
+    cfg->framing = p[2];
+    memcpy(&cfg->features, &p[3], 2);
+    cfg->max_baud = 0;
+    return true;
+}
+
+uint8_t load_encode(const LoadReport *r, uint8_t *out)
+{
+    memcpy(&out[0], &r->backlog, 2);
+    out[2] = r->queue_pct;
+    out[3] = r->budget_pct;
+    return LOAD_LEN;
+}
+
+bool load_decode(const uint8_t *p, uint8_t len, LoadReport *r)
+{
+    if (len != LOAD_LEN) return false;
+    memcpy(&r->backlog, &p[0], 2);
+    r->queue_pct = p[2];
+    r->budget_pct = p[3];
+    return true;
+}
+
+uint8_t rx_stats_encode(const RxStatsReport *r, uint8_t *out)
+{
+    memcpy(&out[0], &r->records, 4);
+    memcpy(&out[4], &r->errors, 4);
+    memcpy(&out[8], &r->drops, 4);
+    memcpy(&out[12], &r->ui_avg_us, 2);
+    memcpy(&out[14], &r->ui_max_us, 2);
+    memcpy(&out[16], &r->lag_max_us, 4);
+    return RX_STATS_LEN;
+}
+
+bool rx_stats_decode(const uint8_t *p, uint8_t len, RxStatsReport *r)
+{
+    if (len != RX_STATS_LEN) return false;
+    memcpy(&r->records, &p[0], 4);
+    memcpy(&r->errors, &p[4], 4);
+    memcpy(&r->drops, &p[8], 4);
+    memcpy(&r->ui_avg_us, &p[12], 2);
+    memcpy(&r->ui_max_us, &p[14], 2);
+    memcpy(&r->lag_max_us, &p[16], 4);
+    return true;
+}
+
+bool lap_event_decode(const uint8_t *p, uint8_t len, uint32_t *src_ms, uint8_t *lap)
+{
+    if (len != LAP_EVENT_LEN) return false;
+    memcpy(src_ms, p, 4);
+    *lap = p[4];
+    return true;
+}
+
+uint8_t control_encode(uint8_t seq, uint8_t op, const uint8_t *args,
+                       uint8_t args_len, uint8_t *out)
+{
+    out[0] = seq;
+    out[1] = op;
+    if (args_len) memcpy(&out[2], args, args_len);
+    return CONTROL_HEADER_LEN + args_len;
+}
+
+bool control_decode(const uint8_t *p, uint8_t len, uint8_t *seq, uint8_t *op,
+                    const uint8_t **args, uint8_t *args_len)
+{
+    if (len < CONTROL_HEADER_LEN) return false;
+    *seq = p[0];
+    *op = p[1];
+    *args = &p[2];
+    *args_len = len - CONTROL_HEADER_LEN;
+    return true;
+}
+
+uint8_t ack_encode(uint8_t seq, uint8_t status, uint8_t *out)
+{
+    out[0] = seq;
+    out[1] = status;
+    return ACK_LEN;
+}
+
+bool ack_decode(const uint8_t *p, uint8_t len, uint8_t *seq, uint8_t *status)
+{
+    if (len != ACK_LEN) return false;
+    *seq = p[0];
+    *status = p[1];
+    return true;
+}
+
+static uint8_t probe_byte(uint8_t idx, uint8_t i)
+{
+    switch ((idx + i / 8) & 3) {
+        case 0:  return 0x00;
+        case 1:  return 0xFF;
+        case 2:  return (i & 1) ? 0x55 : SYNC_BYTE;
+        default: return (uint8_t)(idx * 31 + i * 7);
+    }
+}
+
+uint8_t probe_encode(uint8_t idx, uint8_t *out)
+{
+    out[0] = idx;
+    for (uint8_t i = 1; i < PROBE_LEN; i++) {
+        out[i] = probe_byte(idx, i);
+    }
+    return PROBE_LEN;
+}
+
+bool probe_check(const uint8_t *p, uint8_t len)
+{
+    if (len != PROBE_LEN) return false;
+    for (uint8_t i = 1; i < PROBE_LEN; i++) {
+        if (p[i] != probe_byte(p[0], i)) return false;
+    }
+    return true;
+}
+
+uint8_t trace_header_encode(uint16_t seq, uint32_t tx_us, uint8_t *out)
+{
+    memcpy(&out[0], &seq, 2);
+    memcpy(&out[2], &tx_us, 4);
+    return TRACE_HEADER_LEN;
+}
+
+bool trace_header_decode(const uint8_t *p, uint8_t len, uint16_t *seq, uint32_t *tx_us)
+{
+    if (len < TRACE_HEADER_LEN) return false;
+    memcpy(seq, &p[0], 2);
+    memcpy(tx_us, &p[2], 4);
+    return true;
+}
+
+size_t frame_encode_addr(uint8_t *out, uint8_t addr, uint8_t cmd,
+                         const uint8_t *payload, uint8_t len, Framing framing)
+{
+    if (addr == ADDR_NONE) {
+        return len > FRAME_MAX_PAYLOAD ? 0 : frame_encode(out, cmd, payload, len, framing);
+    }
+
+    // A cut record would still pass the CRC and decode as garbage
+    if (len > FRAME_MAX_PAYLOAD - ADDR_LEN) return 0;
+    uint8_t body[FRAME_MAX_PAYLOAD];
+    body[0] = addr;
+    memcpy(&body[ADDR_LEN], payload, len);
+    return frame_encode(out, cmd | CMD_ADDR_FLAG, body, ADDR_LEN + len, framing);
+}
+
+uint8_t msg_frag_encode(const MessageFragment *f, uint8_t *out)
+{
+    out[0] = f->id;
+    out[1] = f->priority;
+    out[2] = f->index;
+    out[3] = f->count;
+    memcpy(&out[MSG_FRAG_HEADER_LEN], f->text, f->len);
+    return MSG_FRAG_HEADER_LEN + f->len;
+}
+
+bool msg_frag_decode(const uint8_t *p, uint8_t len, MessageFragment *f)
+{
+    if (len < MSG_FRAG_HEADER_LEN || len > MSG_FRAG_HEADER_LEN + MSG_FRAG_TEXT) return false;
+    f->id = p[0];
+    f->priority = p[1];
+    f->index = p[2];
+    f->count = p[3];
+    f->len = len - MSG_FRAG_HEADER_LEN;
+    f->text = &p[MSG_FRAG_HEADER_LEN];
+
+    if (f->count == 0 || f->count > MSG_MAX_FRAGS || f->index >= f->count) return false;
+    // Only the last fragment may be short
+    return f->index == f->count - 1 || f->len == MSG_FRAG_TEXT;
+}
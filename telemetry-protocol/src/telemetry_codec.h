@@ -0,0 +1,144 @@
+#pragma once
+
+#include "telemetry_protocol.h"
+
+// ================= TELEMETRY CODEC =================
+// Payload encoders and decoders for every schema command plus CMD_DELTA.
+// Used by the simulator, the display and host-side tools alike.
+
+// Fields carried by a fixed-layout command, 0 if cmd is not one
+uint32_t telemetry_command_fields(uint8_t cmd);
+
+// Writes cmd's payload for d into out, returns its length (0: unknown cmd)
+uint8_t telemetry_encode(const DisplayData *d, uint8_t cmd, uint8_t *out);
+
+// CMD_DELTA payload carrying the fields in mask
+uint8_t telemetry_encode_delta(const DisplayData *d, uint8_t mask, uint8_t *out);
+
+// Applies a schema command or CMD_DELTA payload onto d. ORs the fields
+// whose value changed into *changed. Returns false for any other cmd or
+// a payload whose length doesn't match.
+bool telemetry_decode(DisplayData *d, uint8_t cmd, const uint8_t *p,
+                      uint8_t len, uint32_t *changed);
+
+// Fields whose value differs between a and b
+uint32_t telemetry_diff(const DisplayData *a, const DisplayData *b);
+
+void telemetry_copy_fields(DisplayData *dst, const DisplayData *src, uint32_t mask);
+
+// CMD_SUPERFRAME builder: add() returns false when the record would take
+// the payload past max_len (leave room for a trace prefix, say)
+typedef struct {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t len;
+    uint8_t count;
+    uint8_t max_len;
+} Superframe;
+
+void superframe_reset(Superframe *sf, uint8_t max_len = FRAME_MAX_PAYLOAD);
+bool superframe_add(Superframe *sf, uint8_t cmd, const uint8_t *p, uint8_t len);
+
+// Hands every record of a CMD_SUPERFRAME payload to handler in order.
+// Returns false (having delivered nothing) if the records don't add up.
+bool superframe_walk(const uint8_t *p, uint8_t len, FrameHandler handler, void *ctx);
+
+// CMD_SAMPLES batch, decoded to absolute values
+typedef struct {
+    uint32_t start_ms;
+    uint8_t  interval_ms;
+    uint8_t  count;
+    int16_t  v[SAMPLE_BATCH_MAX];
+} SampleBatch;
+
+uint8_t samples_encode(const SampleBatch *b, uint8_t *out);
+bool samples_decode(const uint8_t *p, uint8_t len, SampleBatch *b);
+
+// CMD_CAPS payload and CTRL_CONFIGURE args
+typedef struct {
+    uint8_t  cmd;
+    uint16_t min_period_ms;
+} RateLimit;
+
+typedef struct {
+    uint8_t   version;
+    uint16_t  features;
+    uint32_t  max_baud;
+    uint8_t   limit_count;
+    RateLimit limits[CAPS_MAX_LIMITS];
+} Caps;
+
+typedef struct {
+    uint16_t caps_id;    // caps_id() of the sim caps this was chosen for
+    uint8_t  framing;    // Framing
+    uint16_t features;   // FEAT_* outside FEAT_FRAMING
+    uint32_t max_baud;   // Not sent: the sim's MAX_BAUD, kept for reconnects
+} LinkConfig;
+
+uint8_t caps_encode(const Caps *c, uint8_t *out);
+bool caps_decode(const uint8_t *p, uint8_t len, Caps *c);
+uint16_t caps_id(const Caps *c);   // CRC-16 of the encoded caps
+uint8_t link_config_encode(const LinkConfig *cfg, uint8_t *out);
+bool link_config_decode(const uint8_t *p, uint8_t len, LinkConfig *cfg);
+
+// CMD_LOAD payload
+typedef struct {
+    uint16_t backlog;
+    uint8_t  queue_pct;
+    uint8_t  budget_pct;
+} LoadReport;
+
+uint8_t load_encode(const LoadReport *r, uint8_t *out);
+bool load_decode(const uint8_t *p, uint8_t len, LoadReport *r);
+
+// CMD_RX_STATS payload
+typedef struct {
+    uint32_t records;
+    uint32_t errors;
+    uint32_t drops;
+    uint16_t ui_avg_us;
+    uint16_t ui_max_us;
+    uint32_t lag_max_us;
+} RxStatsReport;
+
+uint8_t rx_stats_encode(const RxStatsReport *r, uint8_t *out);
+bool rx_stats_decode(const uint8_t *p, uint8_t len, RxStatsReport *r);
+
+// CMD_MESSAGE_FRAG payload; text points into the decoded buffer
+typedef struct {
+    uint8_t id;
+    uint8_t priority;
+    uint8_t index;
+    uint8_t count;
+    uint8_t len;
+    const uint8_t *text;
+} MessageFragment;
+
+uint8_t msg_frag_encode(const MessageFragment *f, uint8_t *out);
+bool msg_frag_decode(const uint8_t *p, uint8_t len, MessageFragment *f);
+
+// CMD_LAP_EVENT payload, returns its length
+uint8_t lap_event_encode(uint32_t src_ms, uint8_t lap, uint8_t *out);
+bool lap_event_decode(const uint8_t *p, uint8_t len, uint32_t *src_ms, uint8_t *lap);
+
+// CMD_CONTROL / CMD_ACK payloads, encoders return their length.
+// control_decode points *args into p.
+uint8_t control_encode(uint8_t seq, uint8_t op, const uint8_t *args,
+                       uint8_t args_len, uint8_t *out);
+bool control_decode(const uint8_t *p, uint8_t len, uint8_t *seq, uint8_t *op,
+                    const uint8_t **args, uint8_t *args_len);
+uint8_t ack_encode(uint8_t seq, uint8_t status, uint8_t *out);
+bool ack_decode(const uint8_t *p, uint8_t len, uint8_t *seq, uint8_t *status);
+
+// CMD_PROBE payload number idx (PROBE_LEN bytes), and its check
+uint8_t probe_encode(uint8_t idx, uint8_t *out);
+bool probe_check(const uint8_t *p, uint8_t len);
+
+// Trace prefix for frames sent with CMD_TRACE_FLAG
+uint8_t trace_header_encode(uint16_t seq, uint32_t tx_us, uint8_t *out);
+bool trace_header_decode(const uint8_t *p, uint8_t len, uint16_t *seq, uint32_t *tx_us);
+
+// Frame with the bus address prefix (CMD_ADDR_FLAG), or a plain
+// frame_encode() for ADDR_NONE. Returns 0 and writes nothing when the
+// payload plus prefix is longer than FRAME_MAX_PAYLOAD.
+size_t frame_encode_addr(uint8_t *out, uint8_t addr, uint8_t cmd,
+                         const uint8_t *payload, uint8_t len, Framing framing);
@@ -0,0 +1,86 @@
+#include "telemetry_dispatch.h"
+
+static void dispatchRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx);
+
+static void onRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    if (cmd != CMD_SUPERFRAME) {   // No nesting
+        dispatchRecord(cmd, p, len, ctx);
+    }
+}
+
+static void dispatchRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    const TelemetryDispatch *d = (const TelemetryDispatch *)ctx;
+
+    if (cmd == CMD_SUPERFRAME) {
+        superframe_walk(p, len, onRecord, ctx);
+        return;
+    }
+    if (!(command_groups(cmd) & (d->groups | GROUP_LINK))) {
+        if (d->not_ours) d->not_ours(d->ctx);
+        return;
+    }
+    if (cmd == CMD_POLL) {
+        if (d->poll) d->poll(d->ctx);
+        return;
+    }
+    if (d->record) d->record(cmd, d->ctx);
+
+    switch (cmd) {
+        case CMD_MESSAGE:
+        case CMD_MESSAGE_FRAG:
+        case CMD_ACK:
+        case CMD_CAPS:
+            if (d->event) d->event(cmd, p, len, d->ctx);
+            break;
+        case CMD_PROBE:
+            if (d->probe) d->probe(probe_check(p, len), d->ctx);
+            break;
+        case CMD_SAMPLES: {
+            SampleBatch b;
+            if (d->samples && samples_decode(p, len, &b)) d->samples(&b, d->ctx);
+            break;
+        }
+        case CMD_LAP_EVENT: {
+            uint32_t src_ms;
+            uint8_t lap;
+            if (d->lap_event && lap_event_decode(p, len, &src_ms, &lap)) {
+                d->lap_event(src_ms, lap, d->ctx);
+            }
+            break;
+        }
+        default:
+            // Schema commands and CMD_DELTA; unknown or mis-sized frames are ignored
+            if (d->data) telemetry_decode(d->data, cmd, p, len, d->changed);
+            break;
+    }
+}
+
+void telemetry_dispatch(const TelemetryDispatch *d, uint8_t cmd, const uint8_t *payload,
+                        uint8_t len)
+{
+    if (cmd & CMD_ADDR_FLAG) {
+        if (len < ADDR_LEN) return;
+        if (d->node != ADDR_NONE && payload[0] != ADDR_BROADCAST && payload[0] != d->node) {
+            if (d->not_ours) d->not_ours(d->ctx);
+            return;
+        }
+        cmd &= ~CMD_ADDR_FLAG;
+        payload += ADDR_LEN;
+        len -= ADDR_LEN;
+    }
+
+    if (!(cmd & CMD_TRACE_FLAG)) {
+        dispatchRecord(cmd, payload, len, (void *)d);
+        return;
+    }
+
+    uint16_t seq;
+    uint32_t tx_us;
+    if (!trace_header_decode(payload, len, &seq, &tx_us)) return;
+
+    cmd &= ~CMD_TRACE_FLAG;
+    dispatchRecord(cmd, payload + TRACE_HEADER_LEN, len - TRACE_HEADER_LEN, (void *)d);
+    if (d->traced) d->traced(cmd, seq, tx_us, d->ctx);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "telemetry_codec.h"
+
+// ================= RECEIVE DISPATCH =================
+// What the display does with each frame FrameParser delivers, kept here so
+// the fuzz target and host tools run the very same path. In order:
+//
+//   address prefix   stripped; on a bus (node != ADDR_NONE) frames for
+//                    another node are dropped as not ours
+//   trace prefix     stripped, handed to traced() once the frame is done
+//   CMD_SUPERFRAME   each record dispatched as below; no nesting
+//   groups           records outside groups | GROUP_LINK are not ours
+//   CMD_POLL         poll(), not counted as a record
+//
+// Every other record goes to record() and then by command: schema commands
+// and CMD_DELTA are decoded onto *data, samples, lap events and probes are
+// decoded for their handler, and CMD_MESSAGE, CMD_MESSAGE_FRAG, CMD_ACK and
+// CMD_CAPS go to event() as they came, for the receiver to queue. Any
+// handler may be NULL, and so may data (changed with it): schema records
+// are then dropped.
+typedef struct {
+    uint8_t node;     // Our bus address; ADDR_NONE off a bus
+    uint8_t groups;   // GROUP_* acted on; GROUP_ALL off a bus
+
+    DisplayData *data;
+    uint32_t *changed;   // Fields schema records changed are ORed in here
+
+    void (*not_ours)(void *ctx);
+    void (*record)(uint8_t cmd, void *ctx);   // Each record acted on
+    void (*traced)(uint8_t cmd, uint16_t seq, uint32_t tx_us, void *ctx);
+    void (*poll)(void *ctx);
+    void (*samples)(const SampleBatch *b, void *ctx);
+    void (*lap_event)(uint32_t src_ms, uint8_t lap, void *ctx);
+    void (*probe)(bool ok, void *ctx);
+    FrameHandler event;
+    void *ctx;
+} TelemetryDispatch;
+
+// Dispatches one frame as FrameParser delivers it (prefixes included)
+void telemetry_dispatch(const TelemetryDispatch *d, uint8_t cmd, const uint8_t *payload,
+                        uint8_t len);
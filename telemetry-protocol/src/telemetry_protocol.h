@@ -0,0 +1,295 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_schema.h"
+
+// ================= VERSION =================
+// Revision of everything in this library that goes on the wire, sent in
+// CTRL_HELLO and CMD_CAPS. Ends of different versions stay on the boot
+// configuration (see CAPABILITIES). Version 1, the original fixed-frame
+// protocol, has no CTRL_HELLO and can't share a link with this one.
+#define PROTOCOL_VERSION 2
+
+// ================= FRAMING =================
+// Plain (v1):  SYNC | CMD | LEN | PAYLOAD[LEN]
+// CRC   (v2):  SYNC | CMD | LEN | PAYLOAD[LEN] | CRC16 (big-endian)
+// COBS:        COBS(CMD | PAYLOAD | CRC16) | 0x00
+// The CRC-16/CCITT-FALSE covers CMD, LEN and PAYLOAD (CMD and PAYLOAD
+// for COBS, where LEN is implied by the delimiter).
+//
+// COBS removes every 0x00 from the frame body, so the delimiter can never
+// appear inside a payload and a receiver that lost alignment is back in
+// step at the next delimiter.
+#define SYNC_BYTE  0xAA
+#define COBS_DELIM 0x00
+
+#define FRAME_HEADER_LEN  3
+#define FRAME_CRC_LEN     2
+#define FRAME_MAX_PAYLOAD 64
+#define FRAME_MAX_SIZE    (FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD + FRAME_CRC_LEN)
+#define FRAME_MAX_WIRE    (FRAME_MAX_PAYLOAD + 5)   // Worst case of frame_size()
+
+typedef enum {
+    FRAMING_PLAIN,
+    FRAMING_CRC,
+    FRAMING_COBS,
+} Framing;
+
+// Receives one decoded frame (or superframe record)
+typedef void (*FrameHandler)(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx);
+
+// ================= COMMANDS =================
+// Fixed-layout commands (CMD_FAST, CMD_AWARENESS, CMD_GRAPH,
+// CMD_HEARTBEAT) are generated from telemetry_schema.h
+#define CMD_MESSAGE    0x05
+#define CMD_DELTA      0x06
+#define CMD_LAP_EVENT  0x07
+#define CMD_CONTROL    0x08   // Display -> sim
+#define CMD_ACK        0x09   // Sim -> display
+#define CMD_PROBE      0x0A   // Sim -> display, link quality burst
+#define CMD_SUPERFRAME 0x0B
+#define CMD_SAMPLES    0x0C   // Batched high-rate velocity samples
+#define CMD_LOAD       0x0D   // Display -> sim, periodic load report
+#define CMD_CAPS       0x0E   // Sim -> display, answer to CTRL_HELLO
+#define CMD_POLL       0x0F   // Sim -> one display on a bus: its turn to send
+#define CMD_MESSAGE_FRAG 0x10 // One fragment of a long custom message
+#define CMD_RX_STATS   0x11   // Display -> sim, receive counters and UI timing
+
+// ================= DELTA FRAMES =================
+// CMD_DELTA payload: MASK | fields present in MASK, in schema order.
+// MASK uses the FIELD_* bits and each field is encoded exactly as in its
+// full frame. Full frames act as keyframes and are still sent
+// periodically, so a lost delta is corrected by the next keyframe.
+static inline uint8_t delta_payload_len(uint8_t mask)
+{
+    return 1 + fields_len(mask);
+}
+
+// ================= LAP EVENTS =================
+// CMD_LAP_EVENT payload: SRC_MS (u32) | LAP (u8). Sent the moment the lap
+// changes, stamped with the sender's millis() at that moment; LAP 0 is an
+// attempt reset. CMD_AWARENESS keeps carrying laps as a fallback.
+#define LAP_EVENT_LEN 5
+
+// ================= LONG MESSAGES =================
+// CMD_MESSAGE_FRAG payload: MSG_ID (u8) | PRIORITY (u8) | INDEX (u8) |
+// COUNT (u8) | TEXT. Fragment INDEX of COUNT carries bytes
+// INDEX * MSG_FRAG_TEXT onwards of a message up to MAX_LONG_MSG_LEN long;
+// all but the last carry exactly MSG_FRAG_TEXT bytes. Fragments are
+// small so they fit between CMD_FAST frames. The sender repeats whole
+// messages; receivers drop copies of a MSG_ID they already have.
+// CMD_MESSAGE remains for short messages to displays without FEAT_MSG_FRAG.
+#define MSG_FRAG_HEADER_LEN 4
+#define MSG_FRAG_TEXT       16
+#define MAX_LONG_MSG_LEN    128
+#define MSG_MAX_FRAGS       (MAX_LONG_MSG_LEN / MSG_FRAG_TEXT)
+
+enum : uint8_t {
+    MSG_PRIO_INFO   = 0,
+    MSG_PRIO_NORMAL = 1,   // Also CMD_MESSAGE
+    MSG_PRIO_URGENT = 2,
+};
+
+// ================= SUPERFRAMES =================
+// CMD_SUPERFRAME payload: one or more records CMD (u8) | LEN (u8) |
+// PAYLOAD[LEN], each exactly what a frame of its own would carry. Used to
+// send everything due in one scheduler tick behind a single header and
+// CRC; a tick with one record goes out as a plain frame instead. Only
+// with FEAT_SUPERFRAME agreed, which a display opts into: the bytes saved
+// are few, and the decode work lands in bursts on the busiest ticks.
+#define SUPERFRAME_RECORD_HEADER 2
+
+// ================= SAMPLE BATCHES =================
+// CMD_SAMPLES payload: START_MS (u32) | INTERVAL_MS (u8) | COUNT (u8) |
+// BASE (i16) | COUNT - 1 deltas, each sample minus the one before it.
+// Deltas are i8, or i16 when bit 7 of COUNT is set because one didn't fit.
+// Sample i was taken at START_MS + i * INTERVAL_MS on the sender's clock.
+// Velocity samples are in 0.1 km/h, like vel_aux10 on the sim.
+#define SAMPLE_BATCH_MAX  16
+#define SAMPLES_WIDE_FLAG 0x80
+#define SAMPLES_HEADER_LEN 8
+
+// ================= CONTROL CHANNEL =================
+// CMD_CONTROL payload: SEQ (u8) | OP (u8) | ARGS. The sim applies each
+// SEQ once and answers every copy it receives with CMD_ACK:
+// SEQ (u8) | STATUS (u8), so the display can retransmit until acked.
+#define CONTROL_HEADER_LEN 2
+#define CONTROL_MAX_ARGS   8
+#define ACK_LEN            2
+
+typedef enum {
+    CTRL_RESET    = 0x01,   // Reset lap counter and attempt, no args
+    CTRL_PING     = 0x02,   // Acked only, for round trip time
+    CTRL_SET_RATE = 0x03,   // CMD (u8) | PERIOD_MS (u16)
+    CTRL_SET_BAUD = 0x04,   // BAUD (u32); acked at the old rate, then switched
+    CTRL_PROBE    = 0x05,   // COUNT (u8); CMD_PROBE frames, then the ack
+    CTRL_HELLO    = 0x06,   // VERSION (u8); CMD_CAPS, then the ack
+    CTRL_CONFIGURE = 0x07,  // LinkConfig; acked, then applied
+    CTRL_SUBSCRIBE = 0x08,  // GROUPS (u8); bus only, see BUS ADDRESSING
+} ControlOp;
+
+#define SET_RATE_ARGS_LEN 3
+#define SET_BAUD_ARGS_LEN 4
+#define PROBE_ARGS_LEN    1
+#define SUBSCRIBE_ARGS_LEN 1
+
+typedef enum {
+    ACK_OK          = 0,
+    ACK_UNSUPPORTED = 1,    // Unknown OP
+    ACK_BAD_ARGS    = 2,
+    ACK_STALE       = 3,    // CTRL_CONFIGURE made for other capabilities
+    ACK_BAD_VERSION = 4,    // CTRL_HELLO from another PROTOCOL_VERSION
+} AckStatus;
+
+// ================= LOAD REPORTS =================
+// CMD_LOAD payload: BACKLOG (u16, most bytes seen waiting in the UART
+// driver since the last report) | QUEUE_PCT (u8, fullest display queue) |
+// BUDGET_PCT (u8, share of the report period spent rendering). Sent
+// unacknowledged every LOAD_REPORT_MS; a lost one is simply superseded.
+#define LOAD_LEN       4
+#define LOAD_REPORT_MS 100
+
+// ================= RX STATS =================
+// CMD_RX_STATS payload: RECORDS (u32, commands decoded) | ERRORS (u32,
+// frames failing CRC, length or sync) | DROPS (u32, bytes or decoded
+// frames lost to a full buffer or queue), all running totals since boot,
+// so a lost report costs nothing; then UI_AVG_US (u16) | UI_MAX_US (u16),
+// the LVGL refresh passes, and LAG_MAX_US (u32), the longest the UI loop
+// left decoded frames waiting, all three since the previous report.
+// Sent next to CMD_LOAD once FEAT_RX_STATS is agreed; what the sim's
+// stress mode measures the display by.
+#define RX_STATS_LEN 20
+
+// ================= CAPABILITIES =================
+// Both sides boot into the same fixed configuration (FRAMING_CRC at
+// BAUD_BASE). The display then sends CTRL_HELLO; the sim answers with
+// CMD_CAPS and the display picks the most efficient configuration both
+// support, which it sends as CTRL_CONFIGURE. A display that remembers the
+// configuration agreed with these exact caps (CAPS_ID) sends it straight
+// away on reconnect and skips the HELLO.
+//
+// A sim of another PROTOCOL_VERSION still sends CMD_CAPS, whose first
+// byte is VERSION in every version, then acks the HELLO with
+// ACK_BAD_VERSION; both ends then stay on the boot configuration.
+//
+// CMD_CAPS payload: VERSION (u8) | FEATURES (u16) | MAX_BAUD (u32) |
+// COUNT (u8) | COUNT x (CMD (u8) | MIN_PERIOD_MS (u16))
+// CTRL_CONFIGURE args: CAPS_ID (u16) | FRAMING (u8) | FEATURES (u16)
+enum : uint16_t {
+    FEAT_CRC        = 1u << 0,
+    FEAT_COBS       = 1u << 1,
+    FEAT_DELTA      = 1u << 2,
+    FEAT_SUPERFRAME = 1u << 3,
+    FEAT_SAMPLES    = 1u << 4,
+    FEAT_TRACE      = 1u << 5,
+    FEAT_LOAD       = 1u << 6,
+    FEAT_MSG_FRAG   = 1u << 7,
+    FEAT_RX_STATS   = 1u << 8,
+};
+#define FEAT_FRAMING (FEAT_CRC | FEAT_COBS)
+
+#define CAPS_MAX_LIMITS     8
+#define CAPS_HEADER_LEN     8
+#define CONFIGURE_ARGS_LEN  5
+
+// ================= LINK LOSS =================
+// Whoever hears nothing valid for LINK_TIMEOUT_MS goes back to the boot
+// configuration and BAUD_BASE. Once configured, the display keeps the
+// sim's timer fed with whatever it sends up, and a CTRL_PING when nothing
+// went up for BAUD_KEEPALIVE_MS.
+#define LINK_TIMEOUT_MS 1000
+
+// ================= BAUD RATE =================
+// Once configured, the display asks for the fastest rate in baud_rates[]
+// (up to the sim's MAX_BAUD) with CTRL_SET_BAUD, probes it with
+// CTRL_PROBE and keeps it if the burst came through clean. A failed
+// switch ends in a link timeout on the sim, which brings both ends back
+// to BAUD_BASE.
+#define BAUD_BASE            115200
+#define BAUD_KEEPALIVE_MS    250
+
+static const uint32_t baud_rates[] = { 3000000, 2000000, 921600 };   // Fastest first
+#define BAUD_RATE_COUNT (sizeof(baud_rates) / sizeof(baud_rates[0]))
+
+static inline bool baud_supported(uint32_t baud)
+{
+    if (baud == BAUD_BASE) return true;
+    for (size_t i = 0; i < BAUD_RATE_COUNT; i++) {
+        if (baud_rates[i] == baud) return true;
+    }
+    return false;
+}
+
+// CMD_PROBE payload: INDEX (u8) | PROBE_LEN - 1 pattern bytes derived from
+// INDEX. The patterns mix 0x00/0xFF runs, alternating bits and SYNC-like
+// bytes, which is where marginal baud rates tend to slip.
+#define PROBE_LEN       32
+#define PROBE_MAX_COUNT 64
+
+// ================= TRACE MODE =================
+// With CMD_TRACE_FLAG set in CMD, the payload is prefixed with
+// SEQ (u16, counted per command) | TX_US (u32, sender's micros() when the
+// frame was queued for transmission). Receivers strip the prefix and
+// decode the rest as the plain command.
+#define CMD_TRACE_FLAG   0x80
+#define TRACE_HEADER_LEN 6
+
+// ================= BUS ADDRESSING =================
+// Several displays can share one sim over an RS-485 style bus: the sim's
+// TX reaches every display, the displays share one return line. Every
+// frame then has CMD_ADDR_FLAG set in CMD and one ADDR byte ahead of the
+// payload (and ahead of the trace prefix):
+//   sim -> display  destination node, or ADDR_BROADCAST
+//   display -> sim  source node
+// Display nodes are 1..BUS_MAX_NODES. A display only transmits right
+// after a CMD_POLL addressed to it, and only whole frames that fit in
+// one poll slot, so uplink frames from different nodes never interleave.
+//
+// CTRL_SUBSCRIBE sets the command groups a node renders. The sim skips
+// groups no live node subscribed to and each display drops groups it
+// did not ask for before decoding. GROUP_LINK always gets through.
+#define CMD_ADDR_FLAG  0x40
+#define ADDR_LEN       1
+#define ADDR_NONE      0x00   // Point-to-point link: no address byte
+#define ADDR_BROADCAST 0xFF
+#define BUS_MAX_NODES  8
+
+enum : uint8_t {
+    GROUP_FAST      = 1u << 0,   // CMD_FAST, CMD_SAMPLES (and CMD_DELTA)
+    GROUP_AWARENESS = 1u << 1,   // CMD_AWARENESS (and CMD_DELTA)
+    GROUP_GRAPH     = 1u << 2,   // CMD_GRAPH
+    GROUP_STATUS    = 1u << 3,   // CMD_HEARTBEAT, CMD_LAP_EVENT, messages
+    GROUP_LINK      = 1u << 7,   // Acks, caps, polls, probes, superframes
+};
+#define GROUP_ALL 0xFF
+
+// Groups cmd (without flags) belongs to; it is wanted if any is subscribed
+uint8_t command_groups(uint8_t cmd);
+
+// ================= CRC-16 =================
+#define CRC16_INIT 0xFFFF
+
+uint16_t crc16_update(uint16_t crc, uint8_t b);
+uint16_t crc16(const uint8_t *buf, size_t len, uint16_t crc = CRC16_INIT);
+
+// ================= COBS =================
+// Encoded size is at most len + len / 254 + 1, excluding the delimiter.
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+// Decodes in place; returns the decoded length or 0 if buf is malformed.
+size_t cobs_decode_in_place(uint8_t *buf, size_t len);
+
+// ================= ENCODER =================
+// Bytes on the wire for a payload of len bytes (worst case for COBS)
+static inline size_t frame_size(uint8_t len, Framing framing)
+{
+    switch (framing) {
+        case FRAMING_CRC:  return FRAME_HEADER_LEN + len + FRAME_CRC_LEN;
+        case FRAMING_COBS: return 1 + len + FRAME_CRC_LEN + 1 + 1;
+        default:           return FRAME_HEADER_LEN + len;
+    }
+}
+
+// Serialises one frame into out (frame_size() bytes), returns bytes used
+size_t frame_encode(uint8_t *out, uint8_t cmd, const uint8_t *payload,
+                    uint8_t len, Framing framing);
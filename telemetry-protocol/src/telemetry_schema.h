@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ================= TELEMETRY SCHEMA =================
+// Single source of truth for every telemetry field and the fixed-layout
+// commands that carry them. DisplayData, the FIELD_* masks, payload
+// lengths, encoders and decoders are all generated from the two tables
+// below; add a signal here and both firmwares pick it up.
+//
+// Multi-byte fields go on the wire little-endian, i.e. exactly as they
+// sit in memory on the ESP32 and on x86/ARM Linux hosts.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "telemetry wire format assumes a little-endian target"
+#endif
+
+// X(ID, name, type). Payloads carry fields in this order.
+#define TELEMETRY_FIELDS(X)                                                   \
+    X(RPMS,            rpms,            uint16_t) /* 0 to 999              */ \
+    X(VELOCITY,        velocity,        float)    /* 0 to 99.9             */ \
+    X(LAPS,            laps,            uint8_t)  /* Lap counter           */ \
+    X(CONSUMPTION,     consumption,     float)    /* Wh this attempt       */ \
+    X(EFFICIENCY,      efficiency,      float)    /* km/kWh this attempt   */ \
+    X(BATTERY_VOLTAGE, battery_voltage, float)    /* 21.0 to 25.2 Volts    */ \
+    X(CURRENT_AMPS,    current_amps,    float)    /* 0.0 to 45.0 Amps      */ \
+    X(TX_MESSAGE,      tx_message,      uint8_t)  /* Message (0-2)         */
+
+// X(CMD, id, period_ms, fields)
+#define TELEMETRY_COMMANDS(X)                                                        \
+    X(CMD_FAST,      0x01, 10,   FIELD_RPMS | FIELD_VELOCITY)                        \
+    X(CMD_AWARENESS, 0x02, 100,  FIELD_LAPS | FIELD_CONSUMPTION | FIELD_EFFICIENCY)  \
+    X(CMD_GRAPH,     0x03, 1000, FIELD_BATTERY_VOLTAGE | FIELD_CURRENT_AMPS)         \
+    X(CMD_HEARTBEAT, 0x04, 200,  FIELD_TX_MESSAGE)
+
+// ================= GENERATED: DATA =================
+typedef struct {
+#define X(ID, name, type) type name;
+    TELEMETRY_FIELDS(X)
+#undef X
+} DisplayData;
+
+enum {
+#define X(ID, name, type) FIELD_ID_##ID,
+    TELEMETRY_FIELDS(X)
+#undef X
+    FIELD_COUNT
+};
+
+enum : uint32_t {
+#define X(ID, name, type) FIELD_##ID = 1u << FIELD_ID_##ID,
+    TELEMETRY_FIELDS(X)
+#undef X
+};
+#define FIELD_ALL ((1u << FIELD_COUNT) - 1)
+
+static_assert(FIELD_COUNT <= 8, "CMD_DELTA carries a one byte field mask");
+
+typedef struct {
+    uint8_t offset;   // Into DisplayData
+    uint8_t size;     // On the wire and in memory
+} FieldDesc;
+
+static constexpr FieldDesc telemetry_fields[FIELD_COUNT] = {
+#define X(ID, name, type) { offsetof(DisplayData, name), sizeof(type) },
+    TELEMETRY_FIELDS(X)
+#undef X
+};
+
+// Payload bytes for the fields in mask
+constexpr uint8_t fields_len(uint32_t mask)
+{
+    uint8_t len = 0;
+    for (unsigned i = 0; i < FIELD_COUNT; i++) {
+        if (mask & (1u << i)) len += telemetry_fields[i].size;
+    }
+    return len;
+}
+
+// ================= GENERATED: COMMANDS =================
+enum : uint8_t {
+#define X(CMD, id, period, fields) CMD = id,
+    TELEMETRY_COMMANDS(X)
+#undef X
+};
+
+#define X(CMD, id, period, fields)                                   \
+    static constexpr uint32_t CMD##_FIELDS    = (fields);            \
+    static constexpr uint8_t  CMD##_LEN       = fields_len(fields);  \
+    static constexpr uint32_t CMD##_PERIOD_MS = (period);
+TELEMETRY_COMMANDS(X)
+#undef X
+
+// ================= GENERATED: PACK / UNPACK =================
+// Compile-time unrolled per mask: each field becomes a fixed-size copy.
+template <uint32_t MASK, unsigned I = 0>
+static inline uint8_t *pack_fields(const DisplayData *d, uint8_t *out)
+{
+    if constexpr (I == FIELD_COUNT) {
+        return out;
+    } else if constexpr (!(MASK & (1u << I))) {
+        return pack_fields<MASK, I + 1>(d, out);
+    } else {
+        constexpr FieldDesc f = telemetry_fields[I];
+        memcpy(out, (const uint8_t *)d + f.offset, f.size);
+        return pack_fields<MASK, I + 1>(d, out + f.size);
+    }
+}
+
+// Returns the mask of fields whose value actually changed
+template <uint32_t MASK, unsigned I = 0>
+static inline uint32_t unpack_fields(DisplayData *d, const uint8_t *in)
+{
+    if constexpr (I == FIELD_COUNT) {
+        return 0;
+    } else if constexpr (!(MASK & (1u << I))) {
+        return unpack_fields<MASK, I + 1>(d, in);
+    } else {
+        constexpr FieldDesc f = telemetry_fields[I];
+        uint8_t *dst = (uint8_t *)d + f.offset;
+        uint32_t changed = 0;
+        if (memcmp(dst, in, f.size) != 0) {
+            memcpy(dst, in, f.size);
+            changed = 1u << I;
+        }
+        return changed | unpack_fields<MASK, I + 1>(d, in + f.size);
+    }
+}
+
+// ================= MESSAGES =================
+// Values of tx_message; CMD_MESSAGE text is at most MAX_CUSTOM_MSG_LEN
+#define MAX_CUSTOM_MSG_LEN 32
+
+typedef enum {
+  IDLE_MSG,
+  RESET_MSG,
+  CUSTOM_MSG,
+} Message;
@@ -0,0 +1,48 @@
+#pragma once
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "esp_partition.h"
+#include "trace_replay.h"
+
+// ================= TRACE PARTITION =================
+// A trace written raw into a data partition of the flash, e.g. with
+//   parttool.py write_partition --partition-name trace --input run.bin
+// The partition table needs an entry for it (type data, any subtype).
+// Reads stop at the end of the partition; the erased space behind a
+// shorter trace ends it on its own (see trace_replay.h).
+
+class PartitionTraceSource : public TraceSource
+{
+public:
+    explicit PartitionTraceSource(const char *label)
+        : _label(label), _part(NULL), _offset(0) {}
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        if (!_part || _offset >= _part->size) return 0;
+        if (len > _part->size - _offset) len = _part->size - _offset;
+        if (esp_partition_read(_part, _offset, buf, len) != ESP_OK) return 0;
+        _offset += len;
+        return len;
+    }
+
+    // Looks the partition up on first use, so a global can be declared
+    // before the flash is up
+    bool rewind() override
+    {
+        if (!_part) {
+            _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                             ESP_PARTITION_SUBTYPE_ANY, _label);
+        }
+        _offset = 0;
+        return _part != NULL;
+    }
+
+private:
+    const char *_label;
+    const esp_partition_t *_part;
+    size_t _offset;
+};
+
+#endif
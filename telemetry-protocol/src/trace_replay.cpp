@@ -0,0 +1,310 @@
+#include "trace_replay.h"
+#include <string.h>
+#include <stdlib.h>
+#include <type_traits>
+
+typedef struct {
+    const char *name;
+    bool is_float;
+} TraceColumn;
+
+static const TraceColumn trace_columns[FIELD_COUNT] = {
+#define X(ID, name, type) { #name, std::is_floating_point<type>::value },
+    TELEMETRY_FIELDS(X)
+#undef X
+};
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint8_t trace_record_encode(uint32_t t_ms, const DisplayData *d, uint8_t mask, uint8_t *out)
+{
+    out[0] = telemetry_encode_delta(d, mask, out + TRACE_RECORD_HEADER_LEN);
+    put_u32(out + 1, t_ms);
+    return TRACE_RECORD_HEADER_LEN + out[0];
+}
+
+// ===== READER =====
+TraceReader::TraceReader(TraceSource &src) : _src(src)
+{
+    reset();
+}
+
+bool TraceReader::restart()
+{
+    reset();
+    return _src.rewind();
+}
+
+void TraceReader::reset()
+{
+    _fill_idx = 0;
+    _len[0] = _len[1] = 0;
+    _full[0] = false;
+    _full[1] = false;
+    _eof = false;
+    _read_idx = 0;
+    _pos = 0;
+    _format = FORMAT_UNKNOWN;
+    _finished = false;
+    _header = true;
+    _overlong = false;
+    _rec_len = 0;
+    _column_count = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool TraceReader::fill()
+{
+    while (!_eof && !_full[_fill_idx]) {
+        size_t n = _src.read(_buf[_fill_idx], TRACE_BLOCK);
+        if (n == 0) {
+            _eof = true;
+            break;
+        }
+        _len[_fill_idx] = n;
+        _full[_fill_idx] = true;   // Publishes the block to the consumer
+        _fill_idx ^= 1;
+    }
+    return !_eof;
+}
+
+void TraceReader::finish()
+{
+    _finished = true;
+    _eof = true;   // Stops the loader reading on (into erased flash, say)
+}
+
+bool TraceReader::next(uint32_t *t_ms, DisplayData *d, uint32_t *fields)
+{
+    while (!_finished) {
+        if (!_full[_read_idx]) {
+            // _eof is only set after the last block was published
+            if (!_eof || _full[_read_idx]) {
+                _stats.underruns++;
+                return false;
+            }
+            // A last CSV line without its newline
+            bool got = _format == FORMAT_CSV && _rec_len && !_overlong &&
+                       !_header && record(t_ms, d, fields);
+            if (got) _stats.records++;
+            finish();
+            return got;
+        }
+        while (_pos < _len[_read_idx]) {
+            if (take(_buf[_read_idx][_pos++], t_ms, d, fields)) {
+                _stats.records++;
+                return true;
+            }
+            if (_finished) return false;
+        }
+        _full[_read_idx] = false;   // Hands the block back to the loader
+        _read_idx ^= 1;
+        _pos = 0;
+    }
+    return false;
+}
+
+bool TraceReader::take(uint8_t b, uint32_t *t_ms, DisplayData *d, uint32_t *fields)
+{
+    if (_rec_len == 0 && b == 0xFF) {
+        finish();
+        return false;
+    }
+
+    if (_format == FORMAT_UNKNOWN) {
+        _rec[_rec_len++] = b;
+        if (memcmp(_rec, TRACE_MAGIC, _rec_len) != 0) {
+            _format = FORMAT_CSV;   // Carry on with the bytes as the header
+        } else if (_rec_len == TRACE_MAGIC_LEN) {
+            _format = FORMAT_BINARY;
+            _rec_len = 0;
+            return false;
+        } else {
+            return false;
+        }
+        _rec_len--;
+    }
+
+    if (_format == FORMAT_BINARY) {
+        _rec[_rec_len++] = b;
+        if (_rec_len == 1 && TRACE_RECORD_HEADER_LEN + _rec[0] > TRACE_LINE_MAX) {
+            _stats.bad++;   // No way to find the next record
+            finish();
+            return false;
+        }
+        if (_rec_len < (size_t)TRACE_RECORD_HEADER_LEN + _rec[0]) return false;
+        return record(t_ms, d, fields);
+    }
+
+    // CSV
+    if (b == '\r') return false;
+    if (b != '\n') {
+        if (_rec_len < TRACE_LINE_MAX) {
+            _rec[_rec_len++] = b;
+        } else {
+            _overlong = true;
+        }
+        return false;
+    }
+    if (_overlong) {
+        _overlong = false;
+        _rec_len = 0;
+        _stats.bad++;
+        return false;
+    }
+    if (_rec_len == 0) return false;
+    if (_header) {
+        parseHeader();
+        _rec_len = 0;
+        return false;
+    }
+    return record(t_ms, d, fields);
+}
+
+// The complete record in _rec
+bool TraceReader::record(uint32_t *t_ms, DisplayData *d, uint32_t *fields)
+{
+    bool ok;
+    if (_format == FORMAT_BINARY) {
+        uint8_t len = _rec[0];
+        uint32_t changed = 0;
+        ok = len > 0 && telemetry_decode(d, CMD_DELTA, _rec + TRACE_RECORD_HEADER_LEN,
+                                         len, &changed);
+        if (ok) {
+            *t_ms = get_u32(_rec + 1);
+            *fields = _rec[TRACE_RECORD_HEADER_LEN] & FIELD_ALL;
+        }
+    } else {
+        ok = parseLine(t_ms, d, fields);
+    }
+    _rec_len = 0;
+    if (!ok) _stats.bad++;
+    return ok;
+}
+
+void TraceReader::parseHeader()
+{
+    _rec[_rec_len] = '\0';
+    bool have_time = false;
+    char *save;
+    for (char *tok = strtok_r((char *)_rec, ",", &save);
+         tok && _column_count < TRACE_COLUMNS; tok = strtok_r(NULL, ",", &save)) {
+        while (*tok == ' ') tok++;
+        size_t n = strlen(tok);
+        while (n && tok[n - 1] == ' ') tok[--n] = '\0';
+
+        int8_t col = -1;
+        if (strcmp(tok, "t_ms") == 0) {
+            col = FIELD_COUNT;
+            have_time = true;
+        }
+        for (unsigned i = 0; i < FIELD_COUNT && col < 0; i++) {
+            if (strcmp(tok, trace_columns[i].name) == 0) col = i;
+        }
+        _columns[_column_count++] = col;
+    }
+    _header = false;
+    if (!have_time) {
+        _stats.bad++;   // Nothing to time the lines by
+        finish();
+    }
+}
+
+bool TraceReader::parseLine(uint32_t *t_ms, DisplayData *d, uint32_t *fields)
+{
+    _rec[_rec_len] = '\0';
+    DisplayData line = *d;   // Applied only if the whole line parses
+    uint32_t seen = 0;
+    bool have_time = false;
+
+    char *p = (char *)_rec;
+    for (uint8_t c = 0; c < _column_count; c++) {
+        char *end;
+        int8_t col = _columns[c];
+        if (col == FIELD_COUNT) {
+            *t_ms = strtoul(p, &end, 10);
+            have_time = end != p;
+        } else if (col >= 0) {
+            const FieldDesc &f = telemetry_fields[col];
+            uint8_t *dst = (uint8_t *)&line + f.offset;
+            if (trace_columns[col].is_float) {
+                float v = strtof(p, &end);
+                memcpy(dst, &v, sizeof(v));
+            } else {
+                long v = strtol(p, &end, 10);
+                long max = (1L << (8 * f.size)) - 1;
+                v = v < 0 ? 0 : v > max ? max : v;
+                if (f.size == 1) {
+                    *dst = (uint8_t)v;
+                } else {
+                    uint16_t v16 = (uint16_t)v;
+                    memcpy(dst, &v16, sizeof(v16));
+                }
+            }
+            // An empty cell leaves the field as it was
+            if (end != p) seen |= 1u << col;
+        } else {
+            end = p;
+        }
+        while (*end == ' ') end++;
+        p = strchr(end, ',');
+        if (!p) break;
+        p++;
+    }
+
+    if (!have_time) return false;
+    telemetry_copy_fields(d, &line, seen);
+    *fields = seen;
+    return true;
+}
+
+// ===== REPLAY =====
+void TraceReplay::start(uint8_t speed, uint32_t now_ms)
+{
+    _speed = speed < 1 ? 1 : speed > TRACE_SPEED_MAX ? TRACE_SPEED_MAX : speed;
+    _start_ms = now_ms;
+    _have_pending = false;
+    _have_first = false;
+    _fields = 0;
+    memset(&_state, 0, sizeof(_state));
+    _active = true;
+}
+
+bool TraceReplay::update(uint32_t now_ms, DisplayData *d)
+{
+    if (!_active) return false;
+
+    uint32_t trace_ms = (now_ms - _start_ms) * _speed;
+    for (;;) {
+        if (!_have_pending) {
+            uint32_t t;
+            _next = _state;
+            if (!_reader.next(&t, &_next, &_next_fields)) {
+                if (!_reader.finished()) break;   // Loader behind, try next time
+                _active = false;
+                break;
+            }
+            if (!_have_first) {
+                _first_t = t;
+                _have_first = true;
+            }
+            _pending_t = t > _first_t ? t - _first_t : 0;
+            _have_pending = true;
+        }
+        if (_pending_t > trace_ms) break;
+        _state = _next;
+        _fields |= _next_fields;
+        _have_pending = false;
+    }
+
+    telemetry_copy_fields(d, &_state, _fields);
+    return _active;
+}
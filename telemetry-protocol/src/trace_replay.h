@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+#include "telemetry_codec.h"
+
+// ================= TRACE REPLAY =================
+// Recorded runs played back through the normal encoder. A trace is a
+// series of timestamped samples in one of two formats, told apart by
+// the first bytes:
+//  - CSV: a header line naming the columns, t_ms
+//    plus any schema field names (rpms, velocity, ...), then one line
+//    per sample. Unknown columns are ignored, fields not in the file
+//    keep their values.
+//  - Binary: TRACE_MAGIC, then per record a length byte, the time (u32
+//    ms, little endian) and a CMD_DELTA payload of that length with the
+//    fields that changed (trace_record_encode()).
+// A 0xFF where a record or line would start ends the trace (neither a
+// length nor text can be one), so one written to a flash partition stops
+// at the erased space behind it.
+//
+// TraceReader is double buffered for two threads: the loader calls
+// fill() to read blocks from the source into whichever buffer is free,
+// the consumer parses the other one in next() and never touches the
+// source. restart() is for the loader while the consumer is stopped, and
+// the first thing to call: the constructor leaves the source alone.
+
+#define TRACE_MAGIC      "TLT1"
+#define TRACE_MAGIC_LEN  4
+#define TRACE_BLOCK      2048   // Bytes per buffer
+#define TRACE_LINE_MAX   160    // Longest CSV line
+#define TRACE_COLUMNS    16     // CSV columns looked at, the rest ignored
+#define TRACE_RECORD_HEADER_LEN 5
+#define TRACE_SPEED_MAX  100
+
+class TraceSource
+{
+public:
+    virtual ~TraceSource() {}
+
+    // Up to len bytes, 0 at the end
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+    // Back to the first byte; false if the source can't (a pipe)
+    virtual bool rewind() = 0;
+};
+
+// A file, or stdin on a host
+class FileTraceSource : public TraceSource
+{
+public:
+    explicit FileTraceSource(FILE *f) : _f(f) {}
+
+    size_t read(uint8_t *buf, size_t len) override { return fread(buf, 1, len, _f); }
+    bool rewind() override { return fseek(_f, 0, SEEK_SET) == 0; }
+
+private:
+    FILE *_f;
+};
+
+typedef struct {
+    uint32_t records;     // Delivered
+    uint32_t bad;         // Lines or records skipped as malformed
+    uint32_t underruns;   // next() found the loader behind
+} TraceStats;
+
+// Binary record for t_ms carrying the fields of d in mask; returns its length
+uint8_t trace_record_encode(uint32_t t_ms, const DisplayData *d, uint8_t mask, uint8_t *out);
+
+class TraceReader
+{
+public:
+    explicit TraceReader(TraceSource &src);
+
+    // Loader side: reads into a free buffer. Returns false once there's
+    // nothing left to read.
+    bool fill();
+    bool restart();
+
+    // Consumer side: the next record's time and fields onto d, the fields
+    // it carries into *fields. False when none is buffered yet, or the
+    // trace has ended (finished()).
+    bool next(uint32_t *t_ms, DisplayData *d, uint32_t *fields);
+    bool finished() const { return _finished; }
+
+    const TraceStats &stats() const { return _stats; }
+
+private:
+    enum { FORMAT_UNKNOWN, FORMAT_CSV, FORMAT_BINARY };
+
+    void reset();
+    bool take(uint8_t b, uint32_t *t_ms, DisplayData *d, uint32_t *fields);
+    bool record(uint32_t *t_ms, DisplayData *d, uint32_t *fields);
+    void parseHeader();
+    bool parseLine(uint32_t *t_ms, DisplayData *d, uint32_t *fields);
+    void finish();
+
+    TraceSource &_src;
+
+    // Loader side
+    uint8_t _fill_idx;
+
+    // Shared
+    uint8_t _buf[2][TRACE_BLOCK];
+    size_t _len[2];
+    std::atomic<bool> _full[2];
+    std::atomic<bool> _eof;
+
+    // Consumer side
+    uint8_t _read_idx;
+    size_t _pos;
+    uint8_t _format;
+    bool _finished;
+    bool _header;                      // CSV header line still to come
+    bool _overlong;                    // Skipping the rest of a CSV line
+    uint8_t _rec[TRACE_LINE_MAX + 1];  // Record or line being assembled
+    size_t _rec_len;
+    int8_t _columns[TRACE_COLUMNS];    // CSV column -> field, -1 skip, FIELD_COUNT t_ms
+    uint8_t _column_count;
+
+    TraceStats _stats;
+};
+
+// Consumer side timing: trace time runs speed times faster than now_ms
+class TraceReplay
+{
+public:
+    explicit TraceReplay(TraceReader &reader) : _reader(reader), _active(false) {}
+
+    // Trace time 0 at now_ms; fields the trace doesn't carry keep their
+    // values in d
+    void start(uint8_t speed, uint32_t now_ms);
+    void stop() { _active = false; }
+    bool active() const { return _active; }
+
+    // Applies every record due by now_ms onto d. Returns false once the
+    // last record has been applied.
+    bool update(uint32_t now_ms, DisplayData *d);
+
+private:
+    TraceReader &_reader;
+    bool _active;
+    bool _have_pending;
+    bool _have_first;
+    uint8_t _speed;
+    uint32_t _start_ms;
+    uint32_t _first_t;       // Trace time of the first record
+    uint32_t _pending_t;     // Since _first_t
+    uint32_t _fields;        // Carried by any record applied so far
+    uint32_t _next_fields;   // Carried by the pending record
+    DisplayData _state;      // Trace fields as of the last record due
+    DisplayData _next;       // ... and with the pending record
+};
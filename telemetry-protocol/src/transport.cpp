@@ -0,0 +1,6 @@
+#include "transport.h"
+
+void transport_writer(const uint8_t *data, size_t len, void *ctx)
+{
+    static_cast<Transport *>(ctx)->write(data, len);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= TRANSPORT =================
+// The byte link between simulator and display. Protocol code only sees
+// this interface, so the same parser and encoders run over the ESP32
+// UART on target and over an in-memory pipe, a pty or a TCP socket on a
+// Linux host.
+//
+//   available()  bytes that read() would return right now
+//   read()       nonblocking: copies up to len waiting bytes, 0 if none
+//   write()      queues the whole span, waiting while the link drains
+//                (like HardwareSerial); returns the bytes accepted
+//   flush()      waits until everything queued has left
+//   setBaud()    drops RX bytes still waiting, which were sent at the old
+//                rate; links without a line rate accept any value
+
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    virtual size_t available() = 0;
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+    virtual size_t write(const uint8_t *data, size_t len) = 0;
+    virtual void flush() {}
+    virtual void setBaud(uint32_t baud) { (void)baud; }
+};
+
+// Adapter for CommandLink and other LinkWriter users; ctx is the Transport
+void transport_writer(const uint8_t *data, size_t len, void *ctx);
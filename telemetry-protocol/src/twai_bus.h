@@ -0,0 +1,96 @@
+#pragma once
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "driver/twai.h"
+#include "can_transport.h"
+
+// ================= TWAI BUS =================
+// The ESP32's built-in CAN controller. Needs an external transceiver
+// (e.g. SN65HVD230) on tx/rx. The acceptance filter is set when the
+// driver is installed, so setFilter() on a running bus reinstalls it.
+// begin() fails for a bitrate without an IDF timing preset (125k to 1M).
+
+#define TWAI_TX_QUEUE 32   // Frames; a 64 byte record is 10 of them
+#define TWAI_RX_QUEUE 64
+
+class TwaiBus : public CanBus
+{
+public:
+    TwaiBus(int tx_pin, int rx_pin, uint32_t bitrate = 1000000)
+        : _tx(tx_pin), _rx(rx_pin), _bitrate(bitrate), _running(false),
+          _filter(TWAI_FILTER_CONFIG_ACCEPT_ALL()) {}
+
+    bool begin()
+    {
+        twai_general_config_t g = TWAI_GENERAL_CONFIG_DEFAULT(
+            (gpio_num_t)_tx, (gpio_num_t)_rx, TWAI_MODE_NORMAL);
+        g.tx_queue_len = TWAI_TX_QUEUE;
+        g.rx_queue_len = TWAI_RX_QUEUE;
+
+        twai_timing_config_t t;
+        switch (_bitrate) {
+            case 1000000: t = TWAI_TIMING_CONFIG_1MBITS();   break;
+            case 800000:  t = TWAI_TIMING_CONFIG_800KBITS(); break;
+            case 500000:  t = TWAI_TIMING_CONFIG_500KBITS(); break;
+            case 250000:  t = TWAI_TIMING_CONFIG_250KBITS(); break;
+            case 125000:  t = TWAI_TIMING_CONFIG_125KBITS(); break;
+            default:
+                return false;   // Any other rate would not talk to the bus
+        }
+
+        _running = twai_driver_install(&g, &t, &_filter) == ESP_OK &&
+                   twai_start() == ESP_OK;
+        return _running;
+    }
+
+    void end()
+    {
+        if (!_running) return;
+        twai_stop();
+        twai_driver_uninstall();
+        _running = false;
+    }
+
+    bool send(const CanFrame &f) override
+    {
+        twai_message_t m = {};
+        m.identifier = f.id;
+        m.data_length_code = f.len;
+        memcpy(m.data, f.data, f.len);
+        return twai_transmit(&m, 0) == ESP_OK;
+    }
+
+    bool receive(CanFrame &f) override
+    {
+        twai_message_t m;
+        if (twai_receive(&m, 0) != ESP_OK) return false;
+        if (m.extd || m.rtr) return false;
+        f.id = m.identifier;
+        f.len = m.data_length_code > CAN_DATA_LEN ? CAN_DATA_LEN : m.data_length_code;
+        memcpy(f.data, m.data, f.len);
+        return true;
+    }
+
+    // Single filter on the 11 bit ID, left aligned; data bytes don't care
+    void setFilter(const uint32_t *ids, size_t count) override
+    {
+        uint32_t code, mask;
+        can_acceptance(ids, ids ? count : 0, &code, &mask);
+        _filter.acceptance_code = code << 21;
+        _filter.acceptance_mask = mask << 21 | 0x1FFFFF;
+        _filter.single_filter = true;
+        if (_running) {
+            end();
+            begin();
+        }
+    }
+
+private:
+    int _tx;
+    int _rx;
+    uint32_t _bitrate;
+    bool _running;
+    twai_filter_config_t _filter;
+};
+#endif
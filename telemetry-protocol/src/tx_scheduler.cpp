@@ -0,0 +1,145 @@
+#include "tx_scheduler.h"
+#include <string.h>
+
+static void clear_stats(TxTaskStats &s)
+{
+    memset(&s, 0, sizeof(s));
+    s.interval_min_us = UINT32_MAX;
+}
+
+TxScheduler::TxScheduler(uint32_t bytes_per_sec)
+    : _count(0), _bytes_per_sec(bytes_per_sec), _drained_us(0), _drained(true)
+{
+    memset(_tasks, 0, sizeof(_tasks));
+}
+
+uint8_t TxScheduler::add(uint32_t period_us, uint32_t first_due_us, bool budgeted)
+{
+    if (_count >= TX_MAX_TASKS) return TX_NO_TASK;
+    Task &t = _tasks[_count];
+    t.period_us = period_us;
+    t.due_us = first_due_us;
+    t.ran = false;
+    t.budgeted = budgeted;
+    t.held = false;
+    clear_stats(t.stats);
+    return _count++;
+}
+
+void TxScheduler::setPeriod(uint8_t task, uint32_t period_us)
+{
+    Task &t = _tasks[task];
+    if (t.period_us == period_us) return;
+    t.period_us = period_us;
+    t.ran = false;   // An interval spanning the change isn't jitter
+}
+
+void TxScheduler::restart(uint8_t task, uint32_t now_us)
+{
+    _tasks[task].due_us = now_us;
+    _tasks[task].ran = false;
+    _tasks[task].held = false;
+}
+
+void TxScheduler::setByteRate(uint32_t bytes_per_sec)
+{
+    _bytes_per_sec = bytes_per_sec;
+}
+
+void TxScheduler::charge(size_t bytes, uint32_t now_us)
+{
+    if (!_bytes_per_sec) return;
+    uint32_t start = !_drained && (int32_t)(_drained_us - now_us) > 0 ? _drained_us : now_us;
+    _drained_us = start + (uint32_t)((uint64_t)bytes * 1000000 / _bytes_per_sec);
+    _drained = false;
+}
+
+uint32_t TxScheduler::backlogBytes(uint32_t now_us) const
+{
+    int32_t left_us = (int32_t)(_drained_us - now_us);
+    if (!_bytes_per_sec || _drained || left_us <= 0) return 0;
+    return (uint32_t)((uint64_t)left_us * _bytes_per_sec / 1000000);
+}
+
+// Until the backlog is down to TX_BACKLOG_BYTES
+uint32_t TxScheduler::budgetWaitUs(uint32_t now_us) const
+{
+    int32_t left_us = (int32_t)(_drained_us - now_us);
+    if (!_bytes_per_sec || _drained || left_us <= 0) return 0;
+    uint32_t allowed_us = (uint32_t)((uint64_t)TX_BACKLOG_BYTES * 1000000 / _bytes_per_sec);
+    return (uint32_t)left_us > allowed_us ? (uint32_t)left_us - allowed_us : 0;
+}
+
+int TxScheduler::next(uint32_t now_us, uint32_t *due_us)
+{
+    // Before _drained_us gets half the clock range behind and looks ahead
+    if ((int32_t)(_drained_us - now_us) <= 0) _drained = true;
+
+    bool held = budgetWaitUs(now_us) > 0;
+    int best = -1;
+    int32_t best_deadline = 0;   // Relative to now_us
+    for (uint8_t i = 0; i < _count; i++) {
+        Task &t = _tasks[i];
+        if (!t.period_us || (int32_t)(now_us - t.due_us) < 0) continue;
+        if (held && t.budgeted) {
+            if (!t.held) t.stats.deferred++;   // Once, however often it is asked
+            t.held = true;
+            continue;
+        }
+        int32_t deadline = (int32_t)(t.due_us + t.period_us - now_us);
+        if (best < 0 || deadline < best_deadline) {
+            best = i;
+            best_deadline = deadline;
+        }
+    }
+    if (best < 0) return -1;
+
+    Task &t = _tasks[best];
+    if (due_us) *due_us = t.due_us;
+    uint32_t late = now_us - t.due_us;
+    if (late > t.stats.late_max_us) t.stats.late_max_us = late;
+    if (t.ran) {
+        uint32_t interval = now_us - t.last_run_us;
+        if (interval < t.stats.interval_min_us) t.stats.interval_min_us = interval;
+        if (interval > t.stats.interval_max_us) t.stats.interval_max_us = interval;
+    }
+    t.stats.runs++;
+    t.last_run_us = now_us;
+    t.ran = true;
+    t.held = false;
+
+    // Next release on the original grid, past any that were missed
+    uint32_t missed = late / t.period_us;
+    t.stats.skipped += missed;
+    t.due_us += (missed + 1) * t.period_us;
+    return best;
+}
+
+uint32_t TxScheduler::idleUs(uint32_t now_us) const
+{
+    uint32_t budget_wait = budgetWaitUs(now_us);
+    uint32_t wait = UINT32_MAX;
+    for (uint8_t i = 0; i < _count; i++) {
+        const Task &t = _tasks[i];
+        if (!t.period_us) continue;
+        int32_t until = (int32_t)(t.due_us - now_us);
+        uint32_t w = until > 0 ? (uint32_t)until : 0;
+        if (t.budgeted && w < budget_wait) w = budget_wait;
+        if (w < wait) wait = w;
+    }
+    return wait;
+}
+
+uint32_t TxScheduler::jitterUs(uint8_t task) const
+{
+    const TxTaskStats &s = _tasks[task].stats;
+    return s.interval_max_us >= s.interval_min_us ? s.interval_max_us - s.interval_min_us : 0;
+}
+
+void TxScheduler::resetStats()
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        clear_stats(_tasks[i].stats);
+        _tasks[i].ran = false;
+    }
+}
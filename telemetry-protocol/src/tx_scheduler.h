@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= TX SCHEDULER =================
+// Earliest-deadline-first release of the sender's periodic tasks, on a
+// microsecond clock the caller passes in, so it runs the same against
+// micros() on the ESP32 and a virtual clock on a host. idleUs() says how
+// long the caller may sleep, e.g. to arm a one-shot hardware timer.
+//
+// A task is due at its release time and has until the next release, its
+// deadline, to go out. next() hands out due tasks in deadline order, so
+// when several fall due together the shortest period goes first rather
+// than whichever the caller happens to test first.
+//
+// The link is modelled as a byte queue draining at bytes_per_sec: every
+// byte written is charge()d to it, and while more than TX_BACKLOG_BYTES
+// are still queued next() holds all tasks back. Frames then wait here,
+// where deadline order still applies, instead of in the UART FIFO.
+// Tasks added as not budgeted (sampling, say) are released regardless.
+//
+// Per task it records how late each release was and the shortest and
+// longest interval between runs; their spread is the period jitter.
+// A task that falls a whole period behind skips the missed releases
+// instead of bursting to catch up.
+
+#define TX_MAX_TASKS     12
+#define TX_NO_TASK       0xFF  // add() with all TX_MAX_TASKS in use
+#define TX_BACKLOG_BYTES 128   // About one UART hardware FIFO
+
+typedef struct {
+    uint32_t runs;
+    uint32_t deferred;          // Releases held back by the budget
+    uint32_t skipped;           // Releases missed entirely
+    uint32_t late_max_us;       // Release to run
+    uint32_t interval_min_us;   // Between consecutive runs
+    uint32_t interval_max_us;
+} TxTaskStats;
+
+class TxScheduler
+{
+public:
+    explicit TxScheduler(uint32_t bytes_per_sec = 0);   // 0: no byte budget
+
+    // Returns the task number, 0 up in the order added, or TX_NO_TASK
+    // when the table is full. Equal deadlines go to the task added first.
+    uint8_t add(uint32_t period_us, uint32_t first_due_us, bool budgeted = true);
+    // Takes effect from the task's next release; 0 stops it
+    void setPeriod(uint8_t task, uint32_t period_us);
+    void restart(uint8_t task, uint32_t now_us);   // Next due at now_us
+    void setByteRate(uint32_t bytes_per_sec);
+
+    // Most urgent task due at now_us, which counts as run, or -1 when
+    // none is due or the link backlog holds them. *due_us gets the
+    // release it ran for.
+    int next(uint32_t now_us, uint32_t *due_us = NULL);
+    // Time until next() can return a task, 0 if it can now
+    uint32_t idleUs(uint32_t now_us) const;
+
+    void charge(size_t bytes, uint32_t now_us);
+    uint32_t backlogBytes(uint32_t now_us) const;
+
+    const TxTaskStats &stats(uint8_t task) const { return _tasks[task].stats; }
+    uint32_t jitterUs(uint8_t task) const;
+    void resetStats();
+
+private:
+    uint32_t budgetWaitUs(uint32_t now_us) const;
+
+    struct Task {
+        uint32_t period_us;
+        uint32_t due_us;
+        uint32_t last_run_us;
+        bool ran;                // last_run_us valid for an interval
+        bool budgeted;
+        bool held;               // This release already counted as deferred
+        TxTaskStats stats;
+    };
+
+    Task _tasks[TX_MAX_TASKS];
+    uint8_t _count;
+    uint32_t _bytes_per_sec;
+    uint32_t _drained_us;        // When the link empties, given what was charged
+    bool _drained;               // ... which has passed; _drained_us is stale
+};
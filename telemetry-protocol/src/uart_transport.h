@@ -0,0 +1,44 @@
+#pragma once
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "transport.h"
+
+// ================= UART TRANSPORT =================
+// ESP32 HardwareSerial. The caller still does begin() (pins, RX buffer
+// size), this only moves bytes and changes the rate.
+
+class UartTransport : public Transport
+{
+public:
+    explicit UartTransport(HardwareSerial &port) : _port(port) {}
+
+    size_t available() override { return _port.available(); }
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        size_t avail = _port.available();
+        if (len > avail) len = avail;
+        return len ? _port.readBytes(buf, len) : 0;
+    }
+
+    size_t write(const uint8_t *data, size_t len) override
+    {
+        return _port.write(data, len);
+    }
+
+    void flush() override { _port.flush(); }
+
+    // Drains the TX FIFO first so nothing queued goes out at the new rate,
+    // then drops what arrived at the old one
+    void setBaud(uint32_t baud) override
+    {
+        _port.flush();
+        _port.updateBaudRate(baud);
+        while (_port.available()) _port.read();
+    }
+
+private:
+    HardwareSerial &_port;
+};
+#endif
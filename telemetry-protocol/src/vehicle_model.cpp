@@ -0,0 +1,82 @@
+#include "vehicle_model.h"
+#include <math.h>
+
+#define AIR_DENSITY 1.2f
+#define GRAVITY     9.81f
+#define MIN_SPEED   1.0f     // m/s; power limit at a standstill is taken here
+
+VehicleModel::VehicleModel(const VehicleParams &p)
+    : _p(p), _v(0), _soc(1.0f), _current(0), _voltage(p.pack_full_v),
+      _trip_wh(0), _trip_km(0)
+{
+}
+
+void VehicleModel::resetTrip()
+{
+    _trip_wh = 0;
+    _trip_km = 0;
+}
+
+// Smaller root of R*I^2 - Voc*I + P = 0; past the pack's maximum power
+// (Voc^2 / 4R) the current where it peaks
+float VehicleModel::packCurrent(float power_w, float voc) const
+{
+    float r = _p.internal_r_ohm;
+    float disc = voc * voc - 4.0f * r * power_w;
+    if (disc < 0) disc = 0;
+    return (voc - sqrtf(disc)) / (2.0f * r);
+}
+
+void VehicleModel::step(float target_kmh, float dt_s)
+{
+    float target = target_kmh / 3.6f;
+    float voc = _p.pack_empty_v + (_p.pack_full_v - _p.pack_empty_v) * _soc;
+
+    float accel = (target - _v) / (_p.accel_tau_s > dt_s ? _p.accel_tau_s : dt_s);
+    if (accel < -_p.brake_mps2) accel = -_p.brake_mps2;
+
+    float resist = 0.5f * AIR_DENSITY * _p.cda_m2 * _v * _v +
+                   (_v > 0 ? _p.crr * _p.mass_kg * GRAVITY : 0);
+
+    // Current limit: cap the wheel force at what max_current_a delivers
+    float i_max = _p.max_current_a;
+    float max_wheel_w = ((voc - i_max * _p.internal_r_ohm) * i_max - _p.aux_w) * _p.drivetrain_eff;
+    float max_force = max_wheel_w / (_v > MIN_SPEED ? _v : MIN_SPEED);
+    if (_p.mass_kg * accel + resist > max_force) {
+        accel = (max_force - resist) / _p.mass_kg;
+    }
+
+    float force = _p.mass_kg * accel + resist;
+    float wheel_w = force > 0 ? force * _v : 0;   // Braking is mechanical
+    float power = wheel_w / _p.drivetrain_eff + _p.aux_w;
+
+    _current = packCurrent(power, voc);
+    _voltage = voc - _current * _p.internal_r_ohm;
+
+    float wh = power * dt_s / 3600.0f;
+    _soc -= wh / _p.capacity_wh;
+    if (_soc < 0) _soc = 0;
+    _trip_wh += wh;
+
+    _v += accel * dt_s;
+    if (_v < 0) _v = 0;
+    _trip_km += _v * dt_s / 1000.0f;
+}
+
+static float quantize(float x, float step)
+{
+    return roundf(x / step) * step;
+}
+
+// At the resolution the car's sensors report, so a value only changes
+// when a real reading would
+void VehicleModel::telemetry(DisplayData *d) const
+{
+    float kmh = quantize(velocityKmh(), 0.1f);
+    d->velocity        = kmh;
+    d->rpms            = (uint16_t)(kmh * _p.rpm_scale / _p.wheel_r_m);
+    d->battery_voltage = quantize(_voltage, 0.01f);
+    d->current_amps    = quantize(_current, 0.01f);
+    d->consumption     = quantize(_trip_wh, 0.01f);
+    d->efficiency      = _trip_wh > 0 ? quantize(_trip_km / (_trip_wh / 1000.0f), 0.01f) : 0;
+}
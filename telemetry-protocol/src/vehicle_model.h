@@ -0,0 +1,73 @@
+#pragma once
+
+#include "telemetry_schema.h"
+
+// ================= VEHICLE MODEL =================
+// Point-mass longitudinal model of the car and its battery pack, so the
+// simulator's streams move together the way real ones do. Plain C++ with
+// no Arduino calls: the sim steps it from its sample task, a host tool
+// can step it as fast as it likes to generate telemetry in bulk.
+//
+// Each step the car chases the throttle's target speed with time
+// constant accel_tau_s. The force that takes is drag, rolling resistance
+// and m*a at the wheels, drawn from the pack through the drivetrain
+// efficiency plus a constant auxiliary load, with no regeneration.
+// When the pack current would pass max_current_a the acceleration is
+// cut back to what that current can give.
+//
+// The pack is an open circuit voltage falling linearly with state of
+// charge behind internal_r_ohm: the current for a power P solves
+// P = (Voc - I*R) * I and the terminal voltage sags by I*R. Consumption
+// (Wh) and efficiency (km/kWh) come from energy and distance integrated
+// since the last resetTrip().
+
+typedef struct {
+    float mass_kg;
+    float cda_m2;            // Drag coefficient times frontal area
+    float crr;               // Rolling resistance coefficient
+    float drivetrain_eff;
+    float aux_w;             // Electronics, always drawn
+    float accel_tau_s;       // Driver closing in on the throttle speed
+    float brake_mps2;        // Hardest deceleration
+    float max_current_a;     // Motor controller limit
+    float pack_full_v;       // Open circuit voltage at 100 % and 0 %
+    float pack_empty_v;
+    float capacity_wh;
+    float internal_r_ohm;
+    float wheel_r_m;         // rpm = km/h * rpm_scale / wheel_r_m
+    float rpm_scale;
+} VehicleParams;
+
+// A light single-seater on a 6S pack: ~7 A at 50 km/h
+#define VEHICLE_DEFAULTS { 120.0f, 0.06f, 0.003f, 0.88f, 6.0f, 2.0f, 3.0f, 45.0f, \
+                           25.2f, 21.0f, 500.0f, 0.05f, 0.5f, 2.65f }
+
+class VehicleModel
+{
+public:
+    explicit VehicleModel(const VehicleParams &p);
+
+    // Advances dt_s seconds with the throttle asking for target_kmh
+    void step(float target_kmh, float dt_s);
+    void resetTrip();            // Zero consumption and distance
+
+    float velocityKmh() const { return _v * 3.6f; }
+    float currentA() const { return _current; }
+    float voltageV() const { return _voltage; }
+    float soc() const { return _soc; }
+
+    // Every schema field the model owns: rpms, velocity, consumption,
+    // efficiency, battery_voltage and current_amps
+    void telemetry(DisplayData *d) const;
+
+private:
+    float packCurrent(float power_w, float voc) const;
+
+    VehicleParams _p;
+    float _v;                    // m/s
+    float _soc;                  // 0..1
+    float _current;
+    float _voltage;
+    float _trip_wh;
+    float _trip_km;
+};
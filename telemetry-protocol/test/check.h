@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// ================= CHECKS =================
+// Minimal assertions for the host tests: a failed CHECK prints where and
+// what, and the test exits nonzero so ctest reports it.
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        long long _a = (long long)(a), _b = (long long)(b);             \
+        if (_a != _b) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
@@ -0,0 +1,279 @@
+// BaudNegotiator against a scripted sim over a real pty pair, on a
+// virtual millisecond clock. The pty carries bytes at any rate, so the
+// line is modelled at the writer: bytes sent while the two ends disagree
+// on the rate, or at a rate the "cable" can't carry, arrive garbled.
+// The sim streams CMD_FAST every tick, so there are always bytes in
+// flight across a switch, as on the real link.
+
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include "baud_negotiator.h"
+#include "check.h"
+#include "frame_parser.h"
+#include "host_transport.h"
+#include "telemetry_codec.h"
+
+static PtyTransport display_pty, sim_pty;
+
+typedef struct {
+    uint32_t display_baud;
+    uint32_t sim_baud;
+    uint32_t broken_baud;    // Garbles everything at this rate
+    uint32_t reject_baud;    // The sim refuses to switch to this one
+} Line;
+
+static Line line;
+static uint32_t noise = 1;
+
+// What a receiver clocked at the wrong rate makes of a byte: noise, with
+// plenty of false SYNCs in it
+static uint8_t garble()
+{
+    noise ^= noise << 13;
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    return (noise & 0x100) ? SYNC_BYTE : (uint8_t)noise;
+}
+
+static void lineWrite(PtyTransport &from, uint32_t from_baud, uint32_t to_baud,
+                      const uint8_t *data, size_t len)
+{
+    uint8_t buf[FRAME_MAX_WIRE * PROBE_MAX_COUNT];
+    CHECK(len <= sizeof(buf));
+    memcpy(buf, data, len);
+    if (from_baud != to_baud || from_baud == line.broken_baud) {
+        for (size_t i = 0; i < len; i++) buf[i] = garble();
+    }
+    CHECK_EQ(from.write(buf, len), len);
+}
+
+// Reads what the peer wrote this tick; a pty hands bytes over through a
+// kernel worker, so give it a moment when some are expected
+static size_t readLine(PtyTransport &pty, uint8_t *buf, size_t len, bool expect)
+{
+    if (expect) {
+        struct pollfd p = { pty.fd(), POLLIN, 0 };
+        poll(&p, 1, 20);
+    }
+    return pty.read(buf, len);
+}
+
+// ===== SIM =====
+static bool sim_wrote, display_wrote;
+static uint32_t sim_last_rx_ms;
+static uint32_t sim_now;
+
+static void simSend(uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = frame_encode(wire, cmd, payload, len, FRAMING_CRC);
+    lineWrite(sim_pty, line.sim_baud, line.display_baud, wire, n);
+    sim_wrote = true;
+}
+
+static void simAck(uint8_t seq, uint8_t status)
+{
+    uint8_t payload[ACK_LEN];
+    simSend(CMD_ACK, payload, ack_encode(seq, status, payload));
+}
+
+static uint32_t sim_pending_baud;
+static void onSimFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx);
+static FrameParser simParser(FRAMING_CRC, onSimFrame);
+
+// As setBaud() on the sim, outside the parser callback
+static void simSetBaud(uint32_t baud)
+{
+    line.sim_baud = baud;
+    sim_pty.setBaud(baud);
+    simParser.reset();
+}
+
+static void onSimFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    uint8_t seq, op, args_len;
+    const uint8_t *args;
+    sim_last_rx_ms = sim_now;
+    if (cmd != CMD_CONTROL || !control_decode(p, len, &seq, &op, &args, &args_len)) return;
+
+    switch (op) {
+        case CTRL_SET_BAUD: {
+            uint32_t baud;
+            memcpy(&baud, args, SET_BAUD_ARGS_LEN);
+            if (baud == line.reject_baud) {
+                simAck(seq, ACK_BAD_ARGS);
+                break;
+            }
+            simAck(seq, ACK_OK);   // At the old rate, then switch
+            sim_pending_baud = baud;
+            break;
+        }
+        case CTRL_PROBE:
+            for (uint8_t i = 0; i < args[0]; i++) {
+                uint8_t payload[PROBE_LEN];
+                simSend(CMD_PROBE, payload, probe_encode(i, payload));
+            }
+            simAck(seq, ACK_OK);
+            break;
+        default:
+            simAck(seq, ACK_OK);
+            break;
+    }
+}
+
+static void simTick(uint32_t now)
+{
+    uint8_t buf[4096];
+    sim_now = now;
+    size_t n = readLine(sim_pty, buf, sizeof(buf), display_wrote);
+    display_wrote = false;
+    simParser.feed(buf, n);
+    if (sim_pending_baud) {
+        simSetBaud(sim_pending_baud);
+        sim_pending_baud = 0;
+    }
+
+    if (line.sim_baud != BAUD_BASE && now - sim_last_rx_ms > LINK_TIMEOUT_MS) {
+        simSetBaud(BAUD_BASE);
+    }
+
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    d.rpms = now % 1000;
+    d.velocity = (now % 1000) * 0.1f;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    simSend(CMD_FAST, payload, telemetry_encode(&d, CMD_FAST, payload));
+}
+
+// ===== DISPLAY =====
+static uint32_t probes, probe_errors;
+
+static void displayWrite(const uint8_t *data, size_t len, void *ctx)
+{
+    lineWrite(display_pty, line.display_baud, line.sim_baud, data, len);
+    display_wrote = true;
+}
+
+static CommandLink cmdLink(FRAMING_CRC, displayWrite);
+
+static bool display_rx_reset;
+
+// As linkSetBaud() on the display: the parser drops its partial frame
+// before the next chunk, not from inside the callback that got here
+static void displaySetBaud(uint32_t baud, void *ctx)
+{
+    line.display_baud = baud;
+    display_pty.setBaud(baud);
+    display_rx_reset = true;
+}
+
+static BaudNegotiator baudLink(cmdLink, displaySetBaud);
+
+static void onResult(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx)
+{
+    baudLink.onResult(op, status, now_ms);
+}
+
+static void onDisplayFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    uint32_t now = *(uint32_t *)ctx;
+    if (cmd == CMD_ACK) {
+        cmdLink.onAck(p, len, now);
+    } else if (cmd == CMD_PROBE) {
+        if (probe_check(p, len)) probes++;
+        else                     probe_errors++;
+    }
+}
+
+static uint32_t display_now;
+static FrameParser displayParser(FRAMING_CRC, onDisplayFrame, &display_now);
+
+static void displayTick(uint32_t now)
+{
+    uint8_t buf[4096];
+    display_now = now;
+    size_t n = readLine(display_pty, buf, sizeof(buf), sim_wrote);
+    sim_wrote = false;
+    if (display_rx_reset) {
+        display_rx_reset = false;
+        displayParser.reset();
+    }
+    displayParser.feed(buf, n);
+
+    const FrameParserStats &ps = displayParser.stats();
+    BaudLinkCounters c;
+    c.frames = ps.frames;
+    c.errors = ps.crc_errors + ps.resyncs + ps.bad_frames + probe_errors;
+    c.probes = probes;
+
+    cmdLink.poll(now);
+    baudLink.poll(now, c);
+}
+
+// Runs both ends until the negotiator sits in LOCKED at `want` (true) or
+// the deadline passes
+static uint32_t clock_ms = 1;
+
+static bool runUntilLocked(uint32_t want, uint32_t max_ms)
+{
+    for (uint32_t end = clock_ms + max_ms; clock_ms < end; clock_ms++) {
+        simTick(clock_ms);
+        displayTick(clock_ms);
+        if (baudLink.state() == BaudNegotiator::BAUD_STATE_LOCKED &&
+            baudLink.baud() == want) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main()
+{
+    CHECK(display_pty.create());
+    CHECK(sim_pty.open(display_pty.slaveName()));
+    line.display_baud = line.sim_baud = BAUD_BASE;
+    cmdLink.setResultHandler(onResult);
+
+    // The sim refuses 3000000; 2000000 sticks at the first try although
+    // the telemetry right behind its SET_BAUD ack arrives garbled
+    line.reject_baud = 3000000;
+    baudLink.start(clock_ms);
+    CHECK(runUntilLocked(2000000, 2000));
+    CHECK_EQ(baudLink.stats().attempts, 2);   // 3000000 refused by the sim
+    CHECK_EQ(line.sim_baud, 2000000);
+    uint32_t attempts = baudLink.stats().attempts;
+    printf("locked at %u after %u attempts, t=%u ms\n", baudLink.baud(), attempts, clock_ms);
+
+    // The cable stops carrying 2000000: the error window drops the rate,
+    // the sim times out to BAUD_BASE and the next slower one is tried
+    line.broken_baud = 2000000;
+    CHECK(runUntilLocked(921600, 10000));
+    CHECK_EQ(baudLink.stats().fallbacks, 1);
+    CHECK_EQ(baudLink.stats().attempts, attempts + 1);
+    CHECK_EQ(line.sim_baud, 921600);
+    printf("fell back to %u, t=%u ms\n", baudLink.baud(), clock_ms);
+
+    // Link lost and regained: start over from the top. 2000000 is still
+    // broken, so its probe fails and 921600 is locked again
+    baudLink.stop();
+    CHECK(runUntilLocked(UINT32_MAX, LINK_TIMEOUT_MS + 10) == false);
+    CHECK_EQ(line.sim_baud, BAUD_BASE);
+    line.reject_baud = 0;
+    attempts = baudLink.stats().attempts;
+    baudLink.start(clock_ms);
+    CHECK(runUntilLocked(3000000, 2000));
+    CHECK_EQ(baudLink.stats().attempts, attempts + 1);
+    printf("relocked at %u, t=%u ms\n", baudLink.baud(), clock_ms);
+
+    line.reject_baud = 3000000;
+    baudLink.stop();
+    CHECK(runUntilLocked(UINT32_MAX, LINK_TIMEOUT_MS + 10) == false);
+    attempts = baudLink.stats().attempts;
+    baudLink.start(clock_ms);
+    CHECK(runUntilLocked(921600, 10000));
+    CHECK_EQ(baudLink.stats().attempts, attempts + 3);   // Refused, dirty probe, 921600
+    CHECK_EQ(baudLink.stats().fallbacks, 1);             // Only locked rates count
+    printf("skipped a broken rate, locked at %u, t=%u ms\n", baudLink.baud(), clock_ms);
+    return 0;
+}
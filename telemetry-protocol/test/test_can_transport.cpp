@@ -0,0 +1,263 @@
+// CanTransport segmentation and reassembly over an in-memory CanBus, so
+// it runs without vcan0. The sender's frames are kept, checked and then
+// handed to the receiver as sent, with one lost, two swapped, or
+// interleaved with another priority's. Checks every record length for
+// every mapped command, traced and not, the PRIO, TRACE and SEG bits of
+// each CAN ID and the segment headers, and that superframes go out as
+// their records.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "can_transport.h"
+#include "check.h"
+#include "frame_parser.h"
+#include "telemetry_codec.h"
+
+// ===== BUS =====
+// Keeps what is sent until the test hands it over
+class FakeCanBus : public CanBus
+{
+public:
+    std::vector<CanFrame> sent;
+    std::vector<CanFrame> rx;
+    size_t rx_pos = 0;
+
+    bool send(const CanFrame &f) override
+    {
+        sent.push_back(f);
+        return true;
+    }
+    bool receive(CanFrame &f) override
+    {
+        if (rx_pos == rx.size()) return false;
+        f = rx[rx_pos++];
+        return true;
+    }
+    void setFilter(const uint32_t *ids, size_t count) override {}
+};
+
+typedef struct {
+    uint8_t cmd;
+    std::vector<uint8_t> payload;
+} Record;
+
+static FakeCanBus tx_bus, rx_bus;
+static CanTransport tx(tx_bus), rx(rx_bus);
+
+static void onRecord(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    ((std::vector<Record> *)ctx)->push_back(Record{ cmd, std::vector<uint8_t>(p, p + len) });
+}
+
+static void writeFrame(uint8_t cmd, const std::vector<uint8_t> &payload)
+{
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = frame_encode(wire, cmd, payload.data(), payload.size(), FRAMING_PLAIN);
+    CHECK_EQ(tx.write(wire, n), n);
+}
+
+static std::vector<uint8_t> payloadOf(uint8_t len, uint8_t seed)
+{
+    std::vector<uint8_t> p(len);
+    for (uint8_t i = 0; i < len; i++) p[i] = (uint8_t)(seed * 31 + i * 7) | (i % 5 == 0);
+    return p;
+}
+
+// Hands frames to the receiver and returns the records read back
+static std::vector<Record> deliver(const std::vector<CanFrame> &frames)
+{
+    rx_bus.rx = frames;
+    rx_bus.rx_pos = 0;
+    std::vector<Record> out;
+    FrameParser parser(FRAMING_PLAIN, onRecord, &out);
+    uint8_t buf[CAN_RX_BUFFER];
+    size_t n;
+    while ((n = rx.read(buf, sizeof(buf))) > 0) parser.feed(buf, n);
+    return out;
+}
+
+static std::vector<CanFrame> takeSent()
+{
+    std::vector<CanFrame> frames;
+    frames.swap(tx_bus.sent);
+    return frames;
+}
+
+// What one record's frames must look like on the bus
+static void checkIds(const std::vector<CanFrame> &frames, uint8_t cmd, uint8_t len)
+{
+    uint8_t prio = can_priority(cmd & ~CMD_TRACE_FLAG);
+    bool seg = len > CAN_DATA_LEN;
+    size_t count = seg ? (len + CAN_SEG_DATA - 1) / CAN_SEG_DATA : 1;
+    CHECK_EQ(frames.size(), count);
+    size_t bytes = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        const CanFrame &f = frames[i];
+        CHECK_EQ(f.id, can_id(prio, cmd & CMD_TRACE_FLAG, seg));
+        CHECK_EQ((f.id - CAN_ID_BASE) >> 2, prio);
+        CHECK_EQ((f.id >> 1) & 1, (cmd & CMD_TRACE_FLAG) != 0);
+        CHECK_EQ(f.id & 1, seg);
+        CHECK(f.id <= 0x7FF);
+        if (seg) {
+            CHECK_EQ(f.data[0], i << 4 | (count - 1));
+            CHECK(f.len >= 2 && f.len <= CAN_DATA_LEN);
+            bytes += f.len - 1;
+        } else {
+            bytes += f.len;
+        }
+    }
+    CHECK_EQ(bytes, len);
+}
+
+static void everyLength()
+{
+    // Every mapped command, traced and not, at every length
+    uint32_t records = 0, frames = 0;
+    for (uint16_t c = 0; c < 0x80; c++) {
+        uint8_t prio = can_priority(c);
+        if (c == CMD_SUPERFRAME || prio == CAN_NO_PRIORITY) continue;
+        CHECK(prio < CAN_PRIORITIES);
+        for (uint8_t trace = 0; trace < 2; trace++) {
+            uint8_t cmd = c | (trace ? CMD_TRACE_FLAG : 0);
+            for (uint8_t len = 0; len <= FRAME_MAX_PAYLOAD; len++) {
+                std::vector<uint8_t> p = payloadOf(len, cmd + len);
+                writeFrame(cmd, p);
+                std::vector<CanFrame> sent = takeSent();
+                checkIds(sent, cmd, len);
+                std::vector<Record> got = deliver(sent);
+                CHECK_EQ(got.size(), 1);
+                CHECK_EQ(got[0].cmd, cmd);
+                CHECK(got[0].payload == p);
+                records++;
+                frames += sent.size();
+            }
+        }
+    }
+    CHECK_EQ(tx.stats().records_tx, records);
+    CHECK_EQ(rx.stats().records_rx, records);
+    CHECK_EQ(rx.stats().seg_errors, 0);
+
+    // Not mapped: nothing goes out
+    writeFrame(0x7E, payloadOf(10, 1));
+    CHECK(takeSent().empty());
+    printf("every length: %u records in %u CAN frames\n", records, frames);
+}
+
+static void lossAndReorder()
+{
+    const uint8_t len = FRAME_MAX_PAYLOAD;   // 10 segments
+    std::vector<uint8_t> a = payloadOf(len, 1), b = payloadOf(len, 2);
+    writeFrame(CMD_GRAPH, a);
+    std::vector<CanFrame> first = takeSent();
+    writeFrame(CMD_GRAPH, b);
+    std::vector<CanFrame> second = takeSent();
+    size_t count = first.size();
+
+    // Losing any one segment of the first record loses that record only
+    for (size_t lost = 0; lost < count; lost++) {
+        std::vector<CanFrame> frames = first;
+        frames.erase(frames.begin() + lost);
+        frames.insert(frames.end(), second.begin(), second.end());
+        uint32_t errors = rx.stats().seg_errors;
+        std::vector<Record> got = deliver(frames);
+        CHECK_EQ(got.size(), 1);
+        CHECK(got[0].payload == b);
+        // Without its first segment the rest is never started on
+        CHECK_EQ(rx.stats().seg_errors - errors, lost ? 1 : 0);
+    }
+
+    // Two segments swapped, likewise
+    for (size_t i = 0; i + 1 < count; i++) {
+        std::vector<CanFrame> frames = first;
+        std::swap(frames[i], frames[i + 1]);
+        frames.insert(frames.end(), second.begin(), second.end());
+        std::vector<Record> got = deliver(frames);
+        CHECK_EQ(got.size(), 1);
+        CHECK(got[0].payload == b);
+    }
+
+    // A segment from a record with a different COUNT is a gap as well
+    std::vector<CanFrame> frames(first.begin(), first.begin() + 3);
+    writeFrame(CMD_GRAPH, payloadOf(20, 3));
+    std::vector<CanFrame> shorter = takeSent();
+    frames.push_back(shorter[1]);
+    frames.insert(frames.end(), second.begin(), second.end());
+    std::vector<Record> got = deliver(frames);
+    CHECK_EQ(got.size(), 1);
+    CHECK(got[0].payload == b);
+}
+
+static void interleaved()
+{
+    // Segments of two priorities alternate on the bus, as when a higher
+    // priority record wins arbitration in the middle of a lower one
+    std::vector<uint8_t> fast = payloadOf(40, 4), graph = payloadOf(FRAME_MAX_PAYLOAD, 5);
+    writeFrame(CMD_FAST | CMD_TRACE_FLAG, fast);
+    std::vector<CanFrame> f = takeSent();
+    writeFrame(CMD_GRAPH, graph);
+    std::vector<CanFrame> g = takeSent();
+
+    std::vector<CanFrame> frames;
+    for (size_t i = 0; i < f.size() || i < g.size(); i++) {
+        if (i < g.size()) frames.push_back(g[i]);
+        if (i < f.size()) frames.push_back(f[i]);
+    }
+    uint32_t errors = rx.stats().seg_errors;
+    std::vector<Record> got = deliver(frames);
+    CHECK_EQ(got.size(), 2);
+    CHECK_EQ(got[0].cmd, CMD_FAST | CMD_TRACE_FLAG);   // Fewer segments, done first
+    CHECK(got[0].payload == fast);
+    CHECK_EQ(got[1].cmd, CMD_GRAPH);
+    CHECK(got[1].payload == graph);
+    CHECK_EQ(rx.stats().seg_errors, errors);
+}
+
+static void superframes()
+{
+    // A superframe goes out as its records, each on its own ID
+    Superframe sf;
+    superframe_reset(&sf);
+    std::vector<uint8_t> fast = payloadOf(CMD_FAST_LEN, 6);
+    std::vector<uint8_t> aware = payloadOf(CMD_AWARENESS_LEN, 7);
+    std::vector<uint8_t> samples = payloadOf(20, 8);
+    CHECK(superframe_add(&sf, CMD_FAST, fast.data(), fast.size()));
+    CHECK(superframe_add(&sf, CMD_AWARENESS, aware.data(), aware.size()));
+    CHECK(superframe_add(&sf, CMD_SAMPLES, samples.data(), samples.size()));
+    writeFrame(CMD_SUPERFRAME, std::vector<uint8_t>(sf.payload, sf.payload + sf.len));
+    std::vector<CanFrame> sent = takeSent();
+    std::vector<Record> got = deliver(sent);
+    CHECK_EQ(got.size(), 3);
+    CHECK_EQ(got[0].cmd, CMD_FAST);
+    CHECK(got[0].payload == fast);
+    CHECK_EQ(got[1].cmd, CMD_AWARENESS);
+    CHECK(got[1].payload == aware);
+    CHECK_EQ(got[2].cmd, CMD_SAMPLES);
+    CHECK(got[2].payload == samples);
+    CHECK_EQ(sent[0].id, can_id(can_priority(CMD_FAST), false, false));
+}
+
+static void accepted()
+{
+    // Commands the receiver didn't ask for are dropped, even when the
+    // controller lets them through
+    static const uint8_t cmds[] = { CMD_FAST, CMD_CONTROL };
+    rx.accept(cmds, sizeof(cmds));
+    writeFrame(CMD_GRAPH, payloadOf(30, 9));
+    writeFrame(CMD_FAST, payloadOf(6, 10));
+    uint32_t filtered = rx.stats().filtered;
+    std::vector<Record> got = deliver(takeSent());
+    CHECK_EQ(got.size(), 1);
+    CHECK_EQ(got[0].cmd, CMD_FAST);
+    CHECK_EQ(rx.stats().filtered - filtered, 5);   // CMD_GRAPH's segments
+}
+
+int main()
+{
+    everyLength();
+    lossAndReorder();
+    interleaved();
+    superframes();
+    accepted();
+    return 0;
+}
@@ -0,0 +1,138 @@
+// FrameParser output does not depend on how the stream is cut up. Random
+// streams of frames (random commands and lengths, SYNC and delimiter
+// look-alikes in the payloads), clean and with garbage spliced in, are fed
+// whole, a byte at a time and in random chunks including empty ones; every
+// split must deliver the same frames with the same stats. On clean streams
+// that is exactly the frames encoded.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "check.h"
+#include "frame_parser.h"
+
+#define STREAMS 2000
+#define SPLITS  8    // Random splits per stream
+
+static uint32_t rng_state = 2463534242u;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+typedef struct {
+    uint8_t cmd;
+    std::vector<uint8_t> payload;
+} Frame;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    std::vector<Frame> *out = (std::vector<Frame> *)ctx;
+    out->push_back(Frame{ cmd, std::vector<uint8_t>(p, p + len) });
+}
+
+static bool sameFrames(const std::vector<Frame> &a, const std::vector<Frame> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].cmd != b[i].cmd || a[i].payload != b[i].payload) return false;
+    }
+    return true;
+}
+
+static bool sameStats(const FrameParserStats &a, const FrameParserStats &b)
+{
+    return a.frames == b.frames && a.crc_errors == b.crc_errors && a.resyncs == b.resyncs &&
+           a.skipped == b.skipped && a.bad_frames == b.bad_frames;
+}
+
+static uint8_t payloadByte()
+{
+    switch (rnd(4)) {
+        case 0:  return SYNC_BYTE;
+        case 1:  return 0x00;
+        default: return rnd(256);
+    }
+}
+
+// Feeds s in chunks of the given sizes (0 allowed), the last one taking
+// the rest
+static std::vector<Frame> feed(Framing framing, const std::vector<uint8_t> &s,
+                               const std::vector<size_t> &cuts, FrameParserStats *stats)
+{
+    std::vector<Frame> out;
+    FrameParser parser(framing, onFrame, &out);
+    std::vector<uint8_t> buf = s;   // COBS decodes in place
+    size_t pos = 0;
+    for (size_t n : cuts) {
+        if (n > buf.size() - pos) n = buf.size() - pos;
+        parser.feed(buf.data() + pos, n);
+        pos += n;
+    }
+    parser.feed(buf.data() + pos, buf.size() - pos);
+    *stats = parser.stats();
+    return out;
+}
+
+static void streams(Framing framing, const char *name)
+{
+    uint32_t frames = 0, dirty = 0;
+
+    for (int t = 0; t < STREAMS; t++) {
+        std::vector<Frame> sent;
+        std::vector<uint8_t> s;
+        bool garbage = t % 2;
+        uint32_t count = 1 + rnd(30);
+        for (uint32_t i = 0; i < count; i++) {
+            Frame f;
+            f.cmd = rnd(256);
+            f.payload.resize(rnd(FRAME_MAX_PAYLOAD + 1));
+            for (uint8_t &b : f.payload) b = payloadByte();
+            uint8_t wire[FRAME_MAX_WIRE];
+            size_t n = frame_encode(wire, f.cmd, f.payload.data(), f.payload.size(), framing);
+            CHECK(n > 0);
+            s.insert(s.end(), wire, wire + n);
+            sent.push_back(f);
+            if (garbage && rnd(4) == 0) {
+                for (uint32_t g = rnd(2 * FRAME_MAX_SIZE); g > 0; g--) s.push_back(payloadByte());
+            }
+        }
+        if (garbage) dirty++;
+
+        FrameParserStats whole_stats, stats;
+        std::vector<Frame> whole = feed(framing, s, {}, &whole_stats);
+        if (!garbage) {
+            CHECK(sameFrames(whole, sent));
+            CHECK_EQ(whole_stats.skipped, 0);
+        }
+        frames += whole.size();
+
+        std::vector<size_t> bytewise(s.size(), 1);
+        CHECK(sameFrames(feed(framing, s, bytewise, &stats), whole));
+        CHECK(sameStats(stats, whole_stats));
+
+        for (int k = 0; k < SPLITS; k++) {
+            std::vector<size_t> cuts;
+            for (size_t left = s.size(); left > 0;) {
+                size_t n = rnd(4) == 0 ? 0 : rnd(2 * FRAME_MAX_SIZE);
+                cuts.push_back(n);
+                left -= n < left ? n : left;
+            }
+            CHECK(sameFrames(feed(framing, s, cuts, &stats), whole));
+            CHECK(sameStats(stats, whole_stats));
+        }
+    }
+    printf("%s: %d streams (%u with garbage), %u frames, identical under every split\n",
+           name, STREAMS, dirty, frames);
+}
+
+int main()
+{
+    streams(FRAMING_CRC, "crc");
+    streams(FRAMING_COBS, "cobs");
+    return 0;
+}
@@ -0,0 +1,167 @@
+// FrameParser recovery after injected corruption. Each trial corrupts
+// one frame of a clean stream (bit flip, inserted garbage or a lost
+// byte), feeds the result in random chunks and checks that every other
+// frame still arrives exactly once and in order. The same stream fed a
+// byte at a time gives the recovery time: how long after its own last
+// byte the first frame behind the damage was delivered.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "check.h"
+#include "frame_parser.h"
+
+#define FRAMES 40
+#define TRIALS 5000
+#define TEST_CMD 0x01
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+typedef struct {
+    std::vector<uint32_t> seqs;
+    size_t fed;                       // Stream bytes fed so far
+    std::vector<size_t> delivered_at; // fed when each frame came out
+} Rx;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    Rx *rx = (Rx *)ctx;
+    CHECK_EQ(cmd, TEST_CMD);
+    CHECK_EQ(len, 12);
+    uint32_t seq;
+    memcpy(&seq, p, 4);
+    rx->seqs.push_back(seq);
+    rx->delivered_at.push_back(rx->fed);
+}
+
+// Payloads full of SYNC and delimiter look-alikes, so a scanner hunting
+// after the damage meets false starts
+static std::vector<uint8_t> encode(Framing framing, std::vector<size_t> *ends)
+{
+    std::vector<uint8_t> out;
+    for (uint32_t seq = 0; seq < FRAMES; seq++) {
+        uint8_t payload[12];
+        memcpy(payload, &seq, 4);
+        for (int i = 4; i < 12; i++) payload[i] = (i & 1) ? SYNC_BYTE : (uint8_t)rnd(256);
+        uint8_t wire[FRAME_MAX_WIRE];
+        size_t n = frame_encode(wire, TEST_CMD, payload, sizeof(payload), framing);
+        out.insert(out.end(), wire, wire + n);
+        ends->push_back(out.size());
+    }
+    return out;
+}
+
+// Damages frame k in place
+static void corrupt(std::vector<uint8_t> &s, const std::vector<size_t> &ends, size_t k)
+{
+    size_t start = k ? ends[k - 1] : 0;
+    size_t at = start + rnd(ends[k] - start);
+    switch (rnd(3)) {
+        case 0:
+            s[at] ^= 1u << rnd(8);
+            break;
+        case 1: {
+            size_t n = 1 + rnd(2 * FRAME_MAX_SIZE);
+            for (size_t i = 0; i < n; i++) s.insert(s.begin() + at, (uint8_t)rnd(256));
+            break;
+        }
+        default:
+            // Not the last byte: if the next frame's SYNC equals it, that
+            // is indistinguishable from losing the SYNC instead
+            if (at == ends[k] - 1) at--;
+            s.erase(s.begin() + at);
+            break;
+    }
+}
+
+static void trials(Framing framing, const char *name)
+{
+    size_t worst = 0;
+    uint64_t total = 0;
+    uint32_t lost_max = 0;
+
+    for (int t = 0; t < TRIALS; t++) {
+        std::vector<size_t> ends;
+        std::vector<uint8_t> clean = encode(framing, &ends);
+        std::vector<uint8_t> s = clean;
+        size_t k = 1 + rnd(FRAMES - 2);
+        corrupt(s, ends, k);
+        size_t growth = s.size() - clean.size();   // Garbage inserted, or -1
+        // A live link keeps going: a false SYNC in the garbage may be
+        // waiting for up to a maximal frame of bytes behind the last frame
+        s.insert(s.end(), FRAME_MAX_SIZE, 0x00);
+
+        // Random chunks
+        Rx rx = {};
+        FrameParser chunked(framing, onFrame, &rx);
+        std::vector<uint8_t> buf = s;
+        for (size_t pos = 0; pos < buf.size();) {
+            size_t n = 1 + rnd(300);
+            if (n > buf.size() - pos) n = buf.size() - pos;
+            chunked.feed(&buf[pos], n);
+            pos += n;
+        }
+
+        // Every frame before the damage, and all but at most the next
+        // one behind it (COBS loses it too if the damage hit the
+        // delimiter between them), in order and once each
+        uint32_t expect = 0, lost = 0;
+        rx.seqs.push_back(FRAMES);           // Sentinel: checks the tail too
+        for (uint32_t seq : rx.seqs) {
+            CHECK(seq >= expect);
+            for (; expect < seq; expect++) {
+                CHECK(expect == k || (framing == FRAMING_COBS && expect == k + 1));
+                lost++;
+            }
+            expect = seq + 1;
+        }
+        rx.seqs.pop_back();
+        if (lost > lost_max) lost_max = lost;
+
+        // Byte at a time: when did the first intact frame behind k come out?
+        Rx slow = {};
+        FrameParser bytewise(framing, onFrame, &slow);
+        for (size_t i = 0; i < s.size(); i++) {
+            slow.fed = i + 1;
+            bytewise.feed(&s[i], 1);
+        }
+        for (size_t i = 0; i < slow.seqs.size(); i++) {
+            if (slow.seqs[i] <= k) continue;
+            // Its last byte sits where it did in the clean stream, moved
+            // by whatever the damage added or removed
+            size_t end = ends[slow.seqs[i]] + growth;
+            CHECK(slow.delivered_at[i] >= end);
+            size_t delay = slow.delivered_at[i] - end;
+            if (delay > worst) worst = delay;
+            total += delay;
+            break;
+        }
+
+        const FrameParserStats &st = chunked.stats();
+        CHECK_EQ(st.frames, rx.seqs.size());
+        if (framing == FRAMING_CRC && lost) CHECK(st.resyncs + st.skipped > 0);
+    }
+
+    // Resync never holds good frames back by more than one maximal frame,
+    // and COBS not at all: the next delimiter ends the damage
+    CHECK(worst <= FRAME_MAX_SIZE);
+    if (framing == FRAMING_COBS) CHECK_EQ(worst, 0);
+    printf("%s: %d trials, at most %u frames lost, recovery %.2f bytes avg, "
+           "%zu max (%.0f us at 115200)\n", name, TRIALS, lost_max,
+           (double)total / TRIALS, worst, worst * 10 * 1e6 / 115200);
+}
+
+int main()
+{
+    trials(FRAMING_CRC, "crc");
+    trials(FRAMING_COBS, "cobs");
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Handshake against a scripted sim on a virtual millisecond clock. The
+// display's CommandLink writes into the sim's parser; the sim answers as
+// applyControl() does, and its frames reach the display on the next tick.
+// Covers a matching sim, a cached configuration that is still good and
+// one that went stale, a sim of another PROTOCOL_VERSION (one that NAKs
+// the HELLO and one that doesn't), a sim without the handshake, and a sim
+// that is silent for a while.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "check.h"
+#include "frame_parser.h"
+#include "handshake.h"
+#include "telemetry_codec.h"
+
+#define TICK_MS 1
+
+typedef enum {
+    SIM_CURRENT,       // As the sim's applyControl()
+    SIM_NO_CHECK,      // Sends its CAPS and acks every HELLO
+    SIM_NO_HELLO,      // Acks CTRL_HELLO with ACK_UNSUPPORTED
+    SIM_SILENT,        // Rebooting: hears nothing
+} SimMode;
+
+// ===== SIM =====
+static SimMode sim_mode;
+static Caps sim_caps;
+static uint32_t sim_hellos, sim_configures;
+static std::vector<uint8_t> to_display;
+
+static void simSend(uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = frame_encode(wire, cmd, payload, len, FRAMING_CRC);
+    to_display.insert(to_display.end(), wire, wire + n);
+}
+
+static uint8_t simControl(uint8_t op, const uint8_t *args, uint8_t len)
+{
+    switch (op) {
+        case CTRL_HELLO: {
+            sim_hellos++;
+            if (sim_mode == SIM_NO_HELLO) return ACK_UNSUPPORTED;
+            if (len != 1) return ACK_BAD_ARGS;
+            uint8_t payload[FRAME_MAX_PAYLOAD];
+            simSend(CMD_CAPS, payload, caps_encode(&sim_caps, payload));
+            if (sim_mode == SIM_CURRENT && args[0] != sim_caps.version) return ACK_BAD_VERSION;
+            return ACK_OK;
+        }
+        case CTRL_CONFIGURE: {
+            LinkConfig cfg;
+            sim_configures++;
+            if (!link_config_decode(args, len, &cfg)) return ACK_BAD_ARGS;
+            if (cfg.caps_id != caps_id(&sim_caps)) return ACK_STALE;
+            if (cfg.features & ~sim_caps.features) return ACK_BAD_ARGS;
+            return ACK_OK;
+        }
+        default:
+            return ACK_UNSUPPORTED;
+    }
+}
+
+static void onSimFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    uint8_t seq, op, args_len;
+    const uint8_t *args;
+    if (sim_mode == SIM_SILENT) return;
+    if (cmd != CMD_CONTROL || !control_decode(p, len, &seq, &op, &args, &args_len)) return;
+    uint8_t status = simControl(op, args, args_len);
+    uint8_t payload[ACK_LEN];
+    simSend(CMD_ACK, payload, ack_encode(seq, status, payload));
+}
+
+static FrameParser simParser(FRAMING_CRC, onSimFrame);
+
+// ===== DISPLAY =====
+static const Caps display_caps = {
+    PROTOCOL_VERSION,
+    FEAT_CRC | FEAT_COBS | FEAT_DELTA | FEAT_SUPERFRAME | FEAT_LOAD,
+    BAUD_BASE * 8,
+    0,
+    {},
+};
+
+static uint32_t now;
+static uint32_t applied;
+static LinkConfig applied_cfg;
+
+static void displayWrite(const uint8_t *data, size_t len, void *ctx)
+{
+    std::vector<uint8_t> buf(data, data + len);
+    simParser.feed(buf.data(), buf.size());
+}
+
+static void apply(const LinkConfig &cfg, void *ctx)
+{
+    applied++;
+    applied_cfg = cfg;
+}
+
+static CommandLink cmdLink(FRAMING_CRC, displayWrite);
+static Handshake handshake(cmdLink, display_caps, apply);
+
+static void onResult(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx)
+{
+    handshake.onResult(op, status, now_ms);
+}
+
+static void onDisplayFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    if (cmd == CMD_CAPS)     handshake.onCaps(p, len);   // Before its ack
+    else if (cmd == CMD_ACK) cmdLink.onAck(p, len, now);
+}
+
+static FrameParser displayParser(FRAMING_CRC, onDisplayFrame);
+
+static void run(uint32_t ms)
+{
+    for (uint32_t end = now + ms; now != end; now += TICK_MS) {
+        std::vector<uint8_t> rx;
+        rx.swap(to_display);
+        displayParser.feed(rx.data(), rx.size());
+        cmdLink.poll(now);
+        handshake.poll(now);
+    }
+}
+
+static void reset(SimMode mode, uint8_t version)
+{
+    sim_mode = mode;
+    sim_caps.version = version;
+    sim_hellos = sim_configures = 0;
+    applied = 0;
+    handshake.stop();
+    run(1000);   // Anything still queued times out
+}
+
+int main()
+{
+    cmdLink.setResultHandler(onResult);
+    sim_caps.features = FEAT_CRC | FEAT_COBS | FEAT_DELTA | FEAT_SAMPLES | FEAT_LOAD;
+    sim_caps.max_baud = BAUD_BASE * 4;
+    sim_caps.limit_count = 1;
+    sim_caps.limits[0].cmd = CMD_FAST;
+    sim_caps.limits[0].min_period_ms = 5;
+
+    // A sim of our version: HELLO, CAPS, the best common configuration
+    reset(SIM_CURRENT, PROTOCOL_VERSION);
+    handshake.start(now, NULL);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+    CHECK_EQ(applied, 1);
+    CHECK_EQ(applied_cfg.framing, FRAMING_COBS);
+    CHECK_EQ(applied_cfg.features, FEAT_DELTA | FEAT_LOAD);
+    CHECK_EQ(applied_cfg.max_baud, BAUD_BASE * 4);
+    CHECK_EQ(handshake.minPeriod(CMD_FAST), 5);
+    CHECK(!handshake.versionMismatch());
+    LinkConfig cached = applied_cfg;
+
+    // Reconnect with that configuration: no HELLO needed
+    reset(SIM_CURRENT, PROTOCOL_VERSION);
+    handshake.start(now, &cached);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+    CHECK_EQ(sim_hellos, 0);
+    CHECK_EQ(applied, 1);
+
+    // The sim changed since: CONFIGURE is stale, the full exchange follows
+    sim_caps.features &= ~FEAT_DELTA;
+    reset(SIM_CURRENT, PROTOCOL_VERSION);
+    handshake.start(now, &cached);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+    CHECK_EQ(sim_hellos, 1);
+    CHECK_EQ(sim_configures, 2);
+    CHECK_EQ(applied_cfg.features, FEAT_LOAD);
+
+    // A sim of another version NAKs the HELLO; we learn its version from
+    // CAPS and stay on the boot configuration
+    reset(SIM_CURRENT, PROTOCOL_VERSION + 1);
+    handshake.start(now, NULL);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_FALLBACK);
+    CHECK(handshake.versionMismatch());
+    CHECK_EQ(handshake.peer().version, PROTOCOL_VERSION + 1);
+    CHECK_EQ(handshake.peer().limit_count, 0);
+    CHECK_EQ(sim_configures, 0);
+    CHECK_EQ(applied, 0);
+
+    // Asked again once HANDSHAKE_FALLBACK_RETRY_MS is up; updated by now
+    run(HANDSHAKE_FALLBACK_RETRY_MS - 200);
+    CHECK_EQ(sim_hellos, 1);
+    sim_caps.version = PROTOCOL_VERSION;
+    run(300);
+    CHECK_EQ(sim_hellos, 2);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+    CHECK(!handshake.versionMismatch());
+
+    // One that doesn't check our version but sends CAPS of its own: its
+    // CAPS are not read past VERSION, so nothing gets configured
+    reset(SIM_NO_CHECK, PROTOCOL_VERSION + 1);
+    handshake.start(now, NULL);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_FALLBACK);
+    CHECK(handshake.versionMismatch());
+    CHECK_EQ(sim_configures, 0);
+    CHECK_EQ(applied, 0);
+
+    // No handshake at all: ACK_UNSUPPORTED, boot configuration
+    reset(SIM_NO_HELLO, PROTOCOL_VERSION);
+    handshake.start(now, NULL);
+    run(100);
+    CHECK_EQ(handshake.state(), Handshake::HS_FALLBACK);
+    CHECK_EQ(applied, 0);
+
+    // A silent sim: the HELLO times out, we wait HANDSHAKE_RETRY_MS and
+    // start over, as long as it takes
+    reset(SIM_SILENT, PROTOCOL_VERSION);
+    handshake.start(now, NULL);
+    run(1000);
+    CHECK_EQ(handshake.state(), Handshake::HS_RETRY);
+    run(3 * HANDSHAKE_RETRY_MS);
+    CHECK(handshake.state() == Handshake::HS_RETRY || handshake.state() == Handshake::HS_HELLO);
+    CHECK(cmdLink.stats().failed >= 3);
+    sim_mode = SIM_CURRENT;   // Back from its reboot
+    run(2 * HANDSHAKE_RETRY_MS);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+    CHECK_EQ(applied, 1);
+
+    // Another command timing out on the same link leaves the handshake be
+    sim_mode = SIM_SILENT;
+    cmdLink.send(CTRL_PING, NULL, 0, now);
+    run(1000);
+    CHECK_EQ(handshake.state(), Handshake::HS_DONE);
+
+    printf("handshake: %u commands acked, %u timed out, %u rejected\n",
+           cmdLink.stats().sent, cmdLink.stats().failed, cmdLink.stats().rejected);
+    return 0;
+}
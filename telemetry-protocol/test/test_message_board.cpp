@@ -0,0 +1,57 @@
+// MessageBoard duplicate filter: the sender's repeats of a message are
+// dropped, but a MSG_ID heard again after a quiet spell is a new message,
+// as after a sim reboot that numbers its messages from 0 again.
+
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+#include "message_board.h"
+
+static MessageBoard board(0);
+
+// Sends text as the sim does, one fragment per FAST period
+static uint32_t send(uint8_t id, const char *text, uint32_t now_ms)
+{
+    uint8_t len = strlen(text);
+    uint8_t count = (len + MSG_FRAG_TEXT - 1) / MSG_FRAG_TEXT;
+    for (uint8_t i = 0; i < count; i++, now_ms += 10) {
+        MessageFragment f;
+        f.id = id;
+        f.priority = MSG_PRIO_NORMAL;
+        f.index = i;
+        f.count = count;
+        f.len = len - i * MSG_FRAG_TEXT < MSG_FRAG_TEXT ? len - i * MSG_FRAG_TEXT : MSG_FRAG_TEXT;
+        f.text = (const uint8_t *)&text[i * MSG_FRAG_TEXT];
+        board.onFragment(f, now_ms);
+    }
+    return now_ms;
+}
+
+int main()
+{
+    const char *before = "Box this lap, tyres are gone";
+    const char *after  = "Sim restarted, session reset";
+
+    // Sent twice back to back: one message, the copy counted
+    uint32_t now = send(0, before, 1000);
+    now = send(0, before, now);
+    CHECK_EQ(board.stats().completed, 1);
+    CHECK_EQ(board.stats().duplicates, 2);
+    CHECK(board.update(now));
+    CHECK(strcmp(board.current(), before) == 0);
+
+    // The sim reboots and its first message reuses MSG_ID 0
+    now += 5000;
+    now = send(0, after, now);
+    CHECK_EQ(board.stats().completed, 2);
+    CHECK(board.update(now));
+    CHECK(strcmp(board.current(), after) == 0);
+
+    // Repeats that keep coming keep being dropped, however long
+    // the run of them
+    for (int i = 0; i < 20; i++) now = send(0, after, now + MSG_REASSEMBLY_MS / 2);
+    CHECK_EQ(board.stats().completed, 2);
+    printf("%u messages, %u duplicate fragments dropped\n",
+           board.stats().completed, board.stats().duplicates);
+    return 0;
+}
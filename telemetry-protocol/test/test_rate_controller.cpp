@@ -0,0 +1,156 @@
+// RateController in a closed loop with a modelled display, on a virtual
+// millisecond clock. The sender sheds per level as the sim does; the
+// display drains a RX_QUEUE_LEN queue at a fixed record rate and reports
+// its queue fill and busy time every LOAD_REPORT_MS, one period late.
+// Checks that an overloaded display is relieved quickly, that the level
+// then holds without oscillating, and that full rate comes back once the
+// display keeps up again.
+
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+#include "rate_controller.h"
+
+// As in esp32-telemetry-sim/src/main.cpp
+typedef struct {
+    uint8_t fast;        // CMD_FAST period multiplier
+    uint8_t awareness;   // CMD_AWARENESS period multiplier
+    bool    samples;     // 1 kHz CMD_SAMPLES batches
+} LoadLevel;
+
+static const LoadLevel load_levels[] = {
+    { 1, 1, true  },
+    { 2, 1, true  },
+    { 2, 1, false },
+    { 5, 2, false },
+};
+#define LOAD_LEVEL_COUNT (sizeof(load_levels) / sizeof(load_levels[0]))
+#define SAMPLE_BATCH     10
+
+#define RX_QUEUE_LEN 64   // Records the display can hold
+
+typedef struct {
+    uint32_t capacity;     // Records per second the display gets through
+    uint32_t queued;
+    uint32_t credit;       // Record-milliseconds of drain owed
+    uint32_t done;         // Drained this report window
+    uint32_t queue_max;    // Highest fill this window
+    uint32_t drops;
+} Display;
+
+static RateController rc(LOAD_LEVEL_COUNT - 1, 2048);
+static Display display;
+static uint32_t clock_ms = 0;
+static LoadReport pending;
+static bool have_pending;
+static uint32_t level_changes;
+
+static uint32_t due(uint32_t now, uint32_t period)
+{
+    return now % period == 0;
+}
+
+static void tick()
+{
+    uint32_t now = clock_ms++;
+    const LoadLevel &l = load_levels[rc.level()];
+
+    // Sender, at the schema periods scaled by the level
+    uint32_t records = due(now, 10 * l.fast) + due(now, 100 * l.awareness) +
+                       due(now, 1000) + due(now, 200) +
+                       (l.samples ? due(now, SAMPLE_BATCH) : 0);
+    for (uint32_t i = 0; i < records; i++) {
+        if (display.queued < RX_QUEUE_LEN) display.queued++;
+        else                               display.drops++;
+    }
+    if (display.queued > display.queue_max) display.queue_max = display.queued;
+
+    // Display drains at its rate
+    display.credit += display.capacity;
+    while (display.credit >= 1000 && display.queued) {
+        display.credit -= 1000;
+        display.queued--;
+        display.done++;
+    }
+    if (!display.queued) display.credit = 0;   // Idle time is not banked
+
+    if (now % LOAD_REPORT_MS == 0) {
+        // Last period's report reaches the sender now
+        if (have_pending) {
+            uint8_t before = rc.level();
+            if (rc.onReport(pending, now) != before) level_changes++;
+        }
+
+        // Busy share: records handled against what it could handle
+        uint32_t could = display.capacity * LOAD_REPORT_MS / 1000;
+        uint32_t busy = display.done * 100 / could;
+        pending.backlog = 0;
+        pending.queue_pct = display.queue_max * 100 / RX_QUEUE_LEN;
+        pending.budget_pct = busy > 100 ? 100 : busy;
+        have_pending = true;
+        display.done = 0;
+        display.queue_max = display.queued;
+    }
+}
+
+static void run(uint32_t ms)
+{
+    for (uint32_t end = clock_ms + ms; clock_ms < end;) tick();
+}
+
+int main()
+{
+    // A display with headroom never sees the rate cut
+    display.capacity = 1000;
+    run(20000);
+    CHECK_EQ(rc.level(), 0);
+    CHECK_EQ(rc.stats().degrades, 0);
+    CHECK_EQ(display.drops, 0);
+
+    // It slows to 110 records/s (the full rate is 216): levels 0 and 1
+    // overload it, 2 leaves it 60 % busy, between the thresholds. The reports lag and the
+    // queue takes a while to drain, so one step too far is allowed, as
+    // long as the calm reports that follow bring it back.
+    display.capacity = 110;
+    uint32_t start = clock_ms, drops = display.drops;
+    while (rc.level() < 2 && clock_ms - start < 5000) tick();
+    uint32_t relief_ms = clock_ms - start;
+    CHECK_EQ(rc.level(), 2);
+    CHECK(relief_ms <= 4 * RATE_DEGRADE_MS);
+    uint8_t peak = rc.level();
+    while (clock_ms - start < RATE_RESTORE_MS + 2000) {
+        tick();
+        if (rc.level() > peak) peak = rc.level();
+    }
+    CHECK(peak <= 3);
+    CHECK_EQ(rc.level(), 2);
+    printf("overload: level 2 after %u ms, peak %u, %u records dropped meanwhile\n",
+           relief_ms, peak, display.drops - drops);
+
+    // From then on nothing is lost and the level holds
+    drops = display.drops;
+    level_changes = 0;
+    run(30000);
+    CHECK_EQ(display.drops, drops);
+    CHECK_EQ(level_changes, 0);
+    CHECK_EQ(rc.level(), 2);
+    printf("held level 2 for 30 s, load %u%%\n", rc.stats().last_load);
+
+    // Back to full speed: one step per RATE_RESTORE_MS of calm reports
+    display.capacity = 1000;
+    uint32_t restores = rc.stats().restores;
+    start = clock_ms;
+    while (rc.level() > 0 && clock_ms - start < 10000) tick();
+    uint32_t restore_ms = clock_ms - start;
+    CHECK_EQ(rc.level(), 0);
+    CHECK(restore_ms >= 2 * RATE_RESTORE_MS);
+    CHECK(restore_ms <= 2 * RATE_RESTORE_MS + 3 * LOAD_REPORT_MS);
+    CHECK_EQ(rc.stats().restores - restores, 2);
+    printf("recovered: level 0 after %u ms\n", restore_ms);
+
+    // A display that can't keep up even at the last level ends there
+    display.capacity = 20;
+    run(5000);
+    CHECK_EQ(rc.level(), LOAD_LEVEL_COUNT - 1);
+    return 0;
+}
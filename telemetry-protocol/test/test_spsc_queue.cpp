@@ -0,0 +1,91 @@
+// SpscQueue (ui_assets_tutorial/include) between two real threads: every
+// item arrives exactly once, in order and untorn, however the producer
+// and consumer interleave.
+
+#include <stdint.h>
+#include <thread>
+#include "check.h"
+#include "spsc_queue.h"
+
+#define ITEMS 2000000
+
+// Big enough that a torn copy would show as a mismatched check word
+typedef struct {
+    uint32_t seq;
+    uint32_t data[6];
+    uint32_t check;
+} Item;
+
+static Item make(uint32_t seq)
+{
+    Item it;
+    it.seq = seq;
+    it.check = seq;
+    for (int i = 0; i < 6; i++) {
+        it.data[i] = seq * 2654435761u + i;
+        it.check ^= it.data[i];
+    }
+    return it;
+}
+
+template <size_t N>
+static void stress(uint32_t items)
+{
+    static SpscQueue<Item, N> q;
+    uint32_t full = 0;
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < items; i++) {
+            Item it = make(i);
+            while (!q.push(it)) {
+                full++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t next = 0;
+    size_t max_size = 0;
+    while (next < items) {
+        size_t size = q.size();
+        if (size > max_size) max_size = size;
+        Item it;
+        if (!q.pop(it)) {
+            std::this_thread::yield();
+            continue;
+        }
+        CHECK_EQ(it.seq, next);
+        uint32_t check = it.seq;
+        for (int i = 0; i < 6; i++) check ^= it.data[i];
+        CHECK_EQ(check, it.check);
+        next++;
+    }
+    producer.join();
+
+    Item it;
+    CHECK(!q.pop(it));
+    CHECK_EQ(q.size(), 0);
+    CHECK(max_size <= q.capacity());
+    printf("N=%zu: %u items in order, producer found it full %u times\n",
+           N, items, full);
+}
+
+int main()
+{
+    // Single-threaded edges first: capacity is N - 1 and a full push fails
+    static SpscQueue<Item, 4> small;
+    for (uint32_t i = 0; i < 3; i++) CHECK(small.push(make(i)));
+    CHECK(!small.push(make(3)));
+    CHECK_EQ(small.size(), 3);
+    Item it;
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(small.pop(it));
+        CHECK_EQ(it.seq, i);
+    }
+    CHECK(!small.pop(it));
+
+    stress<2>(ITEMS / 10);   // One usable slot: every item changes hands alone
+    stress<64>(ITEMS);       // RX_QUEUE_LEN on the display
+    stress<256>(ITEMS);      // SAMPLE_QUEUE_LEN
+    return 0;
+}
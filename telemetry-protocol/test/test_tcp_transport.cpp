@@ -0,0 +1,172 @@
+// TcpTransport over a real loopback connection: one end listen()s, the
+// other connect()s. Frames of every length go across and are echoed
+// back, then a writer thread pushes far more than the socket buffers
+// hold, so write() has to wait for room without cutting a frame. Last,
+// the connecting end closes: what it sent before still arrives, then
+// available() and read() return 0, isOpen() turns false and writes to
+// the gone peer return without raising SIGPIPE.
+
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "check.h"
+#include "frame_parser.h"
+#include "host_transport.h"
+
+#define PORT_BASE    47100
+#define WAIT_MS      2000
+#define BURST_FRAMES 60000   // About 4 MB
+
+typedef struct {
+    uint8_t cmd;
+    std::vector<uint8_t> payload;
+} Frame;
+
+static void onFrame(uint8_t cmd, const uint8_t *p, uint8_t len, void *ctx)
+{
+    ((std::vector<Frame> *)ctx)->push_back(Frame{ cmd, std::vector<uint8_t>(p, p + len) });
+}
+
+static size_t encode(uint8_t *wire, uint32_t i)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t len = i % (FRAME_MAX_PAYLOAD + 1);
+    for (uint8_t k = 0; k < len; k++) payload[k] = (uint8_t)(i + k * 13);
+    if (len >= 4) memcpy(payload, &i, 4);
+    return frame_encode(wire, (uint8_t)(i % 0x40), payload, len, FRAMING_CRC);
+}
+
+static bool sameAs(const Frame &f, uint32_t i)
+{
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = encode(wire, i);
+    return f.cmd == wire[1] && f.payload.size() == n - FRAME_HEADER_LEN - FRAME_CRC_LEN &&
+           memcmp(f.payload.data(), &wire[FRAME_HEADER_LEN], f.payload.size()) == 0;
+}
+
+// Reads from t into parser until it has want frames; false on timeout
+static bool readFrames(TcpTransport &t, FrameParser &parser, uint32_t want)
+{
+    uint8_t buf[4096];
+    while (parser.stats().frames < want) {
+        size_t n = t.read(buf, sizeof(buf));
+        if (n) {
+            parser.feed(buf, n);
+            continue;
+        }
+        struct pollfd p = { t.fd(), POLLIN, 0 };
+        if (poll(&p, 1, WAIT_MS) <= 0) return false;
+    }
+    return true;
+}
+
+int main()
+{
+    // ===== CONNECT =====
+    TcpTransport server, client;
+    uint16_t port = PORT_BASE + getpid() % 500;
+    std::thread listener([&] { CHECK(server.listen(port)); });
+    bool connected = false;
+    for (int tries = 0; tries < WAIT_MS / 10 && !connected; tries++) {
+        connected = client.connect("127.0.0.1", port);
+        if (!connected) usleep(10000);
+    }
+    listener.join();
+    CHECK(connected);
+    CHECK(server.isOpen() && client.isOpen());
+    CHECK(!client.connect("not an address", port));
+
+    // ===== ROUND TRIP =====
+    // Every length client -> server, echoed back frame by frame
+    std::vector<Frame> at_server, at_client;
+    FrameParser server_parser(FRAMING_CRC, onFrame, &at_server);
+    FrameParser client_parser(FRAMING_CRC, onFrame, &at_client);
+    const uint32_t frames = 10 * (FRAME_MAX_PAYLOAD + 1);
+    for (uint32_t i = 0; i < frames; i++) {
+        uint8_t wire[FRAME_MAX_WIRE];
+        size_t n = encode(wire, i);
+        CHECK_EQ(client.write(wire, n), n);
+        CHECK(readFrames(server, server_parser, i + 1));
+        CHECK(sameAs(at_server[i], i));
+        CHECK_EQ(server.write(wire, n), n);
+    }
+    CHECK(readFrames(client, client_parser, frames));
+    for (uint32_t i = 0; i < frames; i++) CHECK(sameAs(at_client[i], i));
+    CHECK_EQ(server_parser.stats().crc_errors + client_parser.stats().crc_errors, 0);
+
+    // available() counts what read() would return
+    uint8_t wire[FRAME_MAX_WIRE];
+    size_t n = encode(wire, 1000);
+    CHECK_EQ(server.available(), 0);
+    client.write(wire, n);
+    struct pollfd p = { server.fd(), POLLIN, 0 };
+    CHECK(poll(&p, 1, WAIT_MS) == 1);
+    for (int i = 0; i < WAIT_MS && server.available() < n; i++) usleep(1000);
+    CHECK_EQ(server.available(), n);
+    uint8_t buf[FRAME_MAX_WIRE];
+    CHECK_EQ(server.read(buf, sizeof(buf)), n);
+    CHECK(memcmp(buf, wire, n) == 0);
+    CHECK_EQ(server.available(), 0);
+    CHECK_EQ(server.read(buf, sizeof(buf)), 0);   // Nothing waiting: idle
+
+    // ===== BURST =====
+    // Far more than the socket buffers: write() waits, frames stay whole
+    at_server.clear();
+    FrameParser burst_parser(FRAMING_CRC, onFrame, &at_server);
+    std::thread writer([&] {
+        for (uint32_t i = 0; i < BURST_FRAMES; i++) {
+            uint8_t w[FRAME_MAX_WIRE];
+            size_t len = encode(w, i);
+            CHECK_EQ(client.write(w, len), len);
+        }
+    });
+    CHECK(readFrames(server, burst_parser, BURST_FRAMES));
+    writer.join();
+    for (uint32_t i = 0; i < BURST_FRAMES; i++) CHECK(sameAs(at_server[i], i));
+    CHECK_EQ(burst_parser.stats().skipped, 0);
+
+    // ===== PEER CLOSE =====
+    // Sent before the close still arrives; then the stream has ended
+    at_server.clear();
+    FrameParser last_parser(FRAMING_CRC, onFrame, &at_server);
+    for (uint32_t i = 0; i < 3; i++) {
+        n = encode(wire, i + 40);
+        client.write(wire, n);
+    }
+    client.close();
+    CHECK(!client.isOpen());
+    CHECK_EQ(client.write(wire, n), 0);
+    CHECK_EQ(client.read(buf, sizeof(buf)), 0);
+    CHECK(readFrames(server, last_parser, 3));
+    CHECK(sameAs(at_server[2], 42));
+    CHECK(poll(&p, 1, WAIT_MS) == 1);   // Readable: the end of the stream
+    CHECK_EQ(server.read(buf, sizeof(buf)), 0);
+    CHECK(!server.isOpen());
+    CHECK_EQ(server.available(), 0);
+    CHECK_EQ(server.read(buf, sizeof(buf)), 0);
+    for (int i = 0; i < 10; i++) CHECK_EQ(server.write(wire, n), 0);
+
+    // Writing to a peer that left, before reading the end of the stream:
+    // the kernel refuses, and we get a short write instead of SIGPIPE
+    std::thread relisten([&] { CHECK(server.listen(port + 1)); });
+    connected = false;
+    for (int tries = 0; tries < WAIT_MS / 10 && !connected; tries++) {
+        connected = client.connect("127.0.0.1", port + 1);
+        if (!connected) usleep(10000);
+    }
+    relisten.join();
+    CHECK(connected);
+    client.close();
+    bool refused = false;
+    for (int i = 0; i < 100 && !refused; i++) {
+        refused = server.write(wire, n) < n;
+        usleep(1000);
+    }
+    CHECK(refused);
+
+    printf("tcp: %u frames echoed, %u in a burst, peer close seen\n", frames, BURST_FRAMES);
+    return 0;
+}
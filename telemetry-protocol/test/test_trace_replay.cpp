@@ -0,0 +1,296 @@
+// TraceReader and TraceReplay over an in-memory source handing out a few
+// bytes per read, so records and lines straddle the two buffers. Covers
+// CSV headers with unknown, padded and missing columns, a header without
+// t_ms, a last line without its newline, an overlong and a malformed
+// line, binary records, the 0xFF end marker in both formats, next()
+// running into a loader that is behind (single-stepped, then from a real
+// loader thread) and the speed multiplier on a virtual clock.
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "trace_replay.h"
+
+class MemTraceSource : public TraceSource
+{
+public:
+    MemTraceSource(const std::vector<uint8_t> &data, size_t chunk)
+        : _data(data), _pos(0), _chunk(chunk) {}
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        size_t n = _data.size() - _pos;
+        if (n > len) n = len;
+        if (n > _chunk) n = _chunk;
+        memcpy(buf, _data.data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+    bool rewind() override
+    {
+        _pos = 0;
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> _data;
+    size_t _pos;
+    size_t _chunk;
+};
+
+static std::vector<uint8_t> bytes(const std::string &s)
+{
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+typedef struct {
+    uint32_t t_ms;
+    DisplayData d;
+    uint32_t fields;
+} Record;
+
+// Everything reader delivers, the loader keeping up; d starts out as init
+static std::vector<Record> readAll(TraceReader &reader, const DisplayData &init)
+{
+    std::vector<Record> out;
+    Record r;
+    r.d = init;
+    CHECK(reader.restart());
+    while (!reader.finished()) {
+        reader.fill();
+        while (reader.next(&r.t_ms, &r.d, &r.fields)) out.push_back(r);
+    }
+    return out;
+}
+
+static DisplayData blank()
+{
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    return d;
+}
+
+static void csv()
+{
+    // Padded names, a column we don't know, fields missing from the file,
+    // empty cells and a last line without its newline
+    DisplayData init = blank();
+    init.laps = 7;
+    MemTraceSource src(bytes("t_ms, rpms ,gear,velocity\r\n"
+                             "100,500,3,12.5\r\n"
+                             "110,510,,\n"
+                             "\n"
+                             "120,,4,13.0\n"
+                             "130,530,4,13.5"), 7);
+    TraceReader reader(src);
+    std::vector<Record> r = readAll(reader, init);
+    CHECK_EQ(r.size(), 4);
+    CHECK_EQ(r[0].t_ms, 100);
+    CHECK_EQ(r[0].d.rpms, 500);
+    CHECK(r[0].d.velocity == 12.5f);
+    CHECK_EQ(r[0].fields, FIELD_RPMS | FIELD_VELOCITY);
+    CHECK_EQ(r[1].d.rpms, 510);
+    CHECK(r[1].d.velocity == 12.5f);   // Empty cell: as it was
+    CHECK_EQ(r[1].fields, FIELD_RPMS);
+    CHECK_EQ(r[2].d.rpms, 510);
+    CHECK_EQ(r[2].fields, FIELD_VELOCITY);
+    CHECK_EQ(r[3].t_ms, 130);
+    CHECK_EQ(r[3].d.rpms, 530);
+    for (const Record &rec : r) CHECK_EQ(rec.d.laps, 7);   // Not in the file
+    CHECK_EQ(reader.stats().records, 4);
+    CHECK_EQ(reader.stats().bad, 0);
+
+    // Nothing to time the lines by
+    MemTraceSource untimed(bytes("rpms,velocity\n1,2.0\n3,4.0\n"), 5);
+    TraceReader no_time(untimed);
+    CHECK_EQ(readAll(no_time, blank()).size(), 0);
+    CHECK_EQ(no_time.stats().bad, 1);
+
+    // An overlong line and one without a time are skipped, the lines
+    // around them are not
+    std::string text = "t_ms,rpms\n10,1\n" + std::string(TRACE_LINE_MAX + 40, '9') +
+                       "\nabc,5\n20,2\n";
+    MemTraceSource longer(bytes(text), 64);
+    TraceReader skip(longer);
+    r = readAll(skip, blank());
+    CHECK_EQ(r.size(), 2);
+    CHECK_EQ(r[0].d.rpms, 1);
+    CHECK_EQ(r[1].t_ms, 20);
+    CHECK_EQ(r[1].d.rpms, 2);
+    CHECK_EQ(skip.stats().bad, 2);
+
+    // 0xFF where a line would start is the end, as erased flash
+    std::vector<uint8_t> erased = bytes("t_ms,rpms\n10,1\n20,2\n");
+    erased.insert(erased.end(), 300, 0xFF);
+    erased.insert(erased.end(), { '3', '0', ',', '3', '\n' });
+    MemTraceSource flash(erased, 33);
+    TraceReader ended(flash);
+    CHECK_EQ(readAll(ended, blank()).size(), 2);
+    CHECK_EQ(ended.stats().bad, 0);
+}
+
+static void binary()
+{
+    static const uint8_t masks[] = {
+        FIELD_ALL, FIELD_RPMS | FIELD_VELOCITY, FIELD_LAPS, FIELD_BATTERY_VOLTAGE | FIELD_RPMS,
+    };
+    std::vector<uint8_t> data(TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_LEN);
+    std::vector<Record> sent;
+    DisplayData d = blank();
+    for (uint32_t i = 0; i < 200; i++) {
+        Record r;
+        d.rpms = i * 3;
+        d.velocity = i * 0.5f;
+        d.laps = i / 50;
+        d.battery_voltage = 24.0f - i * 0.01f;
+        r.t_ms = 1000 + i * 10;
+        r.fields = masks[i % 4];
+        telemetry_copy_fields(&r.d, &d, FIELD_ALL);
+        uint8_t rec[TRACE_RECORD_HEADER_LEN + FRAME_MAX_PAYLOAD];
+        uint8_t n = trace_record_encode(r.t_ms, &d, r.fields, rec);
+        data.insert(data.end(), rec, rec + n);
+        sent.push_back(r);
+    }
+    data.insert(data.end(), 64, 0xFF);
+    data.insert(data.end(), 64, 0x01);   // Behind the end: never read as records
+
+    MemTraceSource src(data, 13);
+    TraceReader reader(src);
+    std::vector<Record> got = readAll(reader, blank());
+    CHECK_EQ(got.size(), sent.size());
+    for (size_t i = 0; i < got.size(); i++) {
+        CHECK_EQ(got[i].t_ms, sent[i].t_ms);
+        CHECK_EQ(got[i].fields, sent[i].fields);
+        uint32_t f = got[i].fields;
+        if (f & FIELD_RPMS)     CHECK_EQ(got[i].d.rpms, sent[i].d.rpms);
+        if (f & FIELD_VELOCITY) CHECK(got[i].d.velocity == sent[i].d.velocity);
+        if (f & FIELD_LAPS)     CHECK_EQ(got[i].d.laps, sent[i].d.laps);
+    }
+    CHECK_EQ(reader.stats().bad, 0);
+
+    // A length no record can have leaves nothing to resynchronise on
+    std::vector<uint8_t> broken(TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_LEN);
+    broken.push_back(TRACE_LINE_MAX);
+    broken.insert(broken.end(), 200, 0x00);
+    MemTraceSource bad_src(broken, 50);
+    TraceReader bad(bad_src);
+    CHECK_EQ(readAll(bad, blank()).size(), 0);
+    CHECK_EQ(bad.stats().bad, 1);
+    CHECK(bad.finished());
+}
+
+static std::vector<uint8_t> longCsv(uint32_t lines, uint32_t step_ms)
+{
+    std::string text = "t_ms,rpms,velocity\n";
+    char line[48];
+    for (uint32_t i = 0; i < lines; i++) {
+        snprintf(line, sizeof(line), "%u,%u,%.1f\n", 5000 + i * step_ms, i % 1000, i * 0.1f);
+        text += line;
+    }
+    return bytes(text);
+}
+
+static void underrun()
+{
+    // Single-stepped: next() runs dry between the loader's fills and
+    // says so, without losing its place
+    const uint32_t lines = 2000;
+    MemTraceSource src(longCsv(lines, 10), TRACE_BLOCK);
+    TraceReader reader(src);
+    CHECK(reader.restart());
+    uint32_t t, fields, got = 0, dry = 0;
+    DisplayData d = blank();
+    CHECK(!reader.next(&t, &d, &fields));   // Nothing loaded yet
+    while (!reader.finished()) {
+        if (reader.next(&t, &d, &fields)) {
+            CHECK_EQ(d.rpms, got % 1000);
+            got++;
+        } else if (!reader.finished()) {
+            dry++;
+            reader.fill();
+        }
+    }
+    CHECK_EQ(got, lines);
+    CHECK(dry > 2);
+    CHECK_EQ(reader.stats().underruns, dry + 1);
+
+    // A loader thread that dawdles: every record still arrives once, in
+    // order
+    MemTraceSource slow_src(longCsv(lines, 10), 97);
+    TraceReader slow(slow_src);
+    CHECK(slow.restart());
+    std::atomic<bool> stop(false);
+    std::thread loader([&] {
+        while (!stop && slow.fill()) std::this_thread::yield();
+    });
+    got = 0;
+    while (!slow.finished()) {
+        if (slow.next(&t, &d, &fields)) {
+            CHECK_EQ(t, 5000 + got * 10);
+            got++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    stop = true;
+    loader.join();
+    CHECK_EQ(got, lines);
+    CHECK_EQ(slow.stats().bad, 0);
+    printf("underrun: %u of %u next() calls single-stepped dry, %u with a loader thread\n",
+           dry, dry + lines, slow.stats().underruns);
+}
+
+static void replay()
+{
+    // Records 100 ms apart from t = 5000; at 10x one is due every 10 ms
+    const uint32_t lines = 50;
+    MemTraceSource src(longCsv(lines, 100), 31);
+    TraceReader reader(src);
+    TraceReplay replay(reader);
+    CHECK(reader.restart());
+    reader.fill();
+
+    DisplayData d = blank();
+    d.laps = 3;
+    const uint32_t t0 = 70000;
+    replay.start(10, t0);
+    for (uint32_t now = t0; replay.update(now, &d); now++) {
+        reader.fill();
+        uint32_t due = (now - t0) / 10;
+        CHECK_EQ(d.rpms, due < lines ? due : lines - 1);
+        CHECK_EQ(d.laps, 3);
+        CHECK(now - t0 <= lines * 10);
+    }
+    CHECK_EQ(d.rpms, lines - 1);
+    CHECK(!replay.active());
+
+    // Speeds out of range are clamped to 1x and TRACE_SPEED_MAX
+    static const struct { uint8_t asked, runs_ms; } speeds[] = {
+        { 0, 100 }, { 1, 100 }, { 200, 1 },
+    };
+    for (const auto &s : speeds) {
+        CHECK(reader.restart());
+        reader.fill();
+        d = blank();
+        replay.start(s.asked, 0);
+        CHECK(replay.update(0, &d));
+        CHECK_EQ(d.rpms, 0);
+        replay.update(s.runs_ms - 1, &d);
+        CHECK_EQ(d.rpms, 0);
+        replay.update(s.runs_ms, &d);
+        CHECK_EQ(d.rpms, 1);
+    }
+}
+
+int main()
+{
+    csv();
+    binary();
+    underrun();
+    replay();
+    return 0;
+}
@@ -0,0 +1,226 @@
+// TxScheduler on a virtual microsecond clock, driven the way the sim's
+// TX task drives it: run every due task, charge what it wrote, sleep for
+// idleUs() and wake a little late. The task set, periods and frame sizes
+// are the sim's at BAUD_BASE, with the stress sweep driving CMD_GRAPH at
+// 500 Hz, so the link is almost always busy. Checks that CMD_FAST keeps
+// its period to within a millisecond, that a release held by the byte
+// budget counts as deferred once, and that a full task table refuses
+// the next add(). Then the sim polls displays as on a bus, which takes
+// the link past what it carries: the budget holds releases back and
+// CMD_FAST still runs every period. Last, sampling falls behind for
+// good, and the TX task must still block now and then so the idle task
+// runs.
+
+#include <stdint.h>
+#include <string.h>
+#include "check.h"
+#include "telemetry_codec.h"
+#include "tx_scheduler.h"
+
+// As in esp32-telemetry-sim/src/main.cpp
+enum {
+    TX_SAMPLE,
+    TX_INPUT,
+    TX_GENERATE,
+    TX_FAST,
+    TX_AWARENESS,
+    TX_GRAPH,
+    TX_HEARTBEAT,
+    TX_KEYFRAME,
+    TX_POLL,        // Bus only
+    TX_TASK_COUNT
+};
+
+// As in the sim's TX TASK section, on a 1 kHz FreeRTOS tick
+#define TX_MAX_SLEEP_US    1000
+#define TX_MAX_BUSY_PASSES 8
+#define TICK_US            1000
+
+#define WAKE_LATE_US 150   // Timer ISR and context switch, at most
+#define RUN_US       20    // One task's work
+#define RUN_S        30
+#define STRESS_HZ    500
+#define BUS_POLL_MS  10    // As the sim on a bus
+
+static uint32_t rng_state = 88172645u;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+static size_t wireSize(uint8_t cmd)
+{
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    return frame_size(telemetry_encode(&d, cmd, payload), FRAMING_CRC);
+}
+
+// ===== SIM TX SIDE =====
+static TxScheduler sched(BAUD_BASE / 10);
+static uint32_t now_us;
+static size_t fast_bytes, frag_bytes;
+static uint32_t fast_runs;
+static uint64_t bytes;
+static uint32_t sample_us = RUN_US;   // What one TX_SAMPLE costs
+
+static void charge(size_t n)
+{
+    sched.charge(n, now_us);
+    bytes += n;
+}
+
+// As txPass(): due tasks, at most TX_TASK_COUNT, each taking its time
+static void txPass()
+{
+    int run;
+    for (uint8_t released = 0; released < TX_TASK_COUNT && (run = sched.next(now_us)) >= 0;
+         released++) {
+        switch (run) {
+            case TX_FAST:
+                charge(fast_bytes + (fast_runs++ % 2 ? frag_bytes : 0));
+                break;
+            case TX_AWARENESS:
+                charge(wireSize(CMD_AWARENESS));
+                break;
+            case TX_GRAPH:
+                charge(wireSize(CMD_GRAPH));
+                break;
+            case TX_HEARTBEAT:
+                charge(wireSize(CMD_HEARTBEAT));
+                break;
+            case TX_POLL:
+                charge(frame_size(ADDR_LEN, FRAMING_CRC));
+                break;
+        }
+        now_us += run == TX_SAMPLE ? sample_us : RUN_US;
+    }
+}
+
+typedef struct {
+    uint32_t forced_ticks;   // Blocked although behind
+    uint32_t busy_max_us;    // Longest stretch without blocking
+} TxTaskRun;
+
+// As txTask(): sleeps until the next release and wakes a little late,
+// but blocks a tick after TX_MAX_BUSY_PASSES passes that found it behind
+static TxTaskRun txTask(uint32_t until_us)
+{
+    TxTaskRun r = {};
+    uint8_t busy_passes = 0;
+    uint32_t awake_us = now_us;
+    while (now_us < until_us) {
+        txPass();
+        uint32_t wait = sched.idleUs(now_us);
+        if (wait == 0) {
+            if (++busy_passes < TX_MAX_BUSY_PASSES) continue;
+            busy_passes = 0;
+            wait = TICK_US;
+            r.forced_ticks++;
+        } else {
+            busy_passes = 0;
+            if (wait > TX_MAX_SLEEP_US) wait = TX_MAX_SLEEP_US;
+            wait += rnd(WAKE_LATE_US + 1);
+        }
+        if (now_us - awake_us > r.busy_max_us) r.busy_max_us = now_us - awake_us;
+        now_us += wait;
+        awake_us = now_us;
+    }
+    return r;
+}
+
+int main()
+{
+    // A full table refuses the next task instead of writing past it
+    TxScheduler full;
+    for (uint8_t i = 0; i < TX_MAX_TASKS; i++) CHECK_EQ(full.add(1000, 0), i);
+    CHECK_EQ(full.add(1000, 0), TX_NO_TASK);
+    for (int i = 0; i < 100; i++) CHECK(full.next(5000) < TX_MAX_TASKS);
+
+    // A release held by the budget is one deferral, however many times
+    // the caller asks before the link drains
+    TxScheduler held(BAUD_BASE / 10);
+    uint8_t task = held.add(10000, 0);
+    held.charge(4 * TX_BACKLOG_BYTES, 0);
+    for (uint32_t t = 0; t < 5000; t += 10) CHECK_EQ(held.next(t), -1);
+    CHECK_EQ(held.stats(task).deferred, 1);
+    uint32_t t = held.idleUs(5000) + 5000;
+    CHECK_EQ(held.next(t), task);
+    CHECK_EQ(held.stats(task).deferred, 1);
+
+    // The sim's task set
+    sched.add(1000, now_us + 1000, false);                 // TX_SAMPLE
+    sched.add(5000, now_us, false);                        // TX_INPUT
+    sched.add(10000, now_us, false);                       // TX_GENERATE
+    sched.add(CMD_FAST_PERIOD_MS * 1000, now_us);          // TX_FAST
+    sched.add(CMD_AWARENESS_PERIOD_MS * 1000, now_us);     // TX_AWARENESS
+    sched.add(1000000 / STRESS_HZ, now_us);                // TX_GRAPH, stressed
+    sched.add(CMD_HEARTBEAT_PERIOD_MS * 1000, now_us);     // TX_HEARTBEAT
+    sched.add(500000, now_us, false);                      // TX_KEYFRAME
+    sched.add(0, now_us);                                  // TX_POLL, off a bus
+
+    // The CMD_SAMPLES batch goes out with each FAST frame, and a
+    // message fragment with every other one, as while a message is queued
+    SampleBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.count = 10;   // SAMPLE_BATCH
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    fast_bytes = wireSize(CMD_FAST) + frame_size(samples_encode(&batch, payload), FRAMING_CRC);
+    frag_bytes = FRAME_HEADER_LEN + MSG_FRAG_HEADER_LEN + MSG_FRAG_TEXT + FRAME_CRC_LEN;
+
+    TxTaskRun r = txTask(RUN_S * 1000000u);
+    const TxTaskStats &fast = sched.stats(TX_FAST);
+    CHECK(fast.runs >= RUN_S * 1000 / CMD_FAST_PERIOD_MS - 1);
+    CHECK_EQ(fast.skipped, 0);
+    CHECK(sched.jitterUs(TX_FAST) < 1000);
+    CHECK(fast.late_max_us < 1000);
+    CHECK_EQ(r.forced_ticks, 0);   // Never behind, never made to block
+    uint32_t deferred = 0;
+    for (uint8_t i = TX_FAST; i <= TX_HEARTBEAT; i++) {
+        deferred += sched.stats(i).deferred;
+        CHECK(sched.stats(i).deferred <= sched.stats(i).runs);
+    }
+    printf("link %llu%% busy; fast: %u runs, jitter %u us, late max %u us; "
+           "%u releases held by the budget\n",
+           (unsigned long long)(bytes * 100 / (RUN_S * (BAUD_BASE / 10))),
+           fast.runs, sched.jitterUs(TX_FAST), fast.late_max_us, deferred);
+
+    // On a bus: a CMD_POLL every BUS_POLL_MS as well, more than the link
+    // carries. The budget holds releases back rather than let the UART
+    // queue grow, and CMD_FAST gets its frame out every period regardless.
+    sched.setPeriod(TX_POLL, BUS_POLL_MS * 1000);
+    sched.resetStats();
+    bytes = 0;
+    r = txTask(now_us + 5000000u);
+    const TxTaskStats &poll = sched.stats(TX_POLL);
+    deferred = 0;
+    for (uint8_t i = TX_FAST; i < TX_TASK_COUNT; i++) deferred += sched.stats(i).deferred;
+    CHECK(deferred > 0);
+    CHECK_EQ(fast.skipped, 0);
+    CHECK(fast.runs >= 5000 / CMD_FAST_PERIOD_MS - 1);
+    CHECK(poll.runs >= 5000 / BUS_POLL_MS - 1);
+    CHECK_EQ(r.forced_ticks, 0);
+    printf("on a bus: link %llu%% busy; fast: %u runs, jitter %u us, late max %u us; "
+           "%u polls, %u releases held by the budget\n",
+           (unsigned long long)(bytes * 100 / (5 * (BAUD_BASE / 10))), fast.runs,
+           sched.jitterUs(TX_FAST), fast.late_max_us, poll.runs, deferred);
+
+    // Sampling falls behind: each step outlasts its 1 ms period, so it is
+    // due again after every run and the pass never ran dry. Now a pass
+    // ends after TX_TASK_COUNT releases, the task blocks a tick after
+    // TX_MAX_BUSY_PASSES of them, and the frames keep going meanwhile.
+    sample_us = 1200;
+    sched.resetStats();
+    r = txTask(now_us + 5000000u);
+    CHECK(r.forced_ticks > 0);
+    CHECK(r.busy_max_us <= TX_MAX_BUSY_PASSES * TX_TASK_COUNT * sample_us);
+    CHECK(sched.stats(TX_FAST).runs >= 5000 / CMD_FAST_PERIOD_MS / 2);
+    printf("sampling behind: %u ticks given up, at most %u us without blocking, "
+           "fast %u runs, jitter %u us\n", r.forced_ticks, r.busy_max_us,
+           sched.stats(TX_FAST).runs, sched.jitterUs(TX_FAST));
+    return 0;
+}
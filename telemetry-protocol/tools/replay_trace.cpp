@@ -0,0 +1,85 @@
+// Replays a trace (trace_replay.h) on the host the way the sim's "replay"
+// console command does: a loader thread keeps the TraceReader's buffers
+// full from a file or stdin, the main thread runs TraceReplay at the given
+// speed in real time and sends the telemetry as the sim's periodic frames,
+// CRC framed as on the boot configuration. The frames go to out, which can
+// be a pty or serial device the display or a host tool reads, or stdout.
+// How the replay went is printed to stderr at the end.
+//
+//   replay_trace [speed] [trace] [out]     defaults 1, stdin and stdout
+//
+//   vehicle_trace 60 | replay_trace 10 - /dev/pts/3
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "trace_replay.h"
+
+#define LOAD_SLEEP_MS 1   // As loop() on the sim between fills
+
+int main(int argc, char **argv)
+{
+    int speed = argc > 1 ? atoi(argv[1]) : 1;
+    speed = speed < 1 ? 1 : speed > TRACE_SPEED_MAX ? TRACE_SPEED_MAX : speed;
+    FILE *in = stdin, *out = stdout;
+    if (argc > 2 && strcmp(argv[2], "-") != 0 && !(in = fopen(argv[2], "rb"))) {
+        perror(argv[2]);
+        return 1;
+    }
+    if (argc > 3 && !(out = fopen(argv[3], "wb"))) {
+        perror(argv[3]);
+        return 1;
+    }
+
+    FileTraceSource source(in);
+    TraceReader reader(source);
+    TraceReplay replay(reader);
+    reader.restart();   // Can't rewind a pipe, but nothing was read from it yet
+    reader.fill();
+
+    std::atomic<bool> done(false);
+    std::thread loader([&] {
+        while (!done && reader.fill()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOAD_SLEEP_MS));
+        }
+    });
+
+    static const struct { uint8_t cmd; uint32_t period_ms; } schedule[] = {
+        { CMD_FAST,      CMD_FAST_PERIOD_MS },
+        { CMD_AWARENESS, CMD_AWARENESS_PERIOD_MS },
+        { CMD_GRAPH,     CMD_GRAPH_PERIOD_MS },
+        { CMD_HEARTBEAT, CMD_HEARTBEAT_PERIOD_MS },
+    };
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    uint32_t frames = 0;
+    uint32_t tick;
+    auto t0 = std::chrono::steady_clock::now();
+    replay.start(speed, 0);
+    for (tick = 0;; tick++) {
+        std::this_thread::sleep_until(t0 + std::chrono::milliseconds(tick));
+        if (!replay.update(tick, &d)) break;
+        for (const auto &s : schedule) {
+            if (tick % s.period_ms) continue;
+            uint8_t payload[FRAME_MAX_PAYLOAD];
+            uint8_t wire[FRAME_MAX_WIRE];
+            size_t n = frame_encode(wire, s.cmd, payload,
+                                    telemetry_encode(&d, s.cmd, payload), FRAMING_CRC);
+            fwrite(wire, 1, n, out);
+            frames++;
+        }
+        fflush(out);
+    }
+    done = true;
+    loader.join();
+
+    const TraceStats &st = reader.stats();
+    fprintf(stderr, "replayed %u records at %dx in %.1f s: %u frames, %u bad, %u underruns\n",
+            st.records, speed, tick / 1000.0, frames, st.bad, st.underruns);
+    if (in != stdin) fclose(in);
+    if (out != stdout) fclose(out);
+    return 0;
+}
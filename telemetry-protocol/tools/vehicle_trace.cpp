@@ -0,0 +1,78 @@
+// Runs the sim's VehicleModel off-target over a scripted lap and writes
+// the telemetry as a trace CSV (trace_replay.h), one line per FAST
+// period. The result replays on the sim like a recorded run, or feeds
+// the host benchmarks with correlated, slowly varying values.
+//
+//   vehicle_trace [seconds] [out.csv]     defaults 600 and stdout
+//
+// The driver works through LAP_SEGMENTS, chasing each segment's speed
+// until it has covered the segment's length, like a throttle held
+// through a straight and lifted for a corner.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vehicle_model.h"
+
+// As in esp32-telemetry-sim/src/main.cpp
+#define SAMPLE_INTERVAL_MS 1
+#define WHEEL_R_M          0.5f
+#define RPM_K              2.65f
+
+typedef struct {
+    float length_m;
+    float target_kmh;
+} LapSegment;
+
+// A 1.2 km lap: long straight, hairpin, two fast bends
+static const LapSegment lap[] = {
+    { 400.0f, 55.0f },
+    { 80.0f,  20.0f },
+    { 250.0f, 45.0f },
+    { 120.0f, 32.0f },
+    { 300.0f, 50.0f },
+    { 50.0f,  25.0f },
+};
+#define LAP_SEGMENTS (sizeof(lap) / sizeof(lap[0]))
+
+int main(int argc, char **argv)
+{
+    uint32_t seconds = argc > 1 ? atoi(argv[1]) : 600;
+    FILE *out = stdout;
+    if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    VehicleParams p = VEHICLE_DEFAULTS;
+    p.wheel_r_m = WHEEL_R_M;
+    p.rpm_scale = RPM_K;
+    VehicleModel vehicle(p);
+
+    DisplayData d;
+    memset(&d, 0, sizeof(d));
+    fprintf(out, "t_ms,rpms,velocity,laps,consumption,efficiency,battery_voltage,current_amps\n");
+
+    size_t segment = 0;
+    float covered_m = 0.0f;
+    const float dt_s = SAMPLE_INTERVAL_MS / 1000.0f;
+    for (uint32_t t_ms = 0; t_ms <= seconds * 1000; t_ms += SAMPLE_INTERVAL_MS) {
+        vehicle.step(lap[segment].target_kmh, dt_s);
+        covered_m += vehicle.velocityKmh() / 3.6f * dt_s;
+        if (covered_m >= lap[segment].length_m) {
+            covered_m -= lap[segment].length_m;
+            if (++segment == LAP_SEGMENTS) {
+                segment = 0;
+                d.laps++;
+            }
+        }
+
+        if (t_ms % CMD_FAST_PERIOD_MS) continue;
+        vehicle.telemetry(&d);
+        fprintf(out, "%u,%u,%.1f,%u,%.2f,%.1f,%.2f,%.2f\n", t_ms, d.rpms, d.velocity,
+                d.laps, d.consumption, d.efficiency, d.battery_voltage, d.current_amps);
+    }
+
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -29,6 +29,10 @@ extern uint32_t elyos_screen_height;
 extern lv_disp_draw_buf_t elyos_draw_buf;
 extern lv_disp_drv_t elyos_disp_drv;
 
+/* Called after the last flush of each LVGL refresh, i.e. once the
+ * frame is fully on the panel. NULL to disable. */
+extern void (*elyos_flush_done_cb)(void);
+
 /* ---------- Public API ---------- */
 void elyos_display_init(void);
 void elyos_lvgl_init(void);
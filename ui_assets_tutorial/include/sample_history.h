@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ---------- Time-indexed sample history ----------
+ * The last N samples of one signal, each with the local millis() it was
+ * taken at. Samples are numbered from the first one ever pushed, so a
+ * consumer remembers the count() it has seen and reads on from there;
+ * anything older than N samples back is gone. Single task only.
+ */
+template <typename T, size_t N>
+class SampleHistory
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    struct Sample {
+        uint32_t t_ms;
+        T value;
+    };
+
+    void push(uint32_t t_ms, const T &value)
+    {
+        Sample &s = _samples[_count & (N - 1)];
+        s.t_ms = t_ms;
+        s.value = value;
+        _count++;
+    }
+
+    /* Total samples ever pushed; the newest is number count() - 1 */
+    uint32_t count() const { return _count; }
+
+    /* Oldest sample number still held */
+    uint32_t first() const { return _count > N ? _count - N : 0; }
+
+    /* Sample number i, which must lie in [first(), count()) */
+    const Sample &at(uint32_t i) const { return _samples[i & (N - 1)]; }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    Sample _samples[N];
+    uint32_t _count = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+/* ---------- Single producer / single consumer ring ----------
+ * Wait-free queue between exactly one writer and one reader, e.g. the
+ * UART RX task on core 0 and the LVGL loop on core 1. N must be a power
+ * of two; one slot is never used so head == tail always means empty.
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    /* Producer side. Returns false (and drops item) when full. */
+    bool push(const T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & (N - 1);
+        if (next == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side. Returns false when empty. */
+    bool pop(T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[tail];
+        _tail.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    /* Approximate when called from either side while the other runs. */
+    size_t size() const
+    {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return (head - tail) & (N - 1);
+    }
+
+    static constexpr size_t capacity() { return N - 1; }
+
+private:
+    /* Separate cache lines so producer and consumer don't false share */
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+    T _items[N];
+};
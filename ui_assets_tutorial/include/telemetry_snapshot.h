@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/* ---------- Latest-value-wins snapshot (seqlock) ----------
+ * One writer publishes complete versions of T, any number of readers copy
+ * out the newest consistent one. Neither side ever blocks.
+ *
+ * The sequence counter is 2*v while version v is stable and 2*v+1 while
+ * version v+1 is being written. Versions alternate between two buffers,
+ * so the writer only touches the buffer a reader is copying from once it
+ * starts the version after next; readers practically never retry.
+ *
+ * Each version also records, per field bit, the version it last changed
+ * in, so a reader that skipped several versions still gets the exact set
+ * of fields that differ from what it saw last.
+ */
+template <typename T, unsigned NFIELDS>
+class TelemetrySnapshot
+{
+    static_assert(NFIELDS <= 32, "changed mask is 32 bits wide");
+
+public:
+    /* Writer side. changed holds one bit per field that differs from
+     * the previously published version. */
+    void publish(const T &data, uint32_t changed)
+    {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        uint32_t next = (seq >> 1) + 1;
+
+        for (unsigned i = 0; i < NFIELDS; i++) {
+            if (changed & (1u << i)) {
+                _field_ver[i] = next;
+            }
+        }
+
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Version &v = _buf[next & 1];
+        v.data = data;
+        for (unsigned i = 0; i < NFIELDS; i++) {
+            v.field_ver[i] = _field_ver[i];
+        }
+
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /* Reader side. Copies the newest version into out and returns the
+     * mask of fields changed since *last_version, which is then advanced.
+     * Returns 0 without touching out when nothing new was published. */
+    uint32_t read(T &out, uint32_t *last_version)
+    {
+        for (;;) {
+            uint32_t s1 = _seq.load(std::memory_order_acquire);
+            uint32_t ver = s1 >> 1;
+            if (ver == *last_version) {
+                return 0;
+            }
+
+            const Version &v = _buf[ver & 1];
+            T copy = v.data;
+            uint32_t changed = 0;
+            for (unsigned i = 0; i < NFIELDS; i++) {
+                if (v.field_ver[i] > *last_version) {
+                    changed |= 1u << i;
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t s2 = _seq.load(std::memory_order_relaxed);
+
+            // Our buffer is only rewritten once version ver + 2 starts
+            if (s2 - (s1 & ~1u) < 3) {
+                out = copy;
+                *last_version = ver;
+                return changed;
+            }
+        }
+    }
+
+    uint32_t version() const { return _seq.load(std::memory_order_acquire) >> 1; }
+
+private:
+    struct Version {
+        T data;
+        uint32_t field_ver[NFIELDS];
+    };
+
+    std::atomic<uint32_t> _seq{0};
+    Version _buf[2] = {};
+    uint32_t _field_ver[NFIELDS] = {};   // Writer-private
+};
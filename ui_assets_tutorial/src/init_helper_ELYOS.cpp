@@ -10,6 +10,8 @@ static lv_color_t elyos_disp_buf[ELYOS_WIDTH * ELYOS_HEIGHT / 15];
 lv_disp_draw_buf_t elyos_draw_buf;
 lv_disp_drv_t elyos_disp_drv;
 
+void (*elyos_flush_done_cb)(void) = NULL;
+
 uint32_t elyos_screen_width;
 uint32_t elyos_screen_height;
 
@@ -87,6 +89,10 @@ static void elyos_disp_flush(lv_disp_drv_t *disp,
     lcd.pushImageDMA(area->x1, area->y1, w, h,
                      (lgfx::rgb565_t *)&color_p->full);
     lcd.waitDMA();              // SCREEN TEARING AVOID ?
+
+    if (elyos_flush_done_cb && lv_disp_flush_is_last(disp)) {
+        elyos_flush_done_cb();
+    }
     lv_disp_flush_ready(disp);
 }
 
@@ -1,91 +1,445 @@
 #include <Arduino.h>
 #include "init_helper_ELYOS.h"
 #include "ui.h"
+#include "spsc_queue.h"
+#include "telemetry_snapshot.h"
+#include "sample_history.h"
+#include "telemetry_protocol.h"
+#include "frame_parser.h"
+#include "telemetry_codec.h"
+#include "telemetry_dispatch.h"
+#include "clock_sync.h"
+#include "latency_trace.h"
+#include "command_link.h"
+#include "baud_negotiator.h"
+#include "handshake.h"
+#include "uart_transport.h"
+#include "twai_bus.h"
+#include "polled_transport.h"
+#include "message_board.h"
+#include <Preferences.h>
 #include <stdlib.h>
 
 // ================= UART CONFIG =================
 #define DISPLAY_RX_PIN 44
 #define DISPLAY_TX_PIN 43
 #define DISPLAY_UART   1
-#define BAUDRATE       115200
-
+#define BAUDRATE       BAUD_BASE   // Boot rate, see BAUD_NEGOTIATION
+
+// Set to 1 to take telemetry off the CAN bus (a transceiver on the UART
+// pins) instead of the UART; must match esp32-telemetry-sim
+#define TELEMETRY_LINK_CAN 0
+#define CAN_BITRATE        1000000
+
+// Set to 1 to share the simulator with other displays on an RS-485 style
+// bus (TELEMETRY_BUS in esp32-telemetry-sim). We then decode only
+// BUS_GROUPS and transmit only when polled, driving the transceiver's
+// DE input from BUS_DE_PIN.
+#define TELEMETRY_BUS 0
+#define BUS_NODE_ID   1      // 1..BUS_NODES of the sim, unique per display
+#define BUS_GROUPS    (GROUP_FAST | GROUP_AWARENESS | GROUP_GRAPH | GROUP_STATUS)
+#define BUS_DE_PIN    18
+#define BUS_POLL_MS   10     // Must match the sim
+// Leave a quarter of the slot for the poll's own delivery
+#define BUS_SLOT_BYTES (BAUDRATE / 10 * BUS_POLL_MS / 1000 * 3 / 4)
+#define BUS_ADDR      (TELEMETRY_BUS ? BUS_NODE_ID : ADDR_NONE)
+
+// Set to 0 to stay at BAUDRATE instead of negotiating up to baud_rates[]
+#define BAUD_NEGOTIATION (!TELEMETRY_LINK_CAN && !TELEMETRY_BUS)
+
+// Set to 0 to stop sending CMD_LOAD and CMD_RX_STATS, i.e. no backpressure
+// on the simulator and nothing for its stress mode to measure
+#define LOAD_REPORTS 1
+
+// Set to 1 to ask the simulator for one CMD_SUPERFRAME per tick instead of
+// a frame per command: ~2% fewer bytes on the wire, but about twice the
+// decode time on the tick where every command is due (bench_superframe)
+#define TELEMETRY_SUPERFRAME 0
+
+// Set to 0 to forget the agreed link configuration across reboots
+// (it is then only reused on reconnects while powered)
+#define LINK_CONFIG_NVS 1
+
+// The UART driver ISR drains the 128 byte hardware FIFO into this ring
+// buffer, so a long lv_timer_handler() pass no longer overflows the FIFO.
+#define UART_RX_BUFFER_SIZE 4096
+#define UART_RX_CHUNK       256
+
+// RX state machine and decoder run in their own task, away from LVGL
+#define RX_TASK_CORE     0
+#define RX_TASK_PRIORITY 5
+#define RX_TASK_STACK    4096
+#define RX_QUEUE_LEN     64     // Decoded frames buffered for the UI loop
+#define SAMPLE_QUEUE_LEN 256    // CMD_SAMPLES values buffered for the UI loop
+#define VELOCITY_HISTORY 1024   // ~1 s of 1 kHz velocity samples
+
+// Set to 1 to print RX throughput over USB serial once per second
+#define RX_STATS_DEBUG 0
+
+// Set to 1 to measure per-command latency and loss of traced frames
+// (TELEMETRY_TRACE in esp32-telemetry-sim) and print it every 5 s
+#define TELEMETRY_TRACE 0
+#define TRACE_REPORT_MS 5000
+
+#if TELEMETRY_LINK_CAN
+static TwaiBus canBus(DISPLAY_TX_PIN, DISPLAY_RX_PIN, CAN_BITRATE);
+static CanTransport can(canBus);
+static Transport &simLink = can;
+
+// Everything else is dropped by the controller's acceptance filter
+static const uint8_t can_rx_cmds[] = {
+    CMD_FAST, CMD_AWARENESS, CMD_GRAPH, CMD_HEARTBEAT, CMD_MESSAGE,
+    CMD_DELTA, CMD_LAP_EVENT, CMD_SAMPLES, CMD_ACK, CMD_CAPS, CMD_MESSAGE_FRAG,
+};
+#elif TELEMETRY_BUS
 HardwareSerial DisplaySerial(DISPLAY_UART);
+static UartTransport uart(DisplaySerial);
+static PolledTransport polled(uart, BUS_SLOT_BYTES);
+static Transport &simLink = polled;
+#else
+HardwareSerial DisplaySerial(DISPLAY_UART);
+static UartTransport uart(DisplaySerial);
+static Transport &simLink = uart;   // All protocol I/O goes through this
+#endif
 
 // ================= PROTOCOL =================
-#define SYNC_BYTE 0xAA
-
-#define CMD_FAST       0x01
-#define CMD_AWARENESS  0x02
-#define CMD_GRAPH      0x03
-#define CMD_HEARTBEAT  0x04
-#define CMD_MESSAGE    0x05
-
-// ================= MESSAGE =================
-typedef enum {
-  IDLE_MSG,
-  RESET_MSG,
-  CUSTOM_MSG,
-} Message;
-Message sent_message = IDLE_MSG;
+// SYNC_BYTE, CMD_* and the frame layout live in telemetry_protocol.h,
+// DisplayData, the FIELD_* masks and command payloads in telemetry_schema.h.
+// FRAMING_PLAIN, FRAMING_CRC or FRAMING_COBS; must match esp32-telemetry-sim.
+// Only the boot configuration: the handshake switches both ends to the
+// best framing they share, and back here whenever the link is lost.
+// CAN checks frames itself and only carries FRAMING_PLAIN.
+#if TELEMETRY_LINK_CAN
+#define TELEMETRY_FRAMING FRAMING_PLAIN
+#else
+#define TELEMETRY_FRAMING FRAMING_CRC
+#endif
+
+static Framing link_framing = TELEMETRY_FRAMING;   // Owned by the UI loop
+static volatile int rx_framing_req = -1;           // For the RX task, -1 = none
 
 // ================= DATA STRUCT =================
-typedef struct {
-    float battery_voltage;  // 22.0 to 26.0 Volts
-    float current_amps;     // 7.0 to 10.0 Amps
-    uint8_t laps;           // Lap counter
-    float consumption;      //120.0 to 150.0 kWh
-    float efficiency;       //160.0 to 200.0 km/kWh
-    uint16_t rpms;          //Allows for 0 to 999 with no issue
-    float velocity;         //0 to 99.9
-    uint8_t tx_message;     //Type of message recieved (0-2)
-} DisplayData;
-DisplayData received_data = {0};
-
-// ================= RX STATE MACHINE =================
-enum RxState {
-    WAIT_SYNC,
-    WAIT_CMD,
-    WAIT_LEN,
-    WAIT_PAYLOAD
-};
-RxState rxState = WAIT_SYNC;
+// Written only by the RX task, published whole through telemetry
+static DisplayData rx_data = {0};
+static uint32_t    rx_changed = 0;
+static TelemetrySnapshot<DisplayData, FIELD_COUNT> telemetry;
 
-uint8_t rxCmd = 0;
-uint8_t rxLen = 0;
-uint8_t rxIndex = 0;
-uint8_t rxBuffer[32];
+// The UI's consistent copy, refreshed from telemetry once per loop
+static DisplayData received_data = {0};
+static uint32_t    received_version = 0;
 
-// ================= MESSAGE RECEIVER ===========
-#define MAX_CUSTOM_MSG_LEN 32
+// ================= RX STATS =================
+typedef struct {
+    uint32_t bytes;          // Bytes pulled from the driver ring buffer
+    uint32_t decode_us;      // Time spent in parser and decoder
+    uint32_t records;        // Commands decoded, superframe records included
+    uint32_t overflows;      // Times the ring buffer was found full
+    uint32_t queue_drops;    // Decoded frames lost because the UI fell behind
+    uint32_t sample_drops;   // CMD_SAMPLES values lost the same way
+    uint32_t backlog_max;    // Most bytes seen waiting, since the last CMD_LOAD
+    uint32_t probes;         // Intact CMD_PROBE frames
+    uint32_t probe_errors;   // CMD_PROBE frames with a wrong pattern
+    uint32_t not_ours;       // Bus frames for other nodes or groups
+} RxStats;
+RxStats rxStats = {0};
+static uint32_t rx_chunk_us = 0;   // micros() when the chunk being parsed was read
 
-static char custom_msg_buf[MAX_CUSTOM_MSG_LEN + 1];
+// ================= MESSAGE RECEIVER ===========
+// Reassembles CMD_MESSAGE_FRAG and decides which message is on screen
+static MessageBoard messages;
 static uint8_t last_message_type = 0xFF;   // force first update
 static bool message_dirty = false;
 
+// ================= DECODED FRAMES =================
+// Event frames that must not be coalesced, e.g. custom message text.
+// Produced by the RX task, consumed by the UI loop through rxQueue
+typedef struct {
+    uint8_t cmd;
+    union {
+        char message[MAX_CUSTOM_MSG_LEN + 1];
+        struct { uint8_t lap; uint32_t start_ms; } lap;   // start on our clock
+        uint8_t ack[ACK_LEN];                              // CMD_ACK payload
+        struct {
+            uint8_t len;
+            uint8_t data[CAPS_HEADER_LEN + CAPS_MAX_LIMITS * 3];
+        } caps;                                            // CMD_CAPS payload
+        struct {
+            uint8_t len;
+            uint8_t data[MSG_FRAG_HEADER_LEN + MSG_FRAG_TEXT];
+        } frag;                                            // CMD_MESSAGE_FRAG payload
+    };
+} DecodedFrame;
+
+static SpscQueue<DecodedFrame, RX_QUEUE_LEN> rxQueue;
+
+// High-rate velocity (0.1 km/h) from CMD_SAMPLES, stamped on our clock.
+// The RX task queues them, the UI loop moves them into velocityHistory
+// for the arc and anything else that wants more than one value per frame
+typedef struct {
+    uint32_t t_ms;
+    int16_t  v10;
+} VelocitySample;
+
+static SpscQueue<VelocitySample, SAMPLE_QUEUE_LEN> sampleQueue;
+static SampleHistory<int16_t, VELOCITY_HISTORY> velocityHistory;
+static TaskHandle_t rxTaskHandle = NULL;
+
+// ================= COMMAND UPLINK =================
+// Commands to the simulator (reset, ping, set-rate), retransmitted until
+// acked. Owned by the UI loop; acks reach it through rxQueue.
+#if TELEMETRY_BUS
+#define CMD_ACK_TIMEOUT_MS (50 + BUS_POLL_MS * BUS_MAX_NODES)   // Waits for our poll
+#else
+#define CMD_ACK_TIMEOUT_MS 50
+#endif
+#define CMD_MAX_TRIES      5
+
+static uint32_t last_uplink_ms = 0;   // Newest frame to the simulator, for the keepalive
+
+static void uplinkWrite(const uint8_t *data, size_t len, void *ctx)
+{
+    simLink.write(data, len);
+    last_uplink_ms = millis();
+}
+
+static CommandLink cmdLink(TELEMETRY_FRAMING, uplinkWrite, NULL,
+                           CMD_ACK_TIMEOUT_MS, CMD_MAX_TRIES);
+
+// ================= LOAD REPORTS =================
+// How far behind we are, sent every LOAD_REPORT_MS so the simulator can
+// shed rate before data on screen goes stale
+static uint32_t lvgl_busy_us = 0;   // In lv_timer_handler() since the last report
+static uint32_t lvgl_passes  = 0;   // lv_timer_handler() calls, likewise
+static uint32_t lvgl_max_us  = 0;   // Longest of them
+static uint32_t loop_gap_max_us = 0;   // Longest between two loop() passes
+
+#if LOAD_REPORTS
+static uint8_t queue_pct(size_t size, size_t capacity)
+{
+    return (uint8_t)(size * 100 / capacity);
+}
+
+static void sendLoadReport(uint32_t elapsed_ms)
+{
+    LoadReport r;
+    uint32_t backlog = rxStats.backlog_max;
+    r.backlog = backlog > UINT16_MAX ? UINT16_MAX : backlog;
+
+    r.queue_pct = queue_pct(rxQueue.size(), rxQueue.capacity());
+    uint8_t samples = queue_pct(sampleQueue.size(), sampleQueue.capacity());
+    if (samples > r.queue_pct) r.queue_pct = samples;
+
+    uint32_t budget = elapsed_ms ? lvgl_busy_us / 10 / elapsed_ms : 0;   // us -> % of ms
+    r.budget_pct = budget > 100 ? 100 : budget;
+
+    uint8_t payload[LOAD_LEN];
+    uint8_t wire[FRAME_MAX_WIRE];
+    uint8_t len = load_encode(&r, payload);
+    uplinkWrite(wire, frame_encode_addr(wire, BUS_ADDR, CMD_LOAD, payload, len, link_framing),
+                NULL);
+}
+
+// Whether or not a report went out, so the next one covers one period
+static void startLoadWindow(void)
+{
+    rxStats.backlog_max = 0;   // RX task may bump it meanwhile; harmless
+    lvgl_busy_us = 0;
+    lvgl_passes = 0;
+    lvgl_max_us = 0;
+    loop_gap_max_us = 0;
+}
+#endif
+
+// ================= BAUD NEGOTIATION =================
+static void linkSetBaud(uint32_t baud, void *ctx)
+{
+    simLink.setBaud(baud);
+    rx_framing_req = link_framing;   // RX task drops a partial frame from the old rate
+#if RX_STATS_DEBUG
+    Serial.printf("UART %lu baud\n", baud);
+#endif
+}
+
+static BaudNegotiator baudLink(cmdLink, linkSetBaud);
+
+// ================= HANDSHAKE =================
+// What this build decodes; the simulator answers CTRL_HELLO with its own
+static const Caps display_caps = {
+    PROTOCOL_VERSION,
+    FEAT_DELTA | FEAT_SAMPLES
+#if !TELEMETRY_LINK_CAN
+        | FEAT_CRC | FEAT_COBS
+#endif
+#if TELEMETRY_SUPERFRAME && !TELEMETRY_LINK_CAN
+        | FEAT_SUPERFRAME
+#endif
+        | FEAT_MSG_FRAG
+#if LOAD_REPORTS
+        | FEAT_LOAD | FEAT_RX_STATS
+#endif
+#if TELEMETRY_TRACE
+        | FEAT_TRACE
+#endif
+    ,
+    BAUD_NEGOTIATION ? baud_rates[0] : BAUDRATE,
+    0,
+};
+
+// Last agreed configuration, offered first on the next (re)connect
+static LinkConfig link_cache;
+static bool link_cache_valid = false;
+
+#if LINK_CONFIG_NVS
+static Preferences prefs;
+
+static void loadLinkConfig(void)
+{
+    prefs.begin("telemetry", true);
+    link_cache_valid = prefs.getBytes("link", &link_cache, sizeof(link_cache))
+                       == sizeof(link_cache);
+    prefs.end();
+}
+
+static void saveLinkConfig(void)
+{
+    prefs.begin("telemetry", false);
+    prefs.putBytes("link", &link_cache, sizeof(link_cache));
+    prefs.end();
+}
+#else
+static inline void loadLinkConfig(void) {}
+static inline void saveLinkConfig(void) {}
+#endif
+
+static void setFraming(Framing framing)
+{
+    link_framing = framing;
+    cmdLink.setFraming(framing);
+    rx_framing_req = framing;
+}
+
+// The simulator acked CTRL_CONFIGURE and switches as it sends the ack
+static void applyLinkConfig(const LinkConfig &cfg, void *ctx)
+{
+    setFraming((Framing)cfg.framing);
+
+    bool same = link_cache_valid && link_cache.caps_id == cfg.caps_id &&
+                link_cache.framing == cfg.framing &&
+                link_cache.features == cfg.features &&
+                link_cache.max_baud == cfg.max_baud;
+    if (!same) {
+        link_cache = cfg;
+        link_cache_valid = true;
+        saveLinkConfig();
+    }
+#if BAUD_NEGOTIATION
+    baudLink.start(millis(), cfg.max_baud);
+#endif
+#if TELEMETRY_BUS
+    uint8_t groups = BUS_GROUPS;
+    cmdLink.send(CTRL_SUBSCRIBE, &groups, SUBSCRIBE_ARGS_LEN, millis());
+#endif
+}
+
+static Handshake handshake(cmdLink, display_caps, applyLinkConfig);
+
+static void onCommandResult(uint8_t op, uint8_t status, uint32_t now_ms, void *ctx)
+{
+    baudLink.onResult(op, status, now_ms);
+    handshake.onResult(op, status, now_ms);
+}
+
 // ================= TIME BASE =================
 static uint32_t attempt_start_ms = 0;
 static uint32_t lap_start_ms     = 0;
 static uint8_t  last_laps        = 0;
 
+// Simulator millis() -> our millis(), fed by CMD_LAP_EVENT timestamps
+#define CLOCK_SYNC_WINDOW_MS 60000
+static ClockSync simClock(CLOCK_SYNC_WINDOW_MS);
+
+// ================= LATENCY TRACE =================
+#if TELEMETRY_TRACE
+// frame() runs on the RX task; the rest below belongs to the UI loop,
+// which follows each traced value until the flush that puts it on screen
+static LatencyTrace rxTrace;
+
+static uint32_t trace_seen_tx[TRACE_MAX_CMD];   // Newest frame already picked up
+static uint32_t trace_field_tx[FIELD_COUNT];    // Changed but not drawn yet
+static uint8_t  trace_field_cmd[FIELD_COUNT];
+static uint32_t trace_drawn_tx[TRACE_MAX_CMD];  // Drawn, waiting for a flush
+
+// After drainFrames(): note which frame brought each changed field.
+// Event frames are drawn as they are applied.
+static void trace_picked_up(uint32_t changed)
+{
+    for (uint8_t c = 0; c < TRACE_MAX_CMD; c++) {
+        uint32_t tx = rxTrace.lastTx(c);
+        if (tx == trace_seen_tx[c]) continue;
+        trace_seen_tx[c] = tx;
+
+        if (c == CMD_MESSAGE || c == CMD_LAP_EVENT) {
+            if (!trace_drawn_tx[c]) trace_drawn_tx[c] = tx;
+            continue;
+        }
+
+        uint32_t fields = (c == CMD_DELTA || c == CMD_SUPERFRAME)
+                              ? FIELD_ALL : telemetry_command_fields(c);
+        fields &= changed;
+        for (unsigned i = 0; i < FIELD_COUNT; i++) {
+            if ((fields & (1u << i)) && !trace_field_tx[i]) {
+                trace_field_tx[i]  = tx;
+                trace_field_cmd[i] = c;
+            }
+        }
+    }
+}
+
+// An update_* function just set the labels for fields
+static void trace_drawn(uint32_t fields)
+{
+    for (unsigned i = 0; i < FIELD_COUNT; i++) {
+        if (!(fields & (1u << i)) || !trace_field_tx[i]) continue;
+        uint8_t c = trace_field_cmd[i];
+        if (!trace_drawn_tx[c]) trace_drawn_tx[c] = trace_field_tx[i];
+        trace_field_tx[i] = 0;
+    }
+}
+
+// Last flush of an LVGL refresh: everything drawn so far is on screen
+static void trace_flushed(void)
+{
+    uint32_t now = micros();
+    for (uint8_t c = 0; c < TRACE_MAX_CMD; c++) {
+        if (trace_drawn_tx[c]) {
+            rxTrace.displayed(c, trace_drawn_tx[c], now);
+            trace_drawn_tx[c] = 0;
+        }
+    }
+}
+
+static void trace_print(const char *line)
+{
+    Serial.println(line);
+}
+#else
+static inline void trace_picked_up(uint32_t) {}
+static inline void trace_drawn(uint32_t) {}
+#endif
+
 // ================= UPDATE SCHEDULING =================
+// Arc low pass per 1 ms sample, same time constant as 0.18 per 10 ms update
+#define ARC_SAMPLE_ALPHA 0.0196f
+
 static uint32_t last_10ms_update  = 0;
 static uint32_t last_100ms_update = 0;
 static uint32_t last_2s_update    = 0;
 
-// ================= HELPERS =================
-float bytesToFloat(uint8_t *b) {
-    union {
-        float f;
-        uint8_t u8[4];
-    } v;
-    memcpy(v.u8, b, 4);
-    return v.f;
-}
-
-uint16_t bytesToU16(uint8_t *b) {
-    return (b[0] << 8) | b[1];
-}
+// Fields changed since each update_* last ran (all set to force first draw)
+static uint32_t changed_10ms  = FIELD_ALL;
+static uint32_t changed_100ms = FIELD_ALL;
 
+// ================= HELPERS =================
 static void format_time_mmsshh(uint32_t elapsed_ms, char *buf, size_t len)
 {
     uint32_t hundredths = (elapsed_ms / 10) % 100;
@@ -98,138 +452,362 @@ static void format_time_mmsshh(uint32_t elapsed_ms, char *buf, size_t len)
 }
 
 // ================= FRAME DECODER =================
-void decodeFrame(uint8_t cmd, uint8_t *buf, uint8_t len) {
+// Runs on the RX task: telemetry_dispatch() strips the prefixes, filters
+// and decodes; state frames update rx_data, event frames are queued here
+static void pushFrame(const DecodedFrame &f)
+{
+    if (!rxQueue.push(f)) {
+        rxStats.queue_drops++;
+    }
+}
 
+static void onEvent(uint8_t cmd, const uint8_t *buf, uint8_t len, void *ctx)
+{
+    DecodedFrame f;
+    f.cmd = cmd;
     switch (cmd) {
-
-        case CMD_FAST:
-            if (len == 6) {
-                received_data.rpms = bytesToU16(&buf[0]);
-                received_data.velocity = bytesToFloat(&buf[2]);
+        case CMD_MESSAGE:
+            if (len > 0 && len <= MAX_CUSTOM_MSG_LEN) {
+                memcpy(f.message, buf, len);
+                f.message[len] = '\0';   // null terminate
+                pushFrame(f);
             }
             break;
-
-        case CMD_AWARENESS:
-            if (len == 9) {
-                received_data.laps = buf[0];
-                received_data.consumption = bytesToFloat(&buf[1]);
-                received_data.efficiency  = bytesToFloat(&buf[5]);
+        case CMD_MESSAGE_FRAG:
+            if (len <= sizeof(f.frag.data)) {
+                f.frag.len = len;
+                memcpy(f.frag.data, buf, len);
+                pushFrame(f);
             }
             break;
-
-        case CMD_GRAPH:
-            if (len == 8) {
-                received_data.battery_voltage = bytesToFloat(&buf[0]);
-                received_data.current_amps    = bytesToFloat(&buf[4]);
+        case CMD_ACK:
+            if (len == ACK_LEN) {
+                memcpy(f.ack, buf, ACK_LEN);
+                pushFrame(f);
             }
             break;
-
-        case CMD_HEARTBEAT:
-            if (len == 1) {
-                received_data.tx_message = buf[0];
+        case CMD_CAPS:
+            if (len <= sizeof(f.caps.data)) {
+                f.caps.len = len;
+                memcpy(f.caps.data, buf, len);
+                pushFrame(f);
             }
             break;
+    }
+}
+
+static void onSamples(const SampleBatch *b, void *ctx)
+{
+    // The batch leaves right after its last sample: a clock sample too
+    uint32_t last_ms = b->start_ms + (b->count - 1) * b->interval_ms;
+    simClock.sample(last_ms, millis());
+
+    for (uint8_t i = 0; i < b->count; i++) {
+        VelocitySample s;
+        s.t_ms = simClock.toLocal(b->start_ms + i * b->interval_ms);
+        s.v10 = b->v[i];
+        if (!sampleQueue.push(s)) {
+            rxStats.sample_drops++;
+        }
+    }
+}
+
+static void onLapEvent(uint32_t src_ms, uint8_t lap, void *ctx)
+{
+    simClock.sample(src_ms, millis());
+    DecodedFrame f;
+    f.cmd = CMD_LAP_EVENT;
+    f.lap.lap = lap;
+    f.lap.start_ms = simClock.toLocal(src_ms);
+    pushFrame(f);
+}
+
+static void onProbe(bool ok, void *ctx)
+{
+    if (ok) rxStats.probes++;
+    else    rxStats.probe_errors++;
+}
+
+static void onNotOurs(void *ctx)
+{
+    rxStats.not_ours++;
+}
+
+static void onRecord(uint8_t cmd, void *ctx)
+{
+    rxStats.records++;   // Only records this node acts on
+}
+
+#if TELEMETRY_BUS
+static void onPoll(void *ctx)
+{
+    polled.grant();   // Our turn on the return line
+}
+#endif
+
+#if TELEMETRY_TRACE
+static void onTraced(uint8_t cmd, uint16_t seq, uint32_t tx_us, void *ctx)
+{
+    rxTrace.frame(cmd, seq, tx_us, rx_chunk_us, micros());
+}
+#endif
+
+// Publishes rx_data once per received burst (latest value wins)
+static void publishTelemetry(void)
+{
+    if (rx_changed) {
+        telemetry.publish(rx_data, rx_changed);
+        rx_changed = 0;
+    }
+}
+
+// Lap counter changed at start_ms (our clock): restart the lap timer,
+// start the attempt timer on lap 1, clear both on a reset (lap 0)
+static void start_lap(uint8_t laps, uint32_t start_ms)
+{
+    uint32_t now = millis();
+    if ((int32_t)(now - start_ms) < 0) start_ms = now;
+
+    last_laps = laps;
+    lap_start_ms = start_ms;
+
+    // First lap → reset full attempt timer
+    if (laps == 1) {
+        attempt_start_ms = start_ms;
+    }
+    // Reset button pressed
+    else if(laps == 0){
+        lv_label_set_text(ui_fullattemptLabel, "00:00.00");
+        lv_label_set_text(ui_laptimeLabel, "00:00.00");
+        attempt_start_ms = 0;
+        lap_start_ms = 0;
+    }
+
+    char buf[4];
+    snprintf(buf, sizeof(buf), "%u", laps);
+    lv_label_set_text(ui_lapsLabel, buf);
+}
+
+// Runs on the UI loop: applies a queued event frame
+static void applyFrame(const DecodedFrame *f)
+{
+    switch (f->cmd) {
         case CMD_MESSAGE:
-            if (len > 0 && len <= MAX_CUSTOM_MSG_LEN) {
-                memcpy(custom_msg_buf, buf, len);
-                custom_msg_buf[len] = '\0';   // null terminate
-                message_dirty = true;
+            messages.post(f->message, strlen(f->message), MSG_PRIO_NORMAL, millis());
+            break;
+        case CMD_MESSAGE_FRAG: {
+            MessageFragment frag;
+            if (msg_frag_decode(f->frag.data, f->frag.len, &frag)) {
+                messages.onFragment(frag, millis());
             }
             break;
+        }
+        case CMD_LAP_EVENT:
+            start_lap(f->lap.lap, f->lap.start_ms);
+            break;
+        case CMD_ACK:
+            cmdLink.onAck(f->ack, ACK_LEN, millis());
+            break;
+        case CMD_CAPS:
+            handshake.onCaps(f->caps.data, f->caps.len);   // Before its ack
+            break;
         default:
             break;
     }
 }
 
-// ================= UART POLLER =================
-void DisplayUART() {
-    while (DisplaySerial.available()) {
-        uint8_t byteIn = DisplaySerial.read();
-        switch (rxState) {
-            case WAIT_SYNC:
-                if (byteIn == SYNC_BYTE) {
-                    rxState = WAIT_CMD;
-                }
-                break;
-            case WAIT_CMD:
-                rxCmd = byteIn;
-                rxState = WAIT_LEN;
-                break;
-            case WAIT_LEN:
-                rxLen = byteIn;
-                rxIndex = 0;
-                if (rxLen > sizeof(rxBuffer)) {
-                    rxState = WAIT_SYNC; // invalid length
-                } else {
-                    rxState = WAIT_PAYLOAD;
-                }
-                break;
-            case WAIT_PAYLOAD:
-                rxBuffer[rxIndex++] = byteIn;
-                if (rxIndex >= rxLen) {
-                    decodeFrame(rxCmd, rxBuffer, rxLen);
-                    rxState = WAIT_SYNC;
-                }
-                break;
-        }    
-        if(button_aux){ //Trigger when button pressed TX
-            DisplaySerial.write(SYNC_BYTE);
-            button_aux = 0;
+// Takes one consistent telemetry copy and drains queued events.
+// Returns the fields that changed since the previous call.
+static uint32_t drainFrames(void)
+{
+    DecodedFrame f;
+    while (rxQueue.pop(f)) {
+        applyFrame(&f);
+    }
+    VelocitySample s;
+    while (sampleQueue.pop(s)) {
+        velocityHistory.push(s.t_ms, s.v10);
+    }
+    return telemetry.read(received_data, &received_version);
+}
+
+// ================= UART PARSER =================
+// Frame sync, length and CRC checks plus resync; hands frames to
+// telemetry_dispatch(), which calls the decoder above
+static TelemetryDispatch rxDispatch;
+
+static void onFrame(uint8_t cmd, const uint8_t *payload, uint8_t len, void *ctx)
+{
+    telemetry_dispatch(&rxDispatch, cmd, payload, len);
+}
+
+static FrameParser rxParser(TELEMETRY_FRAMING, onFrame);
+
+// Running totals the negotiator judges the current rate by
+static BaudLinkCounters linkCounters(void)
+{
+    const FrameParserStats &ps = rxParser.stats();
+    BaudLinkCounters c;
+    c.frames = ps.frames;
+    c.errors = ps.crc_errors + ps.resyncs + ps.bad_frames + rxStats.probe_errors;
+    c.probes = rxStats.probes;
+    return c;
+}
+
+#if LOAD_REPORTS
+// Before startLoadWindow(), which starts the next UI timing window
+static void sendRxStats(void)
+{
+    const FrameParserStats &ps = rxParser.stats();
+    RxStatsReport r;
+    r.records = rxStats.records;
+    r.errors = ps.crc_errors + ps.resyncs + ps.bad_frames;
+    r.drops = rxStats.overflows + rxStats.queue_drops + rxStats.sample_drops;
+
+    uint32_t avg = lvgl_passes ? lvgl_busy_us / lvgl_passes : 0;
+    r.ui_avg_us = avg > UINT16_MAX ? UINT16_MAX : avg;
+    r.ui_max_us = lvgl_max_us > UINT16_MAX ? UINT16_MAX : lvgl_max_us;
+    r.lag_max_us = loop_gap_max_us;
+
+    uint8_t payload[RX_STATS_LEN];
+    uint8_t wire[FRAME_MAX_WIRE];
+    uint8_t len = rx_stats_encode(&r, payload);
+    uplinkWrite(wire, frame_encode_addr(wire, BUS_ADDR, CMD_RX_STATS, payload, len, link_framing),
+                NULL);
+}
+#endif
+
+// ================= UART RX TASK =================
+// Pinned to core 0 so LVGL rendering on core 1 never delays ingestion
+static void DisplayUART(void *arg) {
+    static uint8_t chunk[UART_RX_CHUNK];
+
+    for (;;) {
+        int framing = rx_framing_req;
+        if (framing >= 0) {
+            rxParser.setFraming((Framing)framing);
+            rx_framing_req = -1;
+        }
+
+        size_t avail = simLink.available();
+        if (avail == 0) {
+            vTaskDelay(1);   // Driver ring buffer holds the backlog meanwhile
+            continue;
         }
+        if (avail >= UART_RX_BUFFER_SIZE - 1) {
+            rxStats.overflows++;
+        }
+        if (avail > rxStats.backlog_max) rxStats.backlog_max = avail;
+
+        size_t n = simLink.read(chunk, sizeof(chunk));
+        rxStats.bytes += n;
+        uint32_t t0 = micros();
+        rx_chunk_us = t0;
+        rxParser.feed(chunk, n);
+        rxStats.decode_us += micros() - t0;
+        publishTelemetry();
     }
 }
 
-static void update_10ms(void)
+#if RX_STATS_DEBUG
+static void report_rx_stats(void)
+{
+    static RxStats last = {0};
+    static uint32_t last_frames = 0;
+    const FrameParserStats &ps = rxParser.stats();
+
+    Serial.printf("RX %lu B/s, %lu frames/s, %lu records/s, decode %lu us/s, "
+                  "crc errors %lu, resyncs %lu, skipped %lu, overflows %lu, "
+                  "queue drops %lu\n",
+                  rxStats.bytes - last.bytes,
+                  ps.frames - last_frames,
+                  rxStats.records - last.records,
+                  rxStats.decode_us - last.decode_us,
+                  ps.crc_errors,
+                  ps.resyncs,
+                  ps.skipped,
+                  rxStats.overflows,
+                  rxStats.queue_drops);
+    const CommandLinkStats &ls = cmdLink.stats();
+    Serial.printf("TX commands %lu, retransmits %lu, failed %lu, rejected %lu, "
+                  "ack latency %lu ms (max %lu ms)\n",
+                  ls.sent, ls.retransmits, ls.failed, ls.rejected,
+                  ls.last_ms, ls.max_ms);
+
+#if TELEMETRY_LINK_CAN
+    const CanStats &cs = can.stats();
+    Serial.printf("CAN frames %lu, records %lu, filtered %lu, segment errors %lu, "
+                  "overflows %lu\n",
+                  cs.frames_rx, cs.records_rx, cs.filtered, cs.seg_errors,
+                  cs.rx_overflow);
+#elif TELEMETRY_BUS
+    const PolledStats &bus = polled.stats();
+    Serial.printf("Bus node %u, polls %lu, frames %lu, deferred %lu, dropped %lu, "
+                  "not ours %lu\n",
+                  BUS_NODE_ID, bus.grants, bus.frames, bus.deferred, bus.dropped,
+                  rxStats.not_ours);
+#else
+    const BaudStats &bs = baudLink.stats();
+    Serial.printf("UART %lu baud, errors %lu ppm, attempts %lu, fallbacks %lu\n",
+                  baudLink.baud(), bs.error_ppm, bs.attempts, bs.fallbacks);
+#endif
+
+    static const char *const hs_names[] = {
+        "idle", "resume", "hello", "configure", "done", "fallback", "retry"
+    };
+    const LinkConfig &lc = handshake.config();
+    Serial.printf("Link %s, sim v%u, framing %u, features 0x%04x\n",
+                  hs_names[handshake.state()], handshake.peer().version,
+                  link_framing, handshake.done() ? lc.features : 0);
+
+    last = rxStats;
+    last_frames = ps.frames;
+}
+#endif
+
+static void update_10ms(uint32_t changed)
 {
     uint32_t now = millis();
 
     // ---------- RPM ----------
-    static uint16_t last_rpm = 0;
-    if (received_data.rpms != last_rpm) {
-        last_rpm = received_data.rpms;
+    if (changed & FIELD_RPMS) {
         char buf[8];
-        snprintf(buf, sizeof(buf), "%3u rpm", last_rpm);
+        snprintf(buf, sizeof(buf), "%3u rpm", received_data.rpms);
         lv_label_set_text(ui_rpmLabel, buf);
     }
 
     // ---------- Velocity (1 decimal) ----------
-    static float last_velocity = -1.0f;
-    if (received_data.velocity != last_velocity) {
-        last_velocity = received_data.velocity;
+    if (changed & FIELD_VELOCITY) {
         char buf[8];
-        snprintf(buf, sizeof(buf), "%.1f", last_velocity);
+        snprintf(buf, sizeof(buf), "%.1f", received_data.velocity);
         lv_label_set_text(ui_velocityLabel, buf);
     }
     // ---------- Arc (velocity 0–100 → arc 0–99) ----------
-    uint16_t arc_val = (uint16_t)(received_data.velocity);
-    if (arc_val > 99) arc_val = 99;
-
     //Low pass for smoother animation
     static float arc_display = 0.0f;   // persistent displayed value
-    arc_display += (arc_val - arc_display) * 0.18f;
+    static uint32_t arc_sample = 0;    // Next velocityHistory sample to use
+
+    if (velocityHistory.count() != arc_sample) {
+        // Filter every 1 ms sample so short spikes still move the arc
+        if (arc_sample < velocityHistory.first()) arc_sample = velocityHistory.first();
+        for (; arc_sample < velocityHistory.count(); arc_sample++) {
+            float v = velocityHistory.at(arc_sample).value / 10.0f;
+            if (v > 99) v = 99;
+            arc_display += (v - arc_display) * ARC_SAMPLE_ALPHA;
+        }
+    } else {
+        uint16_t arc_val = (uint16_t)(received_data.velocity);
+        if (arc_val > 99) arc_val = 99;
+        arc_display += (arc_val - arc_display) * 0.18f;
+    }
     lv_arc_set_value(ui_Arc1, (uint16_t)arc_display);
 
 
     // ---------- Lap change detection ----------
-    if (received_data.laps != last_laps) {
-        last_laps = received_data.laps;
-        lap_start_ms = now;
-
-        // First lap → reset full attempt timer
-        if (received_data.laps == 1) {
-            attempt_start_ms = now;
-        }
-        // Reset button pressed
-        else if(received_data.laps == 0){
-            lv_label_set_text(ui_fullattemptLabel, "00:00.00");
-            lv_label_set_text(ui_laptimeLabel, "00:00.00");
-            attempt_start_ms = 0;
-            lap_start_ms = 0;
-        }
-
-        char buf[4];
-        snprintf(buf, sizeof(buf), "%u", received_data.laps);
-        lv_label_set_text(ui_lapsLabel, buf);
+    // Normally already handled by CMD_LAP_EVENT; this only fires if that
+    // frame was lost, and then is up to 100 ms late
+    if ((changed & FIELD_LAPS) && received_data.laps != last_laps) {
+        start_lap(received_data.laps, now);
     }
 
     // ---------- Full attempt timer ----------
@@ -247,8 +825,25 @@ static void update_10ms(void)
     }
 }
 
-static void update_100ms(void)
+static void update_100ms(uint32_t changed)
 {
+    // ---------- Consumption (2 decimals) ----------
+    if (changed & FIELD_CONSUMPTION) {
+        char buf[10];
+        snprintf(buf, sizeof(buf), "%.2f", received_data.consumption);
+        lv_label_set_text(ui_ConsumptionLabel, buf);
+    }
+
+    // ---------- Efficiency (2 decimals) ----------
+    if (changed & FIELD_EFFICIENCY) {
+        char buf[10];
+        snprintf(buf, sizeof(buf), "%.2f", received_data.efficiency);
+        lv_label_set_text(ui_EfficiencyLabel, buf);
+    }
+
+    // Arc color and battery fill both follow velocity
+    if (!(changed & FIELD_VELOCITY)) return;
+
     // ---------- Arc color swapping ----------
     float v = received_data.velocity;
     lv_color_t c;
@@ -265,15 +860,6 @@ static void update_100ms(void)
     }
     lv_obj_set_style_arc_color(ui_Arc1, c, LV_PART_INDICATOR);
 
-    // ---------- Consumption (2 decimals) ----------
-    char buf[10];
-    snprintf(buf, sizeof(buf), "%.2f", received_data.consumption);
-    lv_label_set_text(ui_ConsumptionLabel, buf);
-
-    // ---------- Efficiency (2 decimals) ----------
-    snprintf(buf, sizeof(buf), "%.2f", received_data.efficiency);
-    lv_label_set_text(ui_EfficiencyLabel, buf);
-
     static lv_obj_t *bat_clip = NULL;
     static lv_coord_t full_h;
     static lv_coord_t base_y;
@@ -332,9 +918,15 @@ static void update_2s(void)
 
 void update_message_label(void)
 {
+    if (messages.update(millis()))
+        message_dirty = true;
     if (!message_dirty && received_data.tx_message == last_message_type)
         return;
 
+    // Sim went back to idle: whatever is still queued is stale
+    if (received_data.tx_message == IDLE_MSG && last_message_type == CUSTOM_MSG)
+        messages.clear();
+
     last_message_type = received_data.tx_message;
     message_dirty = false;
 
@@ -351,8 +943,10 @@ void update_message_label(void)
             break; 
 
         case CUSTOM_MSG:
-            lv_label_set_text(ui_messageLabel, custom_msg_buf);
-            lv_obj_set_style_text_color(ui_messageLabel, lv_color_hex(0xD4D3D6), LV_PART_MAIN | LV_STATE_DEFAULT);
+            lv_label_set_text(ui_messageLabel, messages.current() ? messages.current() : "");
+            lv_obj_set_style_text_color(ui_messageLabel,
+                                        lv_color_hex(messages.currentPriority() == MSG_PRIO_URGENT ? 0xE5484D : 0xD4D3D6),
+                                        LV_PART_MAIN | LV_STATE_DEFAULT);
             break;
 
         default:
@@ -363,13 +957,30 @@ void update_message_label(void)
 // ================= SETUP =================
 void setup()
 {
-    //Serial.begin(115200); //Debug Data RX prints
+#if RX_STATS_DEBUG || TELEMETRY_TRACE
+    Serial.begin(115200); //Debug Data RX prints
+#endif
+#if TELEMETRY_LINK_CAN
+    can.accept(can_rx_cmds, sizeof(can_rx_cmds));
+    if (!canBus.begin()) {
+#if RX_STATS_DEBUG || TELEMETRY_TRACE
+        Serial.printf("CAN start failed at %lu bit/s\n", (unsigned long)CAN_BITRATE);
+#endif
+    }
+#else
+    DisplaySerial.setRxBufferSize(UART_RX_BUFFER_SIZE); // must precede begin()
     DisplaySerial.begin(
         BAUDRATE,
         SERIAL_8N1,
         DISPLAY_RX_PIN,
         DISPLAY_TX_PIN
     );
+#if TELEMETRY_BUS
+    // Driver enabled only while we send, so the other displays can talk
+    DisplaySerial.setPins(DISPLAY_RX_PIN, DISPLAY_TX_PIN, -1, BUS_DE_PIN);
+    DisplaySerial.setMode(UART_MODE_RS485_HALF_DUPLEX);
+#endif
+#endif
 
     elyos_display_init();
     elyos_lvgl_init();
@@ -377,39 +988,168 @@ void setup()
     elyos_backlight_init(200);
 
     ui_init();
+#if TELEMETRY_TRACE
+    elyos_flush_done_cb = trace_flushed;
+#endif
+
+    // Before the RX task starts parsing
+    rxDispatch.node      = BUS_ADDR;
+    rxDispatch.groups    = TELEMETRY_BUS ? BUS_GROUPS : GROUP_ALL;
+    rxDispatch.data      = &rx_data;
+    rxDispatch.changed   = &rx_changed;
+    rxDispatch.not_ours  = onNotOurs;
+    rxDispatch.record    = onRecord;
+    rxDispatch.samples   = onSamples;
+    rxDispatch.lap_event = onLapEvent;
+    rxDispatch.probe     = onProbe;
+    rxDispatch.event     = onEvent;
+#if TELEMETRY_BUS
+    rxDispatch.poll      = onPoll;
+#endif
+#if TELEMETRY_TRACE
+    rxDispatch.traced    = onTraced;
+#endif
+
+    xTaskCreatePinnedToCore(DisplayUART, "uart_rx", RX_TASK_STACK, NULL,
+                            RX_TASK_PRIORITY, &rxTaskHandle, RX_TASK_CORE);
+
+    cmdLink.setResultHandler(onCommandResult);
+    cmdLink.setAddress(BUS_ADDR);
+    loadLinkConfig();
+    handshake.start(millis(), link_cache_valid ? &link_cache : NULL);
+}
+
+// ================= LINK LOSS =================
+// Nothing parsed for LINK_TIMEOUT_MS: the simulator rebooted or gave up on
+// us and is back on the boot configuration, so go there too and reconnect.
+// A simulator we gave up configuring (another version, or one that refused
+// our configuration) may come back updated, so ask it again.
+static void checkLink(uint32_t now)
+{
+    static uint32_t last_frames = 0;
+    static uint32_t last_rx_ms  = 0;
+
+    uint32_t frames = rxParser.stats().frames;
+    if (frames != last_frames) {
+        last_frames = frames;
+        last_rx_ms = now;
+        return;
+    }
+    if (now - last_rx_ms <= LINK_TIMEOUT_MS) return;
+    last_rx_ms = now;   // One attempt per timeout
+
+    bool moved = link_framing != TELEMETRY_FRAMING || baudLink.baud() != BAUDRATE;
+    Handshake::State hs = handshake.state();
+    if (!moved && hs != Handshake::HS_DONE && hs != Handshake::HS_FALLBACK) return;
+
+    baudLink.stop();
+    setFraming(TELEMETRY_FRAMING);
+    handshake.start(now, link_cache_valid ? &link_cache : NULL);
 }
 
 // ================= LOOP =================
 void loop()
 {
-    DisplayUART();   // Non-blocking RX-TX
+    // One consistent telemetry copy per pass
+    uint32_t changed = drainFrames();
+    changed_10ms  |= changed;
+    changed_100ms |= changed;
+    trace_picked_up(changed);
 
     uint32_t now = millis();
 
+    // Frames decoded during a long pass wait this long for the UI
+    static uint32_t last_loop_us = 0;
+    uint32_t loop_us = micros();
+    if (last_loop_us && loop_us - last_loop_us > loop_gap_max_us) {
+        loop_gap_max_us = loop_us - last_loop_us;
+    }
+    last_loop_us = loop_us;
+
+    // ---------- Commands to the simulator ----------
+    if(button_aux){ //Trigger when button pressed TX
+        cmdLink.send(CTRL_RESET, NULL, 0, now);
+        button_aux = 0;
+    }
+    cmdLink.poll(now);
+    handshake.poll(now);
+    baudLink.poll(now, linkCounters());
+    checkLink(now);
+
     // ---------- LVGL ----------
     static uint32_t last_lvgl_ms = 0;
     if (now - last_lvgl_ms >= 5) {
         last_lvgl_ms = now;
+        uint32_t t0 = micros();
         lv_timer_handler();
+        uint32_t pass_us = micros() - t0;
+        lvgl_busy_us += pass_us;
+        lvgl_passes++;
+        if (pass_us > lvgl_max_us) lvgl_max_us = pass_us;
+    }
+
+#if LOAD_REPORTS
+    // ---------- Load report (backpressure) ----------
+    static uint32_t last_load_ms = 0;
+    if (now - last_load_ms >= LOAD_REPORT_MS) {
+        // Only what the simulator agreed to in CTRL_CONFIGURE
+        if (handshake.done()) {
+            uint16_t features = handshake.config().features;
+            if (features & FEAT_RX_STATS) sendRxStats();
+            if (features & FEAT_LOAD)     sendLoadReport(now - last_load_ms);
+        }
+        startLoadWindow();
+        last_load_ms = now;
+    }
+#endif
+
+    // ---------- Keepalive ----------
+    // A configured simulator goes back to the boot configuration when it
+    // hears nothing for LINK_TIMEOUT_MS. Load reports feed it only when
+    // built and agreed, so ping whenever nothing else went up.
+    if (handshake.done() && cmdLink.idle() && now - last_uplink_ms >= BAUD_KEEPALIVE_MS) {
+        cmdLink.send(CTRL_PING, NULL, 0, now);
     }
 
     update_message_label(); 
+    trace_drawn(FIELD_TX_MESSAGE);
 
     // ---------- 10 ms ----------
     if (now - last_10ms_update >= 10) {
         last_10ms_update = now;
-        update_10ms();
+        update_10ms(changed_10ms);
+        trace_drawn(changed_10ms & (FIELD_RPMS | FIELD_VELOCITY | FIELD_LAPS));
+        changed_10ms = 0;
     }
 
     // ---------- 100 ms ----------
     if (now - last_100ms_update >= 100) {
         last_100ms_update = now;
-        update_100ms();
+        update_100ms(changed_100ms);
+        trace_drawn(changed_100ms & (FIELD_CONSUMPTION | FIELD_EFFICIENCY));
+        changed_100ms = 0;
     }
 
     // ---------- 2 seconds ----------
     if (now - last_2s_update >= 2000) {
         last_2s_update = now;
         update_2s();
+        trace_drawn(FIELD_BATTERY_VOLTAGE | FIELD_CURRENT_AMPS);
+    }
+
+#if RX_STATS_DEBUG
+    static uint32_t last_stats_ms = 0;
+    if (now - last_stats_ms >= 1000) {
+        last_stats_ms = now;
+        report_rx_stats();
+    }
+#endif
+
+#if TELEMETRY_TRACE
+    static uint32_t last_trace_ms = 0;
+    if (now - last_trace_ms >= TRACE_REPORT_MS) {
+        last_trace_ms = now;
+        rxTrace.report(trace_print);
     }
+#endif
 }